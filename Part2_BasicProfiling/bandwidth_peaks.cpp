@@ -0,0 +1,312 @@
+#include "bandwidth_peaks.h"
+
+#include <stdio.h>
+#include <immintrin.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#if _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "cpu_features.h"
+#include "platform_metrics.h"
+#include "tsc_frequency.h"
+
+// NOTE(Umut): Same as haversine_batch.cpp, GCC and clang only emit AVX2 inside functions compiled for it.
+#if _MSC_VER
+#define BEGIN_TARGET_AVX2
+#define END_TARGET
+#else
+#define BEGIN_TARGET_AVX2 _Pragma("GCC push_options") _Pragma("GCC target(\"avx2\")")
+#define END_TARGET _Pragma("GCC pop_options")
+#endif
+
+static const char* MEMORY_LEVEL_NAMES[MEMORY_LEVEL_COUNT] = {
+	"L1",
+	"L2",
+	"L3",
+	"DRAM",
+};
+
+// Used for a level the OS does not report.
+const u64 DEFAULT_CACHE_SIZES[MEMORY_LEVEL_DRAM] = { 32 * 1024, 1024 * 1024, 8 * 1024 * 1024 };
+const u64 MIN_DRAM_TEST_SIZE = 64ull * 1024 * 1024;
+const u64 MAX_DRAM_TEST_SIZE = 256ull * 1024 * 1024;
+const u64 TEST_SIZE_ALIGNMENT = 4096;
+
+// NOTE(Umut): Every trial repeats the pass for at least a millisecond, the fastest trial is kept.
+const u32 BANDWIDTH_TRIAL_COUNT = 4;
+const u64 MIN_TRIAL_MICROSECONDS = 1000;
+
+static const char* BANDWIDTH_PEAKS_CACHE_FILE_NAME = "bandwidth_peaks.txt";
+
+using BandwidthKernel = void (*)(u8* data, const u64 size);
+
+// Keeps the loads of the read kernels from being optimized out.
+static volatile s32 readSink;
+
+static void ReadSse(u8* data, const u64 size)
+{
+	__m128i a = _mm_setzero_si128();
+	__m128i b = _mm_setzero_si128();
+	__m128i c = _mm_setzero_si128();
+	__m128i d = _mm_setzero_si128();
+	for (u64 i = 0; i < size; i += 64) {
+		a = _mm_or_si128(a, _mm_load_si128(reinterpret_cast<const __m128i*>(data + i)));
+		b = _mm_or_si128(b, _mm_load_si128(reinterpret_cast<const __m128i*>(data + i + 16)));
+		c = _mm_or_si128(c, _mm_load_si128(reinterpret_cast<const __m128i*>(data + i + 32)));
+		d = _mm_or_si128(d, _mm_load_si128(reinterpret_cast<const __m128i*>(data + i + 48)));
+	}
+
+	readSink = _mm_cvtsi128_si32(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)));
+}
+
+static void WriteSse(u8* data, const u64 size)
+{
+	const __m128i value = _mm_set1_epi8(1);
+	for (u64 i = 0; i < size; i += 64) {
+		_mm_store_si128(reinterpret_cast<__m128i*>(data + i), value);
+		_mm_store_si128(reinterpret_cast<__m128i*>(data + i + 16), value);
+		_mm_store_si128(reinterpret_cast<__m128i*>(data + i + 32), value);
+		_mm_store_si128(reinterpret_cast<__m128i*>(data + i + 48), value);
+	}
+}
+
+// NOTE(Umut): Large memsets and copies switch to non-temporal stores, which beat regular stores to DRAM.
+static void WriteStreamSse(u8* data, const u64 size)
+{
+	const __m128i value = _mm_set1_epi8(1);
+	for (u64 i = 0; i < size; i += 64) {
+		_mm_stream_si128(reinterpret_cast<__m128i*>(data + i), value);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(data + i + 16), value);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(data + i + 32), value);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(data + i + 48), value);
+	}
+	_mm_sfence();
+}
+
+static void CopySse(u8* data, const u64 size)
+{
+	const u64 half = size / 2;
+	for (u64 i = 0; i < half; i += 32) {
+		const __m128i a = _mm_load_si128(reinterpret_cast<const __m128i*>(data + i));
+		const __m128i b = _mm_load_si128(reinterpret_cast<const __m128i*>(data + i + 16));
+		_mm_store_si128(reinterpret_cast<__m128i*>(data + half + i), a);
+		_mm_store_si128(reinterpret_cast<__m128i*>(data + half + i + 16), b);
+	}
+}
+
+BEGIN_TARGET_AVX2
+
+static void ReadAvx2(u8* data, const u64 size)
+{
+	__m256i a = _mm256_setzero_si256();
+	__m256i b = _mm256_setzero_si256();
+	__m256i c = _mm256_setzero_si256();
+	__m256i d = _mm256_setzero_si256();
+	for (u64 i = 0; i < size; i += 128) {
+		a = _mm256_or_si256(a, _mm256_load_si256(reinterpret_cast<const __m256i*>(data + i)));
+		b = _mm256_or_si256(b, _mm256_load_si256(reinterpret_cast<const __m256i*>(data + i + 32)));
+		c = _mm256_or_si256(c, _mm256_load_si256(reinterpret_cast<const __m256i*>(data + i + 64)));
+		d = _mm256_or_si256(d, _mm256_load_si256(reinterpret_cast<const __m256i*>(data + i + 96)));
+	}
+
+	const __m256i result = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+	readSink = _mm_cvtsi128_si32(_mm256_castsi256_si128(result));
+}
+
+static void WriteAvx2(u8* data, const u64 size)
+{
+	const __m256i value = _mm256_set1_epi8(1);
+	for (u64 i = 0; i < size; i += 128) {
+		_mm256_store_si256(reinterpret_cast<__m256i*>(data + i), value);
+		_mm256_store_si256(reinterpret_cast<__m256i*>(data + i + 32), value);
+		_mm256_store_si256(reinterpret_cast<__m256i*>(data + i + 64), value);
+		_mm256_store_si256(reinterpret_cast<__m256i*>(data + i + 96), value);
+	}
+}
+
+static void CopyAvx2(u8* data, const u64 size)
+{
+	const u64 half = size / 2;
+	for (u64 i = 0; i < half; i += 64) {
+		const __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i*>(data + i));
+		const __m256i b = _mm256_load_si256(reinterpret_cast<const __m256i*>(data + i + 32));
+		_mm256_store_si256(reinterpret_cast<__m256i*>(data + half + i), a);
+		_mm256_store_si256(reinterpret_cast<__m256i*>(data + half + i + 32), b);
+	}
+}
+
+END_TARGET
+
+const char* GetMemoryLevelName(const u32 level)
+{
+	return (level < MEMORY_LEVEL_COUNT) ? MEMORY_LEVEL_NAMES[level] : "unknown";
+}
+
+MemoryLevel GetMemoryLevel(const BandwidthPeaks& peaks, const u64 workingSetSize)
+{
+	for (u32 level = 0; level < MEMORY_LEVEL_DRAM; ++level) {
+		if (workingSetSize <= peaks.levelSizes[level]) {
+			return static_cast<MemoryLevel>(level);
+		}
+	}
+
+	return MEMORY_LEVEL_DRAM;
+}
+
+static void ReadCacheSizes(u64* sizesOut)
+{
+	for (u32 level = 0; level < MEMORY_LEVEL_DRAM; ++level) {
+		sizesOut[level] = 0;
+	}
+
+#if _WIN32
+	DWORD length = 0;
+	GetLogicalProcessorInformation(nullptr, &length);
+	std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> infos(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+	if (!infos.empty() && GetLogicalProcessorInformation(infos.data(), &length)) {
+		for (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION& info : infos) {
+			const CACHE_DESCRIPTOR& cache = info.Cache;
+			const bool isDataCache = (cache.Type == CacheData) || (cache.Type == CacheUnified);
+			if ((info.Relationship == RelationCache) && isDataCache && (cache.Level >= 1) && (cache.Level <= MEMORY_LEVEL_DRAM)) {
+				sizesOut[cache.Level - 1] = cache.Size;
+			}
+		}
+	}
+#else
+	const s32 names[MEMORY_LEVEL_DRAM] = { _SC_LEVEL1_DCACHE_SIZE, _SC_LEVEL2_CACHE_SIZE, _SC_LEVEL3_CACHE_SIZE };
+	for (u32 level = 0; level < MEMORY_LEVEL_DRAM; ++level) {
+		const long size = sysconf(names[level]);
+		sizesOut[level] = (size > 0) ? static_cast<u64>(size) : 0;
+	}
+#endif
+
+	for (u32 level = 0; level < MEMORY_LEVEL_DRAM; ++level) {
+		sizesOut[level] = sizesOut[level] ? sizesOut[level] : DEFAULT_CACHE_SIZES[level];
+	}
+}
+
+static f64 MeasureBandwidth(const BandwidthKernel kernel, u8* data, const u64 size, const u64 cpuFreq)
+{
+	const u64 minTrialTime = cpuFreq * MIN_TRIAL_MICROSECONDS / 1000000;
+	f64 best = 0.0;
+	for (u32 trial = 0; trial < BANDWIDTH_TRIAL_COUNT; ++trial) {
+		u64 passCount = 0;
+		u64 elapsedTime = 0;
+		const u64 startTime = ReadCPUTimer();
+		do {
+			kernel(data, size);
+			++passCount;
+			elapsedTime = ReadCPUTimer() - startTime;
+		} while (elapsedTime < minTrialTime);
+
+		const f64 bytesPerSecond = static_cast<f64>(passCount * size) * static_cast<f64>(cpuFreq) / static_cast<f64>(elapsedTime);
+		best = (bytesPerSecond > best) ? bytesPerSecond : best;
+	}
+
+	return best;
+}
+
+static BandwidthPeaks MeasureBandwidthPeaks()
+{
+	BandwidthPeaks peaks = {};
+	ReadCacheSizes(peaks.levelSizes);
+
+	const u64 dramSize = peaks.levelSizes[MEMORY_LEVEL_L3] * 2;
+	peaks.levelSizes[MEMORY_LEVEL_DRAM] = (dramSize < MIN_DRAM_TEST_SIZE) ? MIN_DRAM_TEST_SIZE
+										: ((dramSize > MAX_DRAM_TEST_SIZE) ? MAX_DRAM_TEST_SIZE : dramSize);
+
+	const bool hasAvx2 = GetCpuFeatures().avx2;
+	const BandwidthKernel read = hasAvx2 ? ReadAvx2 : ReadSse;
+	const BandwidthKernel write = hasAvx2 ? WriteAvx2 : WriteSse;
+	const BandwidthKernel copy = hasAvx2 ? CopyAvx2 : CopySse;
+
+	// NOTE(Umut): One buffer for every level, faulted in up front so no level pays for the page faults.
+	u8* data = static_cast<u8*>(_mm_malloc(peaks.levelSizes[MEMORY_LEVEL_DRAM], 64));
+	if (!data) {
+		return peaks;
+	}
+	WriteSse(data, peaks.levelSizes[MEMORY_LEVEL_DRAM]);
+
+	const u64 cpuFreq = GetEstimatedCPUFrequency();
+	for (u32 level = 0; level < MEMORY_LEVEL_COUNT; ++level) {
+		// Half a cache leaves room for the stack and everything else the core touches meanwhile.
+		const u64 levelSize = (level == MEMORY_LEVEL_DRAM) ? peaks.levelSizes[level] : peaks.levelSizes[level] / 2;
+		const u64 size = (levelSize / TEST_SIZE_ALIGNMENT) * TEST_SIZE_ALIGNMENT;
+		peaks.readBytesPerSecond[level] = MeasureBandwidth(read, data, size, cpuFreq);
+		peaks.writeBytesPerSecond[level] = MeasureBandwidth(write, data, size, cpuFreq);
+		if (level == MEMORY_LEVEL_DRAM) {
+			const f64 streamBytesPerSecond = MeasureBandwidth(WriteStreamSse, data, size, cpuFreq);
+			peaks.writeBytesPerSecond[level] = std::max(peaks.writeBytesPerSecond[level], streamBytesPerSecond);
+		}
+		peaks.copyBytesPerSecond[level] = MeasureBandwidth(copy, data, size, cpuFreq);
+	}
+
+	_mm_free(data);
+	return peaks;
+}
+
+static bool LoadCachedBandwidthPeaks(const std::string& path, const std::string& identity, BandwidthPeaks& peaksOut)
+{
+	FILE* file = nullptr;
+	if (path.empty() || fopen_s(&file, path.c_str(), "rb") || !file) {
+		return false;
+	}
+
+	char line[256] = {};
+	bool valid = fgets(line, sizeof(line), file) && (identity + "\n" == line);
+	for (u32 level = 0; valid && (level < MEMORY_LEVEL_COUNT); ++level) {
+		unsigned long long size = 0;
+		valid = fgets(line, sizeof(line), file)
+			&& (sscanf(line, "%llu %lf %lf %lf", &size, &peaksOut.readBytesPerSecond[level], &peaksOut.writeBytesPerSecond[level],
+					   &peaksOut.copyBytesPerSecond[level]) == 4);
+		peaksOut.levelSizes[level] = size;
+	}
+	fclose(file);
+
+	return valid;
+}
+
+static void StoreCachedBandwidthPeaks(const std::string& path, const std::string& identity, const BandwidthPeaks& peaks)
+{
+	FILE* file = nullptr;
+	if (path.empty() || fopen_s(&file, path.c_str(), "wb") || !file) {
+		return;
+	}
+
+	fprintf(file, "%s\n", identity.c_str());
+	for (u32 level = 0; level < MEMORY_LEVEL_COUNT; ++level) {
+		fprintf(file, "%llu %.0f %.0f %.0f\n", peaks.levelSizes[level], peaks.readBytesPerSecond[level], peaks.writeBytesPerSecond[level],
+				peaks.copyBytesPerSecond[level]);
+	}
+	fclose(file);
+}
+
+static BandwidthPeaks DiscoverBandwidthPeaks()
+{
+	const std::string path = GetMachineCachePath(BANDWIDTH_PEAKS_CACHE_FILE_NAME);
+	const std::string identity = GetCpuIdentity();
+
+	BandwidthPeaks peaks = {};
+	if (LoadCachedBandwidthPeaks(path, identity, peaks)) {
+		return peaks;
+	}
+
+	peaks = MeasureBandwidthPeaks();
+	if (peaks.readBytesPerSecond[MEMORY_LEVEL_L1] > 0.0) {
+		StoreCachedBandwidthPeaks(path, identity, peaks);
+	}
+
+	return peaks;
+}
+
+const BandwidthPeaks& GetBandwidthPeaks()
+{
+	static const BandwidthPeaks peaks = DiscoverBandwidthPeaks();
+	return peaks;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "basedef.h"
+
+enum MemoryLevel : u32
+{
+	MEMORY_LEVEL_L1,
+	MEMORY_LEVEL_L2,
+	MEMORY_LEVEL_L3,
+	MEMORY_LEVEL_DRAM,
+
+	MEMORY_LEVEL_COUNT,
+};
+
+/* NOTE(Umut): Best single thread bandwidth this machine reaches out of each cache level and out of DRAM,
+   measured with a working set of half the cache (twice the last level for DRAM). Copy counts both the bytes
+   read and the bytes written, the DRAM write peak also tries non-temporal stores. Measuring takes about a
+   second, so the result is cached on disk next to the TSC frequency, keyed by the CPU. */
+struct BandwidthPeaks
+{
+	// Cache size of the level, the DRAM entry is the buffer the DRAM peaks were measured on.
+	u64 levelSizes[MEMORY_LEVEL_COUNT];
+	f64 readBytesPerSecond[MEMORY_LEVEL_COUNT];
+	f64 writeBytesPerSecond[MEMORY_LEVEL_COUNT];
+	f64 copyBytesPerSecond[MEMORY_LEVEL_COUNT];
+};
+
+/**
+ * @brief Peaks of the current machine, loaded from the cache or measured on the first call.
+ */
+const BandwidthPeaks& GetBandwidthPeaks();
+
+/**
+ * @brief Smallest level a working set of the given size fits in.
+ */
+MemoryLevel GetMemoryLevel(const BandwidthPeaks& peaks, const u64 workingSetSize);
+
+const char* GetMemoryLevelName(const u32 level);
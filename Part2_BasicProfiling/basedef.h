@@ -19,3 +19,10 @@ using f64 = double;
 
 #define PROFILER 1
 #define ALTERNATE_TIMER 0
+#define PROFILER_TRACE 0
+#define PROFILER_PERF_COUNTERS 0
+#define PROFILER_OS_COUNTERS 0
+#define PROFILER_SAMPLING 0
+#define PROFILER_HISTOGRAMS 0
+#define PROFILER_LIVE 0
+#define PROFILER_RUNTIME_TOGGLE 0
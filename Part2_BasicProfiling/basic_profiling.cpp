@@ -12,11 +12,15 @@
 #include "haversine.h"
 #include "parser.h"
 #include "profiler.h"
-
-std::random_device randomDevice;
-std::mt19937_64 generator(randomDevice());
-std::uniform_real_distribution<f64> distGlobalX(-180.0, 180.0);
-std::uniform_real_distribution<f64> distGlobalY(-90.0, 90.0);
+#include "mapped_file.h"
+#include "validation.h"
+#include "sampled_mean.h"
+#include "quantized_pairs.h"
+#include "distance_matrix.h"
+#include "spatial_index.h"
+#include "pair_generator.h"
+#include "profile_compare.h"
+#include "profile_live.h"
 
 const char* DATA_FILE_NAME_BASE = "data/haversine_data";
 const char* DATA_FILE_NAME_EXT = ".json";
@@ -24,168 +28,282 @@ const char* DATA_FILE_NAME_EXT = ".json";
 const char* ANSWERS_FILE_NAME_BASE = "data/haversine_answers";
 const char* ANSWERS_FILE_NAME_EXT = ".f64";
 
+const char* QUANTIZED_FILE_NAME_BASE = "data/haversine_quantized";
+const char* QUANTIZED_FILE_NAME_EXT = ".hvq";
+
+const char* TRACE_FILE_NAME = "data/haversine_trace.json";
+const char* COLLAPSED_STACKS_FILE_NAME = "data/haversine_stacks.txt";
+const char* PROFILE_JSON_FILE_NAME = "data/haversine_profile.json";
+const char* PROFILE_CSV_FILE_NAME = "data/haversine_profile.csv";
+
 const unsigned NUM_PAIRS = 1000000;
 const unsigned CLUSTER_COUNT = 32;
+const u64 GENERATOR_SEED = 0x5eed;
+// NOTE(Umut): The streaming writer keeps memory constant and writes sequentially, the parallel one is faster on many cores.
+const bool streamGeneratedData = false;
+const unsigned DEPOT_COUNT = 256;
+const unsigned SPATIAL_QUERY_COUNT = 1000;
+const f64 SPATIAL_QUERY_RADIUS = 50.0;
+const u32 SPATIAL_QUERY_NEIGHBOR_COUNT = 16;
 
-double wrapToRange(double value, double min, double max)
+inline void PrintPair(const HaversinePair& pair)
 {
-	const double range = max - min;
-	return (value < 0 ? max : min) + fmod(value, range);
+	std::cout << "x0: " << pair.p0.x << ", y0: " << pair.p0.y;
+	std::cout << ", x1: " << pair.p1.x << ", y1: " << pair.p1.y;
 }
 
-inline Point GetGlobalRandomPoint()
+PairGeneratorParameters GetGeneratorParameters(const bool isCluster)
 {
-	return { distGlobalX(generator), distGlobalY(generator) };
+	PairGeneratorParameters params;
+	params.pairCount = NUM_PAIRS;
+	params.seed = GENERATOR_SEED;
+	params.isCluster = isCluster;
+	params.clusterCount = CLUSTER_COUNT;
+	return params;
 }
 
-inline f64 GetRandom(const f64 min, const f64 max)
+f64 ComputeMeanDistance(const std::vector<HaversinePair>& pairs)
 {
-	std::uniform_real_distribution<f64> dist(min, max);
-	return dist(generator);
+	return HaversineSum(pairs) / static_cast<f64>(pairs.size());
 }
 
-HaversinePair CreateRandomPair(std::uniform_real_distribution<f64>& distX, std::uniform_real_distribution<f64>& distY)
+f64 ComputeDistances(const std::vector<HaversinePair>& pairs, std::vector<f64>& distancesOut)
 {
-	return {
-		wrapToRange(distX(generator), -180.0, 180.0),
-		wrapToRange(distY(generator), -90.0, 90.0),
-		wrapToRange(distX(generator), -180.0, 180.0),
-		wrapToRange(distY(generator), -90.0, 90.0)
-	};
-}
+	distancesOut.resize(pairs.size());
+	Haversine(pairs, distancesOut);
 
-inline void PrintPair(const HaversinePair& pair)
-{
-	std::cout << "x0: " << pair.p0.x << ", y0: " << pair.p0.y;
-	std::cout << ", x1: " << pair.p1.x << ", y1: " << pair.p1.y;
+	const f64 coef = 1.0 / static_cast<f64>(pairs.size());
+	f64 mean = 0;
+	for (const f64 distance : distancesOut) {
+		mean += coef * distance;
+	}
+
+	return mean;
 }
 
-std::vector<HaversinePair> CreateCluster(const Point center, const f64 xRange, const f64 yRange, const unsigned numPairs)
+void WriteGeneratedQuantizedPairs(const bool isCluster, const std::string& quantizedFileName)
 {
-	std::uniform_real_distribution<f64> distX(center.x - xRange, center.x + xRange);
-	std::uniform_real_distribution<f64> distY(center.y - yRange, center.y + yRange);
+	const PairGeneratorParameters params = GetGeneratorParameters(isCluster);
+	const f64 maxCoordinateError = WriteQuantizedPairs(NUM_PAIRS, [&params](const u64 firstPairIndex, std::span<HaversinePair> pairsOut) {
+		GeneratePairs(params, firstPairIndex, pairsOut);
+	}, quantizedFileName.c_str());
 
-	std::vector<HaversinePair> pairs;
-	pairs.resize(numPairs);
-	std::generate(pairs.begin(), pairs.end(), [&]() -> HaversinePair { return CreateRandomPair(distX, distY); });
-	return pairs;
+	fprintf(stdout, "Quantized pairs max coordinate error: %.12f degrees\n", maxCoordinateError);
 }
 
-std::vector<HaversinePair> CreatePairsCluster()
+void WritePairs(const bool isCluster)
 {
-	std::vector<HaversinePair> pairs;
-	pairs.reserve(NUM_PAIRS);
-	unsigned clusterPopulation = NUM_PAIRS / CLUSTER_COUNT;
+	const PairGeneratorParameters params = GetGeneratorParameters(isCluster);
 
-	for (size_t i = 0; i < CLUSTER_COUNT; ++i) {
-		if (i == CLUSTER_COUNT - 1) {
-			clusterPopulation = NUM_PAIRS - static_cast<unsigned>(pairs.size());
-		}
+	const std::string dataFileName = DATA_FILE_NAME_BASE + std::to_string(NUM_PAIRS) + DATA_FILE_NAME_EXT;
+	const std::string answersFileName = ANSWERS_FILE_NAME_BASE + std::to_string(NUM_PAIRS) + ANSWERS_FILE_NAME_EXT;
+
+	const u64 start = ReadCPUTimer();
+	const PairGeneratorResult result = streamGeneratedData ? StreamPairFiles(params, dataFileName.c_str(), answersFileName.c_str())
+															: WritePairFiles(params, dataFileName.c_str(), answersFileName.c_str());
+	const u64 elapsed = ReadCPUTimer() - start;
 
-		const Point center = GetGlobalRandomPoint();
-		const f64 xRange = GetRandom(0, 180);
-		const f64 yRange = GetRandom(0, 90);
-		std::vector<HaversinePair> cluster = CreateCluster(center, xRange, yRange, clusterPopulation);
-		pairs.insert(pairs.end(), std::make_move_iterator(cluster.begin()), std::make_move_iterator(cluster.end()));
+	if (!result.succeeded) {
+		fprintf(stderr, "ERROR: Unable to write %s and %s\n", dataFileName.c_str(), answersFileName.c_str());
+		return;
 	}
 
-	return pairs;
+	const f64 seconds = static_cast<f64>(elapsed) / static_cast<f64>(GetEstimatedCPUFrequency());
+	const f64 gigabytes = static_cast<f64>(result.dataBytes + result.answersBytes) / (1024.0 * 1024.0 * 1024.0);
+	fprintf(stdout, "Generated %u pairs (mean %.16f, hash %016llx), %.3f GB in %.3f s (%.3f GB/s)\n", NUM_PAIRS, result.mean,
+			result.contentHash, gigabytes, seconds, gigabytes / seconds);
 }
 
-std::vector<HaversinePair> CreatePairsUniform()
+bool ValidateResult(const size_t pairCount, const f64 computedMean, const MappedFile& answersFile)
 {
-	std::vector<HaversinePair> pairs;
-	pairs.resize(NUM_PAIRS);
-	std::generate(pairs.begin(), pairs.end(), [&]() { return CreateRandomPair(distGlobalX, distGlobalY); });
-	return pairs;
-}
+	if (!IsValid(answersFile)) {
+		return false;
+	}
 
-std::vector<HaversinePair> CreatePairs(const bool isCluster)
-{
-	if (!isCluster) {
-		return CreatePairsUniform();
+	const size_t answerPairCount = (answersFile.size - sizeof(f64)) / sizeof(f64);
+	if (pairCount != answerPairCount) {
+		fprintf(stdout, "Pair count does not match!");
+		return false;
 	}
 
-	return CreatePairsCluster();
+	const f64* answersArray = reinterpret_cast<const f64*>(answersFile.data);
+	const f64 refMean = answersArray[pairCount];
+
+	fprintf(stdout, "Reference mean: %.16f\n", refMean);
+	fprintf(stdout, "Difference: %.16f\n", computedMean - refMean);
+
+	return true;
 }
 
-f64 ComputeMeanDistance(const std::vector<HaversinePair>& pairs)
+void ReportSampledMeans(const std::vector<HaversinePair>& pairs)
 {
-
-	const f64 coef = 1.0 / static_cast<f64>(pairs.size());
-	f64 mean = 0;
-	for (const HaversinePair& pair : pairs) {
-		mean += coef * ReferenceHaversine(pair.p0.x, pair.p0.y, pair.p1.x, pair.p1.y, EARTH_RADIUS);
+	const u64 fullStart = ReadCPUTimer();
+	const f64 fullMean = ComputeMeanDistance(pairs);
+	const u64 fullElapsed = ReadCPUTimer() - fullStart;
+
+	fprintf(stdout, "Sampled mean (full scan: %.16f in %llu cycles):\n", fullMean, fullElapsed);
+
+	const f64 targetErrors[] = { 0.01, 0.001 };
+	const SamplingMode modes[] = { SamplingMode::Random, SamplingMode::Stratified };
+	for (const SamplingMode mode : modes) {
+		for (const f64 targetError : targetErrors) {
+			SampledMeanParameters params;
+			params.mode = mode;
+			params.targetRelativeError = targetError;
+			params.strataCount = CLUSTER_COUNT;
+
+			const u64 start = ReadCPUTimer();
+			const SampledMeanResult result = ComputeSampledMean(pairs, params);
+			const u64 elapsed = ReadCPUTimer() - start;
+
+			const f64 actualError = 100.0 * fabs(result.mean - fullMean) / fullMean;
+			const f64 sampledPercentage = 100.0 * static_cast<f64>(result.sampledPairCount) / static_cast<f64>(pairs.size());
+			const f64 speedup = elapsed ? (static_cast<f64>(fullElapsed) / static_cast<f64>(elapsed)) : 0.0;
+			fprintf(stdout, "  %-10s %.3f%%: %.16f +- %.6f (actual error %.4f%%), %llu pairs (%.2f%%), %.2fx faster\n",
+					(mode == SamplingMode::Random) ? "random" : "stratified", 100.0 * targetError,
+					result.mean, result.halfWidth, actualError, result.sampledPairCount, sampledPercentage, speedup);
+		}
 	}
-
-	return mean;
 }
 
-void WritePairs(const std::vector<HaversinePair>& pairs)
+void ReportNearestDepots(const std::vector<HaversinePair>& pairs)
 {
-	const std::string data_file_name = DATA_FILE_NAME_BASE + std::to_string(NUM_PAIRS) + DATA_FILE_NAME_EXT;
-	FILE* file;
-	errno_t err = fopen_s(&file, data_file_name.c_str(), "wb");
-	if (err || (!file)) {
-		return;
+	// NOTE(Umut): The first points of the first DEPOT_COUNT pairs act as depots, every second point as a customer.
+	std::vector<Point> depots;
+	std::vector<Point> customers;
+	customers.reserve(pairs.size());
+	for (const HaversinePair& pair : pairs) {
+		if (depots.size() < DEPOT_COUNT) {
+			depots.push_back(pair.p0);
+		}
+		customers.push_back(pair.p1);
 	}
 
-	const std::string answers_file_name = ANSWERS_FILE_NAME_BASE + std::to_string(NUM_PAIRS) + ANSWERS_FILE_NAME_EXT;
-	FILE* fileAnswers;
-	errno_t errAnswers = fopen_s(&fileAnswers, answers_file_name.c_str(), "wb");
-	if (errAnswers || (!fileAnswers)) {
-		return;
-	}
+	const UnitVectors depotVectors = ComputeUnitVectors(depots);
+	const UnitVectors customerVectors = ComputeUnitVectors(customers);
 
-	fprintf(file, "{\"pairs\":[");
+	std::vector<f64> nearestDistances(customers.size());
+	std::vector<u64> nearestDepots(customers.size());
 
-	const size_t pairCount = pairs.size();
-	const f64 coef = 1.0 / static_cast<f64>(pairCount);
-	f64 mean = 0;
+	const u64 start = ReadCPUTimer();
+	ComputeNearest(customerVectors, depotVectors, nearestDistances, nearestDepots);
+	const u64 elapsed = ReadCPUTimer() - start;
 
-	for (size_t i = 0; i < pairCount; ++i) {
-		const HaversinePair& pair = pairs[i];
-		const char* separator = (i < (pairCount - 1)) ? ",\n" : "\n";
-		fprintf(file, "{\"x0\":%.16f, \"y0\":%.16f, \"x1\":%.16f, \"y1\":%.16f}%s",
-				pair.p0.x, pair.p0.y, pair.p1.x, pair.p1.y, separator);
+	f64 meanDistance = 0;
+	f64 maxError = 0;
+	for (size_t i = 0; i < customers.size(); ++i) {
+		meanDistance += nearestDistances[i];
 
-		const f64 distance = ReferenceHaversine(pair.p0.x, pair.p0.y, pair.p1.x, pair.p1.y, EARTH_RADIUS);
-		mean += coef * distance;
-		fwrite(&distance, sizeof(f64), 1, fileAnswers);
+		// Spot check against the reference formula, a full brute force check would take longer than the matrix.
+		if (!(i % 4096)) {
+			const Point& depot = depots[nearestDepots[i]];
+			const f64 reference = ReferenceHaversine(customers[i].x, customers[i].y, depot.x, depot.y, EARTH_RADIUS);
+			maxError = (fabs(reference - nearestDistances[i]) > maxError) ? fabs(reference - nearestDistances[i]) : maxError;
+		}
 	}
+	meanDistance /= static_cast<f64>(customers.size());
 
-	fprintf(file, "]}");
-	fwrite(&mean, sizeof(f64), 1, fileAnswers);
+	const f64 distanceCount = static_cast<f64>(customers.size()) * static_cast<f64>(depots.size());
+	fprintf(stdout, "Nearest depot (%llu customers x %llu depots): mean %.6f, spot check max error %.3e, %.2f cycles/distance\n",
+			customers.size(), depots.size(), meanDistance, maxError, static_cast<f64>(elapsed) / distanceCount);
+}
 
-	fclose(file);
-	fclose(fileAnswers);
+void ReportSpatialQueries(const std::vector<HaversinePair>& pairs)
+{
+	const u64 cpuFreq = GetEstimatedCPUFrequency();
+
+	const u64 buildStart = ReadCPUTimer();
+	const SpatialIndex index = BuildSpatialIndex(pairs);
+	const u64 buildElapsed = ReadCPUTimer() - buildStart;
+
+	// NOTE(Umut): Queries are centered on pair start points so they land inside the generated clusters.
+	std::mt19937_64 generator(GENERATOR_SEED);
+	std::uniform_int_distribution<size_t> distPair(0, pairs.size() - 1);
+	std::vector<SpatialQueryResult> results;
+	u64 radiusElapsed = 0;
+	u64 nearestElapsed = 0;
+	u64 radiusHitCount = 0;
+	u64 mismatchCount = 0;
+	for (u32 i = 0; i < SPATIAL_QUERY_COUNT; ++i) {
+		const Point center = pairs[distPair(generator)].p0;
+
+		const u64 radiusStart = ReadCPUTimer();
+		QueryRadius(index, center, SPATIAL_QUERY_RADIUS, results);
+		radiusElapsed += ReadCPUTimer() - radiusStart;
+		radiusHitCount += results.size();
+
+		// Compare a few queries against the linear scan this index replaces.
+		if (i < 4) {
+			u64 scanHitCount = 0;
+			for (const HaversinePair& pair : pairs) {
+				scanHitCount += ReferenceHaversine(center.x, center.y, pair.p0.x, pair.p0.y, EARTH_RADIUS) <= SPATIAL_QUERY_RADIUS;
+			}
+			mismatchCount += (scanHitCount != results.size());
+		}
+
+		const u64 nearestStart = ReadCPUTimer();
+		QueryNearest(index, center, SPATIAL_QUERY_NEIGHBOR_COUNT, results);
+		nearestElapsed += ReadCPUTimer() - nearestStart;
+	}
+
+	const f64 cyclesToMicroseconds = 1000000.0 / static_cast<f64>(cpuFreq);
+	fprintf(stdout, "Spatial index over %llu points: built in %.2f ms, depth %u\n", pairs.size(),
+			static_cast<f64>(buildElapsed) * cyclesToMicroseconds / 1000.0, index.depth);
+	fprintf(stdout, "  radius %.1f: %.2f us/query, %.1f hits/query, %llu scan mismatches\n", SPATIAL_QUERY_RADIUS,
+			static_cast<f64>(radiusElapsed) * cyclesToMicroseconds / SPATIAL_QUERY_COUNT,
+			static_cast<f64>(radiusHitCount) / SPATIAL_QUERY_COUNT, mismatchCount);
+	fprintf(stdout, "  %u nearest: %.2f us/query\n", SPATIAL_QUERY_NEIGHBOR_COUNT,
+			static_cast<f64>(nearestElapsed) * cyclesToMicroseconds / SPATIAL_QUERY_COUNT);
 }
 
-bool ValidateResult(const size_t pairCount, const f64 computedMean, const std::string& answersFile)
+void ProcessQuantizedPairs(const std::string& quantizedFileName, const std::string& answersFileName, const bool validate)
 {
-	std::ifstream file(answersFile, std::ios::binary);
-	if (!file.is_open()) {
-		return false;
+	QuantizedPairs pairs = MapQuantizedPairs(quantizedFileName.c_str());
+	const size_t pairCount = pairs.x0.size();
+	if (!pairCount) {
+		fprintf(stderr, "ERROR: Unable to map quantized pairs %s\n", quantizedFileName.c_str());
+		return;
 	}
 
-	const uintmax_t size = std::filesystem::file_size(answersFile);
-	const size_t answerPairCount = (size - sizeof(f64)) / sizeof(f64);
-	if (pairCount != answerPairCount) {
-		fprintf(stdout, "Pair count does not match!");
-		return false;
+	std::vector<f64> distances;
+	f64 haversineMean = 0;
+	{
+		PROFILE_BLOCK("HaversineQuantized", ProfileWork{ pairCount * 4 * sizeof(s32), validate ? pairCount * sizeof(f64) : 0, 0 });
+
+		if (validate) {
+			distances.resize(pairCount);
+			HaversineQuantized(pairs.x0, pairs.y0, pairs.x1, pairs.y1, distances);
+			for (const f64 distance : distances) {
+				haversineMean += distance;
+			}
+		}
+		else {
+			haversineMean = HaversineQuantizedSum(pairs.x0, pairs.y0, pairs.x1, pairs.y1);
+		}
+
+		haversineMean /= static_cast<f64>(pairCount);
 	}
 
-	char* buffer = new char[size];
-	file.read(buffer, size);
-	file.close();
+	// NOTE(Umut): Mapped once for both checks, the per pair one reads all of it.
+	MappedFile answersFile = MapFileReadOnly(answersFileName.c_str());
+	ValidateResult(pairCount, haversineMean, answersFile);
 
-	const f64* answersArray = reinterpret_cast<f64*>(buffer);
-	const f64 refMean = answersArray[pairCount];
+	if (validate) {
+		ValidationStats validationStats;
+		if (ValidatePairDistances(distances.data(), distances.size(), answersFile, validationStats)) {
+			fprintf(stdout, "Quantization error against the f64 answers:\n");
+			PrintValidationStats(validationStats);
+		}
+	}
 
-	fprintf(stdout, "Reference mean: %.16f\n", refMean);
-	fprintf(stdout, "Difference: %.16f\n", computedMean - refMean);
+	UnmapFile(answersFile);
 
-	return true;
+	fprintf(stdout, "Haversine implementation: %s (quantized)\n", GetHaversineImplName(GetHaversineImpl()));
+	fprintf(stdout, "Pair count: %llu\n", pairCount);
+	fprintf(stdout, "Haversine mean: %.16f\n", haversineMean);
+	fprintf(stdout, "\n");
+
+	UnmapQuantizedPairs(pairs);
 }
 
 void PrintCpuTime(const char* label, const u64 totalTime, const u64 startTime, const u64 endCpuTime)
@@ -197,35 +315,111 @@ void PrintCpuTime(const char* label, const u64 totalTime, const u64 startTime, c
 
 const bool generateData = false;
 const bool parseData = true;
+const bool validatePairs = false;
+const bool approximateMean = false;
+const bool writeQuantizedPairs = true;
+const bool useQuantizedPairs = false;
+const bool computeNearestDepots = false;
+const bool querySpatialIndex = false;
+// How many times main runs the workload, more than one adds the run to run spread of every block to the profile.
+const u32 profileRunCount = 1;
+
+void ProcessJsonPairs(const std::string& dataFileName, const std::string& answersFileName)
+{
+	JsonParser parser;
+	parser.Read(dataFileName);
+
+	const std::vector<HaversinePair> parsedPairs = parser.Parse();
+	std::vector<f64> distances;
+	const f64 haversineMean = validatePairs ? ComputeDistances(parsedPairs, distances) : ComputeMeanDistance(parsedPairs);
+
+	MappedFile answersFile = MapFileReadOnly(answersFileName.c_str());
+	const bool valid = ValidateResult(parsedPairs.size(), haversineMean, answersFile);
+
+	if (validatePairs) {
+		ValidationStats validationStats;
+		if (ValidatePairDistances(distances.data(), distances.size(), answersFile, validationStats)) {
+			PrintValidationStats(validationStats);
+		}
+	}
+
+	UnmapFile(answersFile);
+
+	fprintf(stdout, "Haversine implementation: %s\n", GetHaversineImplName(GetHaversineImpl()));
+	fprintf(stdout, "Pair count: %llu\n", parsedPairs.size());
+	fprintf(stdout, "Haversine mean: %.16f\n", haversineMean);
+	fprintf(stdout, "\n");
+
+	if (approximateMean) {
+		ReportSampledMeans(parsedPairs);
+		fprintf(stdout, "\n");
+	}
+
+	if (computeNearestDepots) {
+		ReportNearestDepots(parsedPairs);
+		fprintf(stdout, "\n");
+	}
 
-int main()
+	if (querySpatialIndex) {
+		ReportSpatialQueries(parsedPairs);
+		fprintf(stdout, "\n");
+	}
+}
+
+void FinishProfile(const std::string& datasetName)
+{
+	Profiler::End();
+	Profiler::PrintBlocks();
+	Profiler::WriteTrace(TRACE_FILE_NAME);
+	Profiler::WriteCollapsedStacks(COLLAPSED_STACKS_FILE_NAME);
+	Profiler::WriteProfileJson(PROFILE_JSON_FILE_NAME, datasetName.c_str());
+	Profiler::WriteProfileCsv(PROFILE_CSV_FILE_NAME, datasetName.c_str());
+}
+
+int main(int argc, char** argv)
 {
+	// NOTE(Umut): --compare <baseline.json> <current.json> [threshold %] only compares two earlier profiles and
+	// fails when a block regressed, for the perf regression gate.
+	if ((argc >= 4) && (std::string(argv[1]) == "--compare")) {
+		const f64 threshold = (argc >= 5) ? atof(argv[4]) / 100.0 : DEFAULT_PROFILE_COMPARE_THRESHOLD;
+		return (CompareProfiles(argv[2], argv[3], threshold) == 0) ? 0 : 1;
+	}
+
+	// NOTE(Umut): --watch [live file] [interval ms] attaches to a PROFILER_LIVE build running elsewhere and prints
+	// what every block did per interval, until that process ends.
+	if ((argc >= 2) && (std::string(argv[1]) == "--watch")) {
+		const char* liveFileName = (argc >= 3) ? argv[2] : PROFILER_LIVE_FILE_NAME;
+		const u32 intervalMilliseconds = (argc >= 4) ? static_cast<u32>(atoi(argv[3])) : PROFILER_LIVE_INTERVAL_MS;
+		return WatchLiveProfile(liveFileName, intervalMilliseconds ? intervalMilliseconds : PROFILER_LIVE_INTERVAL_MS);
+	}
+
 	Profiler::Begin();
 
+	const std::string quantizedFileName = QUANTIZED_FILE_NAME_BASE + std::to_string(NUM_PAIRS) + QUANTIZED_FILE_NAME_EXT;
+	const std::string answersFileName = ANSWERS_FILE_NAME_BASE + std::to_string(NUM_PAIRS) + ANSWERS_FILE_NAME_EXT;
+
 	if (generateData) {
-		const std::vector<HaversinePair> pairs = CreatePairs(true);
-		WritePairs(pairs);
+		WritePairs(true);
+
+		if (writeQuantizedPairs) {
+			WriteGeneratedQuantizedPairs(true, quantizedFileName);
+		}
 	}
 
 	if (!parseData) {
 		return 0;
 	}
 
-	const std::string dataFileName = DATA_FILE_NAME_BASE + std::to_string(NUM_PAIRS) + DATA_FILE_NAME_EXT;
-	JsonParser parser;
-	parser.Read(dataFileName);
-
-	const std::vector<HaversinePair> parsedPairs = parser.Parse();
-	const f64 haversineMean = ComputeMeanDistance(parsedPairs);
+	if (useQuantizedPairs) {
+		Profiler::Repeat(profileRunCount, [&]() { ProcessQuantizedPairs(quantizedFileName, answersFileName, validatePairs); });
 
-	const std::string answersFileName = ANSWERS_FILE_NAME_BASE + std::to_string(NUM_PAIRS) + ANSWERS_FILE_NAME_EXT;
-	const bool valid = ValidateResult(parsedPairs.size(), haversineMean, answersFileName);
+		FinishProfile(quantizedFileName);
+		return 0;
+	}
 
-	fprintf(stdout, "Pair count: %llu\n", parsedPairs.size());
-	fprintf(stdout, "Haversine mean: %.16f\n", haversineMean);
-	fprintf(stdout, "\n");
+	const std::string dataFileName = DATA_FILE_NAME_BASE + std::to_string(NUM_PAIRS) + DATA_FILE_NAME_EXT;
+	Profiler::Repeat(profileRunCount, [&]() { ProcessJsonPairs(dataFileName, answersFileName); });
 
-	Profiler::End();
-	Profiler::PrintBlocks();
+	FinishProfile(dataFileName);
 }
 
@@ -0,0 +1,80 @@
+#pragma once
+
+#if _WIN32
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+#include "basedef.h"
+
+struct CpuFeatures
+{
+	b32 sse41 = false;
+	b32 avx = false;
+	b32 avx2 = false;
+	b32 fma = false;
+	b32 avx512f = false;
+};
+
+inline void ReadCpuid(const u32 leaf, const u32 subLeaf, u32 registers[4])
+{
+#if _WIN32
+	__cpuidex(reinterpret_cast<int*>(registers), leaf, subLeaf);
+#else
+	__cpuid_count(leaf, subLeaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+inline u64 ReadXcr0()
+{
+#if _WIN32
+	return _xgetbv(0);
+#else
+	u32 eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return (static_cast<u64>(edx) << 32) | eax;
+#endif
+}
+
+/* NOTE(Umut): CPUID only says what the core can execute. AVX state also has to be enabled
+   by the OS (XCR0), otherwise the first ymm instruction faults. */
+inline CpuFeatures DetectCpuFeatures()
+{
+	CpuFeatures result = {};
+
+	u32 regs[4] = {};
+	ReadCpuid(0, 0, regs);
+	const u32 maxLeaf = regs[0];
+	if (maxLeaf < 1) {
+		return result;
+	}
+
+	ReadCpuid(1, 0, regs);
+	result.sse41 = !!(regs[2] & (1u << 19));
+
+	const b32 osXsave = !!(regs[2] & (1u << 27));
+	const b32 cpuAvx = !!(regs[2] & (1u << 28));
+	const b32 cpuFma = !!(regs[2] & (1u << 12));
+	const u64 xcr0 = osXsave ? ReadXcr0() : 0;
+	const b32 osYmm = (xcr0 & 0x6) == 0x6;
+	const b32 osZmm = (xcr0 & 0xe6) == 0xe6;
+
+	result.avx = cpuAvx && osYmm;
+	result.fma = result.avx && cpuFma;
+
+	if (maxLeaf >= 7) {
+		ReadCpuid(7, 0, regs);
+		result.avx2 = result.avx && !!(regs[1] & (1u << 5));
+		result.avx512f = osZmm && !!(regs[1] & (1u << 16));
+	}
+
+	return result;
+}
+
+inline const CpuFeatures& GetCpuFeatures()
+{
+	static const CpuFeatures features = DetectCpuFeatures();
+	return features;
+}
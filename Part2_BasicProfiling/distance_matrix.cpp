@@ -0,0 +1,266 @@
+#include "distance_matrix.h"
+
+#include "haversine_dispatch.h"
+#include "math_approx.h"
+#include "profiler.h"
+
+#include <assert.h>
+#include <math.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+const f64 DEGREES_TO_RADIANS = 0.01745329251994329577;
+// Three differences, one square and two fused multiply adds per chord.
+const u64 CHORD_SQUARED_FLOP_COUNT = 8;
+/* NOTE(Umut): ChordDistanceKernel, a square root and two multiplies around the asin. The asin evaluates both
+   of its branches: the reduction is a subtract, a multiply and a square root, the polynomial a square, one
+   fused multiply add per term after the first and a final multiply, and the large branch adds a subtract and
+   an add on top. */
+const u64 CHORD_DISTANCE_FLOP_COUNT = 3 + 3 + 1 + 2 * (ASIN_TERM_COUNT - 1) + 1 + 2;
+
+// NOTE(Umut): Only read by the profile blocks, which compile out with PROFILER 0.
+[[maybe_unused]] static u64 GetUnitVectorBytes(const UnitVectors& rows, const UnitVectors& cols)
+{
+	return (rows.Count() + cols.Count()) * 3 * sizeof(f64);
+}
+
+void ComputeUnitVector(const Point point, f64& xOut, f64& yOut, f64& zOut)
+{
+	const f64 lon = point.x * DEGREES_TO_RADIANS;
+	const f64 lat = point.y * DEGREES_TO_RADIANS;
+	const f64 cosLat = cos(lat);
+
+	xOut = cosLat * cos(lon);
+	yOut = cosLat * sin(lon);
+	zOut = sin(lat);
+}
+
+UnitVectors ComputeUnitVectors(std::span<const Point> points)
+{
+	UnitVectors result;
+	result.x.resize(points.size());
+	result.y.resize(points.size());
+	result.z.resize(points.size());
+
+	for (size_t i = 0; i < points.size(); ++i) {
+		ComputeUnitVector(points[i], result.x[i], result.y[i], result.z[i]);
+	}
+
+	return result;
+}
+
+static u32 GetThreadCount(const DistanceMatrixParameters& params, const u64 tileCount)
+{
+	u64 threadCount = params.threadCount ? params.threadCount : std::thread::hardware_concurrency();
+	threadCount = threadCount ? threadCount : 1;
+	return static_cast<u32>((threadCount < tileCount) ? threadCount : tileCount);
+}
+
+/**
+ * @brief Hand out row tiles to threadCount threads, the calling thread included. TileFunction is called as
+ *        function(rowStart, rowCount, scratch) and has to be safe to run concurrently on disjoint rows. Every
+ *        thread owns a scratch buffer of scratchCount f64s that it reuses for all the tiles it pulls.
+ */
+template <typename TileFunction>
+static void ForEachRowTile(const u64 rowCount, const DistanceMatrixParameters& params, const u64 scratchCount, TileFunction&& function)
+{
+	const u64 rowTileSize = params.rowTileSize ? params.rowTileSize : 1;
+	const u64 tileCount = (rowCount + rowTileSize - 1) / rowTileSize;
+	if (!tileCount) {
+		return;
+	}
+
+	std::atomic<u64> nextTile = 0;
+	auto worker = [&]() {
+		std::vector<f64> scratch(scratchCount);
+		for (u64 tile = nextTile++; tile < tileCount; tile = nextTile++) {
+			const u64 rowStart = tile * rowTileSize;
+			const u64 count = (rowCount - rowStart < rowTileSize) ? (rowCount - rowStart) : rowTileSize;
+			function(rowStart, count, scratch.data());
+		}
+	};
+
+	std::vector<std::thread> threads;
+	const u32 threadCount = GetThreadCount(params, tileCount);
+	for (u32 i = 1; i < threadCount; ++i) {
+		threads.emplace_back(worker);
+	}
+
+	worker();
+
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
+
+/**
+ * @brief Same, for TileFunctions that need no scratch, called as function(rowStart, rowCount).
+ */
+template <typename TileFunction>
+static void ForEachRowTile(const u64 rowCount, const DistanceMatrixParameters& params, TileFunction&& function)
+{
+	ForEachRowTile(rowCount, params, 0, [&](const u64 rowStart, const u64 count, f64*) { function(rowStart, count); });
+}
+
+static u64 GetColTileSize(const DistanceMatrixParameters& params, const HaversineImplInfo& impl)
+{
+	// NOTE(Umut): Rounded to the lane count so only the very last column tile has a scalar tail.
+	const u64 size = params.colTileSize - (params.colTileSize % impl.laneCount);
+	return size ? size : impl.laneCount;
+}
+
+/**
+ * @brief Distances of row against cols[colStart, colStart + count), written to out.
+ */
+static void ComputeRowDistances(const HaversineImplInfo& impl, const HaversineImplInfo& scalar, const UnitVectors& rows, const u64 row,
+								const UnitVectors& cols, const u64 colStart, const u64 count, f64* out, const f64 earthRadius)
+{
+	const f64 px = rows.x[row];
+	const f64 py = rows.y[row];
+	const f64 pz = rows.z[row];
+	const f64* x = cols.x.data() + colStart;
+	const f64* y = cols.y.data() + colStart;
+	const f64* z = cols.z.data() + colStart;
+
+	const u64 vectorCount = count - (count % impl.laneCount);
+	impl.chordSquared(px, py, pz, x, y, z, out, vectorCount);
+	scalar.chordSquared(px, py, pz, x + vectorCount, y + vectorCount, z + vectorCount, out + vectorCount, count - vectorCount);
+
+	impl.chordSquaredToDistance(out, vectorCount, earthRadius);
+	scalar.chordSquaredToDistance(out + vectorCount, count - vectorCount, earthRadius);
+}
+
+void ComputeDistanceMatrix(const UnitVectors& rows, const UnitVectors& cols, std::span<f64> distancesOut, const DistanceMatrixParameters& params)
+{
+	assert(distancesOut.size() == rows.Count() * cols.Count());
+
+	PROFILE_GROUP_FUNCTION("distance", ProfileWork{ GetUnitVectorBytes(rows, cols), distancesOut.size() * sizeof(f64),
+													distancesOut.size() * (CHORD_SQUARED_FLOP_COUNT + CHORD_DISTANCE_FLOP_COUNT) });
+
+	const HaversineImplInfo& impl = GetActiveHaversineImplInfo();
+	const HaversineImplInfo& scalar = GetHaversineImplInfo(HaversineImpl::Scalar);
+	const u64 colCount = cols.Count();
+	const u64 colTileSize = GetColTileSize(params, impl);
+
+	ForEachRowTile(rows.Count(), params, [&](const u64 rowStart, const u64 rowCount) {
+		for (u64 colStart = 0; colStart < colCount; colStart += colTileSize) {
+			const u64 count = (colCount - colStart < colTileSize) ? (colCount - colStart) : colTileSize;
+			for (u64 row = rowStart; row < rowStart + rowCount; ++row) {
+				ComputeRowDistances(impl, scalar, rows, row, cols, colStart, count, distancesOut.data() + row * colCount + colStart,
+									params.earthRadius);
+			}
+		}
+	});
+}
+
+void ComputeDistanceTiles(const UnitVectors& rows, const UnitVectors& cols, const DistanceTileCallback& callback, const DistanceMatrixParameters& params)
+{
+	PROFILE_GROUP_FUNCTION("distance", ProfileWork{ GetUnitVectorBytes(rows, cols), rows.Count() * cols.Count() * sizeof(f64),
+													rows.Count() * cols.Count() * (CHORD_SQUARED_FLOP_COUNT + CHORD_DISTANCE_FLOP_COUNT) });
+
+	const HaversineImplInfo& impl = GetActiveHaversineImplInfo();
+	const HaversineImplInfo& scalar = GetHaversineImplInfo(HaversineImpl::Scalar);
+	const u64 colCount = cols.Count();
+	const u64 colTileSize = GetColTileSize(params, impl);
+
+	const u64 rowTileSize = params.rowTileSize ? params.rowTileSize : 1;
+	ForEachRowTile(rows.Count(), params, rowTileSize * colTileSize, [&](const u64 rowStart, const u64 rowCount, f64* tile) {
+		for (u64 colStart = 0; colStart < colCount; colStart += colTileSize) {
+			const u64 count = (colCount - colStart < colTileSize) ? (colCount - colStart) : colTileSize;
+			for (u64 i = 0; i < rowCount; ++i) {
+				ComputeRowDistances(impl, scalar, rows, rowStart + i, cols, colStart, count, tile + i * colTileSize, params.earthRadius);
+			}
+
+			DistanceTile result;
+			result.rowStart = rowStart;
+			result.rowCount = rowCount;
+			result.colStart = colStart;
+			result.colCount = count;
+			result.distances = tile;
+			result.stride = colTileSize;
+			callback(result);
+		}
+	});
+}
+
+void ComputeNearest(const UnitVectors& rows, const UnitVectors& cols, std::span<f64> minDistancesOut, std::span<u64> argminOut,
+					const DistanceMatrixParameters& params)
+{
+	assert((minDistancesOut.size() == rows.Count()) && (argminOut.size() == rows.Count()));
+
+	PROFILE_GROUP_FUNCTION("distance", ProfileWork{ GetUnitVectorBytes(rows, cols), rows.Count() * (sizeof(f64) + sizeof(u64)),
+													rows.Count() * cols.Count() * CHORD_SQUARED_FLOP_COUNT + rows.Count() * CHORD_DISTANCE_FLOP_COUNT });
+
+	const HaversineImplInfo& impl = GetActiveHaversineImplInfo();
+	const HaversineImplInfo& scalar = GetHaversineImplInfo(HaversineImpl::Scalar);
+	const u64 colCount = cols.Count();
+	const u64 colTileSize = GetColTileSize(params, impl);
+
+	ForEachRowTile(rows.Count(), params, [&](const u64 rowStart, const u64 rowCount) {
+		f64* minChords = minDistancesOut.data() + rowStart;
+		u64* argmins = argminOut.data() + rowStart;
+		for (u64 i = 0; i < rowCount; ++i) {
+			minChords[i] = INFINITY;
+			argmins[i] = colCount;
+		}
+
+		for (u64 colStart = 0; colStart < colCount; colStart += colTileSize) {
+			const u64 count = (colCount - colStart < colTileSize) ? (colCount - colStart) : colTileSize;
+			const u64 vectorCount = count - (count % impl.laneCount);
+			const f64* x = cols.x.data() + colStart;
+			const f64* y = cols.y.data() + colStart;
+			const f64* z = cols.z.data() + colStart;
+
+			for (u64 i = 0; i < rowCount; ++i) {
+				const u64 row = rowStart + i;
+				impl.minChordSquared(rows.x[row], rows.y[row], rows.z[row], x, y, z, vectorCount, colStart, minChords + i, argmins + i);
+				scalar.minChordSquared(rows.x[row], rows.y[row], rows.z[row], x + vectorCount, y + vectorCount, z + vectorCount,
+									   count - vectorCount, colStart + vectorCount, minChords + i, argmins + i);
+			}
+		}
+
+		// NOTE(Umut): Rows with no columns keep INFINITY, only finite chords are converted.
+		if (colCount) {
+			const u64 vectorCount = rowCount - (rowCount % impl.laneCount);
+			impl.chordSquaredToDistance(minChords, vectorCount, params.earthRadius);
+			scalar.chordSquaredToDistance(minChords + vectorCount, rowCount - vectorCount, params.earthRadius);
+		}
+	});
+}
+
+void ComputeDistanceSums(const UnitVectors& rows, const UnitVectors& cols, std::span<f64> sumsOut, const DistanceMatrixParameters& params)
+{
+	assert(sumsOut.size() == rows.Count());
+
+	// NOTE(Umut): One more add per pair for the running sum.
+	PROFILE_GROUP_FUNCTION("distance", ProfileWork{ GetUnitVectorBytes(rows, cols), rows.Count() * sizeof(f64),
+													rows.Count() * cols.Count() * (CHORD_SQUARED_FLOP_COUNT + CHORD_DISTANCE_FLOP_COUNT + 1) });
+
+	const HaversineImplInfo& impl = GetActiveHaversineImplInfo();
+	const HaversineImplInfo& scalar = GetHaversineImplInfo(HaversineImpl::Scalar);
+	const u64 colCount = cols.Count();
+	const u64 colTileSize = GetColTileSize(params, impl);
+
+	ForEachRowTile(rows.Count(), params, [&](const u64 rowStart, const u64 rowCount) {
+		f64* sums = sumsOut.data() + rowStart;
+		for (u64 i = 0; i < rowCount; ++i) {
+			sums[i] = 0.0;
+		}
+
+		for (u64 colStart = 0; colStart < colCount; colStart += colTileSize) {
+			const u64 count = (colCount - colStart < colTileSize) ? (colCount - colStart) : colTileSize;
+			const u64 vectorCount = count - (count % impl.laneCount);
+			const f64* x = cols.x.data() + colStart;
+			const f64* y = cols.y.data() + colStart;
+			const f64* z = cols.z.data() + colStart;
+
+			for (u64 i = 0; i < rowCount; ++i) {
+				const u64 row = rowStart + i;
+				sums[i] += impl.distanceSum(rows.x[row], rows.y[row], rows.z[row], x, y, z, vectorCount, params.earthRadius);
+				sums[i] += scalar.distanceSum(rows.x[row], rows.y[row], rows.z[row], x + vectorCount, y + vectorCount, z + vectorCount,
+											  count - vectorCount, params.earthRadius);
+			}
+		}
+	});
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <functional>
+#include <span>
+#include <vector>
+
+#include "basedef.h"
+#include "haversine.h"
+
+/* NOTE(Umut): All-pairs distances between a row point set and a column point set (depots x customers).
+   Points are converted once to unit vectors, after which every distance is a squared chord (3 subs, 3 FMAs)
+   plus one asin, no trigonometry per pair. Column tiles are sized to stay in L1 while a tile of rows is swept
+   over them, row tiles are handed out to threads. Reductions run on the squared chord so min/argmin never
+   need the asin at all. */
+struct UnitVectors
+{
+	std::vector<f64> x;
+	std::vector<f64> y;
+	std::vector<f64> z;
+
+	u64 Count() const { return x.size(); }
+};
+
+void ComputeUnitVector(const Point point, f64& xOut, f64& yOut, f64& zOut);
+UnitVectors ComputeUnitVectors(std::span<const Point> points);
+
+struct DistanceMatrixParameters
+{
+	// 0 picks std::thread::hardware_concurrency().
+	u32 threadCount = 0;
+
+	// Rows per unit of work handed to a thread. Tiles of rowTileSize x colTileSize results stay in L2.
+	u64 rowTileSize = 32;
+	// Columns swept per row, 3 * 8 bytes per column so 512 columns take 12KB of L1.
+	u64 colTileSize = 512;
+
+	f64 earthRadius = EARTH_RADIUS;
+};
+
+struct DistanceTile
+{
+	u64 rowStart = 0;
+	u64 rowCount = 0;
+	u64 colStart = 0;
+	u64 colCount = 0;
+
+	// distances[row * stride + col], relative to rowStart/colStart.
+	const f64* distances = nullptr;
+	u64 stride = 0;
+};
+
+// NOTE(Umut): Called from the worker threads, possibly concurrently. The tile memory is reused after the call returns.
+using DistanceTileCallback = std::function<void(const DistanceTile&)>;
+
+/**
+ * @brief Full row-major matrix, distancesOut has to hold rows.Count() * cols.Count() values.
+ */
+void ComputeDistanceMatrix(const UnitVectors& rows, const UnitVectors& cols, std::span<f64> distancesOut,
+						   const DistanceMatrixParameters& params = {});
+
+/**
+ * @brief Stream the matrix tile by tile without ever materializing it.
+ */
+void ComputeDistanceTiles(const UnitVectors& rows, const UnitVectors& cols, const DistanceTileCallback& callback,
+						  const DistanceMatrixParameters& params = {});
+
+/**
+ * @brief For every row the closest column and its distance. Ties resolve to the lowest column index.
+ */
+void ComputeNearest(const UnitVectors& rows, const UnitVectors& cols, std::span<f64> minDistancesOut, std::span<u64> argminOut,
+					const DistanceMatrixParameters& params = {});
+
+/**
+ * @brief For every row the sum of its distances to all columns.
+ */
+void ComputeDistanceSums(const UnitVectors& rows, const UnitVectors& cols, std::span<f64> sumsOut,
+						 const DistanceMatrixParameters& params = {});
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <span>
+
 #include "basedef.h"
 
 const f64 EARTH_RADIUS = 6372.8;
@@ -37,4 +39,42 @@ static f64 RadiansFromDegrees(f64 Degrees)
     return Result;
 }
 
-f64 ReferenceHaversine(f64 X0, f64 Y0, f64 X1, f64 Y1, f64 EarthRadius);
\ No newline at end of file
+f64 ReferenceHaversine(f64 X0, f64 Y0, f64 X1, f64 Y1, f64 EarthRadius);
+
+enum class HaversineImpl : u32
+{
+	Scalar,
+	Sse2,
+	Avx2,
+	Avx512,
+
+	Count
+};
+
+// NOTE(Umut): The batch functions below use the best implementation the CPU supports unless one is
+// forced with SetHaversineImpl. Every implementation evaluates the same polynomial approximations, but
+// AVX2 and AVX-512 fuse their multiply-adds and Scalar and SSE2 don't. Results are within a few ulps of
+// ReferenceHaversine and can differ by a few ulps between implementations. The pairs past the last full
+// vector go through Scalar, so with a wider implementation a pair's result also depends on where it falls.
+HaversineImpl GetBestHaversineImpl();
+HaversineImpl GetHaversineImpl();
+bool SetHaversineImpl(const HaversineImpl impl);
+const char* GetHaversineImplName(const HaversineImpl impl);
+
+/**
+ * @brief Distance of every (x0[i], y0[i]) - (x1[i], y1[i]) pair. All spans must have the same size,
+ *        no alignment is required.
+ */
+void Haversine(std::span<const f64> x0, std::span<const f64> y0, std::span<const f64> x1, std::span<const f64> y1,
+			   std::span<f64> out, const f64 earthRadius = EARTH_RADIUS);
+f64 HaversineSum(std::span<const f64> x0, std::span<const f64> y0, std::span<const f64> x1, std::span<const f64> y1,
+				 const f64 earthRadius = EARTH_RADIUS);
+
+void Haversine(std::span<const HaversinePair> pairs, std::span<f64> out, const f64 earthRadius = EARTH_RADIUS);
+f64 HaversineSum(std::span<const HaversinePair> pairs, const f64 earthRadius = EARTH_RADIUS);
+
+// NOTE(Umut): Same as above for the s32 fixed point columns of quantized_pairs.h, dequantized in registers.
+void HaversineQuantized(std::span<const s32> x0, std::span<const s32> y0, std::span<const s32> x1, std::span<const s32> y1,
+						std::span<f64> out, const f64 earthRadius = EARTH_RADIUS);
+f64 HaversineQuantizedSum(std::span<const s32> x0, std::span<const s32> y0, std::span<const s32> x1, std::span<const s32> y1,
+						  const f64 earthRadius = EARTH_RADIUS);
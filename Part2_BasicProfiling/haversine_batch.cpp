@@ -0,0 +1,327 @@
+#include "haversine.h"
+
+#include "haversine_dispatch.h"
+#include "math_approx.h"
+#include "cpu_features.h"
+#include "quantized_pairs.h"
+
+#include <assert.h>
+#include <atomic>
+#include <immintrin.h>
+
+// NOTE(Umut): MSVC emits any intrinsic regardless of /arch. GCC and clang only allow them inside
+// functions compiled for that target, hence the push/pop target regions around the wider kernels.
+#if _MSC_VER
+#define BEGIN_TARGET_AVX2
+#define BEGIN_TARGET_AVX512
+#define END_TARGET
+#else
+#define BEGIN_TARGET_AVX2 _Pragma("GCC push_options") _Pragma("GCC target(\"avx2,fma\")")
+#define BEGIN_TARGET_AVX512 _Pragma("GCC push_options") _Pragma("GCC target(\"avx512f\")")
+#define END_TARGET _Pragma("GCC pop_options")
+#endif
+
+namespace HaversineScalar
+{
+	using Vec = f64;
+	using Mask = bool;
+	const u64 LANE_COUNT = 1;
+
+	inline Vec Set1(const f64 value) { return value; }
+	inline Vec Load(const f64* ptr) { return *ptr; }
+	inline Vec LoadQuantized(const s32* ptr) { return static_cast<f64>(*ptr); }
+	inline void Store(f64* ptr, const Vec value) { *ptr = value; }
+	inline Vec Add(const Vec a, const Vec b) { return a + b; }
+	inline Vec Sub(const Vec a, const Vec b) { return a - b; }
+	inline Vec Mul(const Vec a, const Vec b) { return a * b; }
+	// NOTE(Umut): Unfused like SSE2, std::fma is a slow library call on CPUs without FMA.
+	inline Vec MulAdd(const Vec a, const Vec b, const Vec c) { return a * b + c; }
+	inline Vec Min(const Vec a, const Vec b) { return (a < b) ? a : b; }
+	inline Vec Max(const Vec a, const Vec b) { return (a > b) ? a : b; }
+	inline Vec Sqrt(const Vec a) { return SqrtSse(a); }
+	inline Mask CmpGt(const Vec a, const Vec b) { return a > b; }
+	inline Vec Select(const Mask mask, const Vec ifTrue, const Vec ifFalse) { return mask ? ifTrue : ifFalse; }
+	inline f64 ReduceAdd(const Vec value) { return value; }
+	inline Vec LaneIndices() { return 0.0; }
+
+#include "haversine_kernel.inl"
+}
+
+namespace HaversineSse2
+{
+	using Vec = __m128d;
+	using Mask = __m128d;
+	const u64 LANE_COUNT = 2;
+
+	inline Vec Set1(const f64 value) { return _mm_set1_pd(value); }
+	inline Vec Load(const f64* ptr) { return _mm_loadu_pd(ptr); }
+	inline Vec LoadQuantized(const s32* ptr) { return _mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(ptr))); }
+	inline void Store(f64* ptr, const Vec value) { _mm_storeu_pd(ptr, value); }
+	inline Vec Add(const Vec a, const Vec b) { return _mm_add_pd(a, b); }
+	inline Vec Sub(const Vec a, const Vec b) { return _mm_sub_pd(a, b); }
+	inline Vec Mul(const Vec a, const Vec b) { return _mm_mul_pd(a, b); }
+	inline Vec MulAdd(const Vec a, const Vec b, const Vec c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+	inline Vec Min(const Vec a, const Vec b) { return _mm_min_pd(a, b); }
+	inline Vec Max(const Vec a, const Vec b) { return _mm_max_pd(a, b); }
+	inline Vec Sqrt(const Vec a) { return _mm_sqrt_pd(a); }
+	inline Mask CmpGt(const Vec a, const Vec b) { return _mm_cmpgt_pd(a, b); }
+	inline Vec Select(const Mask mask, const Vec ifTrue, const Vec ifFalse) { return _mm_or_pd(_mm_and_pd(mask, ifTrue), _mm_andnot_pd(mask, ifFalse)); }
+	inline f64 ReduceAdd(const Vec value) { return _mm_cvtsd_f64(_mm_add_sd(value, _mm_unpackhi_pd(value, value))); }
+	inline Vec LaneIndices() { return _mm_setr_pd(0.0, 1.0); }
+
+#include "haversine_kernel.inl"
+}
+
+BEGIN_TARGET_AVX2
+namespace HaversineAvx2
+{
+	using Vec = __m256d;
+	using Mask = __m256d;
+	const u64 LANE_COUNT = 4;
+
+	inline Vec Set1(const f64 value) { return _mm256_set1_pd(value); }
+	inline Vec Load(const f64* ptr) { return _mm256_loadu_pd(ptr); }
+	inline Vec LoadQuantized(const s32* ptr) { return _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr))); }
+	inline void Store(f64* ptr, const Vec value) { _mm256_storeu_pd(ptr, value); }
+	inline Vec Add(const Vec a, const Vec b) { return _mm256_add_pd(a, b); }
+	inline Vec Sub(const Vec a, const Vec b) { return _mm256_sub_pd(a, b); }
+	inline Vec Mul(const Vec a, const Vec b) { return _mm256_mul_pd(a, b); }
+	inline Vec MulAdd(const Vec a, const Vec b, const Vec c) { return _mm256_fmadd_pd(a, b, c); }
+	inline Vec Min(const Vec a, const Vec b) { return _mm256_min_pd(a, b); }
+	inline Vec Max(const Vec a, const Vec b) { return _mm256_max_pd(a, b); }
+	inline Vec Sqrt(const Vec a) { return _mm256_sqrt_pd(a); }
+	inline Mask CmpGt(const Vec a, const Vec b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+	inline Vec Select(const Mask mask, const Vec ifTrue, const Vec ifFalse) { return _mm256_blendv_pd(ifFalse, ifTrue, mask); }
+	inline f64 ReduceAdd(const Vec value)
+	{
+		const __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(value), _mm256_extractf128_pd(value, 1));
+		return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+	}
+	inline Vec LaneIndices() { return _mm256_setr_pd(0.0, 1.0, 2.0, 3.0); }
+
+#include "haversine_kernel.inl"
+}
+END_TARGET
+
+BEGIN_TARGET_AVX512
+namespace HaversineAvx512
+{
+	using Vec = __m512d;
+	using Mask = __mmask8;
+	const u64 LANE_COUNT = 8;
+
+	inline Vec Set1(const f64 value) { return _mm512_set1_pd(value); }
+	inline Vec Load(const f64* ptr) { return _mm512_loadu_pd(ptr); }
+	inline Vec LoadQuantized(const s32* ptr) { return _mm512_cvtepi32_pd(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr))); }
+	inline void Store(f64* ptr, const Vec value) { _mm512_storeu_pd(ptr, value); }
+	inline Vec Add(const Vec a, const Vec b) { return _mm512_add_pd(a, b); }
+	inline Vec Sub(const Vec a, const Vec b) { return _mm512_sub_pd(a, b); }
+	inline Vec Mul(const Vec a, const Vec b) { return _mm512_mul_pd(a, b); }
+	inline Vec MulAdd(const Vec a, const Vec b, const Vec c) { return _mm512_fmadd_pd(a, b, c); }
+	inline Vec Min(const Vec a, const Vec b) { return _mm512_min_pd(a, b); }
+	inline Vec Max(const Vec a, const Vec b) { return _mm512_max_pd(a, b); }
+	inline Vec Sqrt(const Vec a) { return _mm512_sqrt_pd(a); }
+	inline Mask CmpGt(const Vec a, const Vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ); }
+	inline Vec Select(const Mask mask, const Vec ifTrue, const Vec ifFalse) { return _mm512_mask_blend_pd(mask, ifFalse, ifTrue); }
+	inline f64 ReduceAdd(const Vec value) { return _mm512_reduce_add_pd(value); }
+	inline Vec LaneIndices() { return _mm512_setr_pd(0.0, 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0); }
+
+#include "haversine_kernel.inl"
+}
+END_TARGET
+
+static const HaversineImplInfo IMPLEMENTATIONS[] = {
+	{ "Scalar", HaversineScalar::LANE_COUNT, HaversineScalar::HaversineArray, HaversineScalar::HaversineArraySum,
+	  HaversineScalar::HaversineQuantizedArray, HaversineScalar::HaversineQuantizedArraySum,
+	  HaversineScalar::UnitVectorChordSquared, HaversineScalar::ChordSquaredToDistance,
+	  HaversineScalar::UnitVectorMinChordSquared, HaversineScalar::UnitVectorDistanceSum },
+	{ "SSE2", HaversineSse2::LANE_COUNT, HaversineSse2::HaversineArray, HaversineSse2::HaversineArraySum,
+	  HaversineSse2::HaversineQuantizedArray, HaversineSse2::HaversineQuantizedArraySum,
+	  HaversineSse2::UnitVectorChordSquared, HaversineSse2::ChordSquaredToDistance,
+	  HaversineSse2::UnitVectorMinChordSquared, HaversineSse2::UnitVectorDistanceSum },
+	{ "AVX2", HaversineAvx2::LANE_COUNT, HaversineAvx2::HaversineArray, HaversineAvx2::HaversineArraySum,
+	  HaversineAvx2::HaversineQuantizedArray, HaversineAvx2::HaversineQuantizedArraySum,
+	  HaversineAvx2::UnitVectorChordSquared, HaversineAvx2::ChordSquaredToDistance,
+	  HaversineAvx2::UnitVectorMinChordSquared, HaversineAvx2::UnitVectorDistanceSum },
+	{ "AVX-512", HaversineAvx512::LANE_COUNT, HaversineAvx512::HaversineArray, HaversineAvx512::HaversineArraySum,
+	  HaversineAvx512::HaversineQuantizedArray, HaversineAvx512::HaversineQuantizedArraySum,
+	  HaversineAvx512::UnitVectorChordSquared, HaversineAvx512::ChordSquaredToDistance,
+	  HaversineAvx512::UnitVectorMinChordSquared, HaversineAvx512::UnitVectorDistanceSum },
+};
+
+static_assert(ARRAY_SIZE(IMPLEMENTATIONS) == static_cast<size_t>(HaversineImpl::Count));
+
+// NOTE(Umut): AoS overloads transpose this many pairs at a time into stack buffers that stay in L1.
+const u64 PAIR_CHUNK_SIZE = 256;
+
+// NOTE(Umut): Batch calls read this from every worker thread, Count until the first call picks the best one.
+static std::atomic<HaversineImpl> activeImpl = HaversineImpl::Count;
+
+static bool IsSupported(const HaversineImpl impl)
+{
+	const CpuFeatures& features = GetCpuFeatures();
+	switch (impl) {
+		case HaversineImpl::Scalar:
+		case HaversineImpl::Sse2:
+			return true;
+		case HaversineImpl::Avx2:
+			return features.avx2 && features.fma;
+		case HaversineImpl::Avx512:
+			return features.avx512f;
+		default:
+			return false;
+	}
+}
+
+const HaversineImplInfo& GetHaversineImplInfo(const HaversineImpl impl)
+{
+	assert(impl < HaversineImpl::Count);
+	return IMPLEMENTATIONS[static_cast<size_t>(impl)];
+}
+
+const HaversineImplInfo& GetActiveHaversineImplInfo()
+{
+	return GetHaversineImplInfo(GetHaversineImpl());
+}
+
+HaversineImpl GetBestHaversineImpl()
+{
+	for (u32 impl = static_cast<u32>(HaversineImpl::Count); impl > 0; --impl) {
+		if (IsSupported(static_cast<HaversineImpl>(impl - 1))) {
+			return static_cast<HaversineImpl>(impl - 1);
+		}
+	}
+
+	return HaversineImpl::Scalar;
+}
+
+HaversineImpl GetHaversineImpl()
+{
+	HaversineImpl impl = activeImpl.load(std::memory_order_relaxed);
+	if (impl == HaversineImpl::Count) {
+		// NOTE(Umut): Threads racing here pick the same one, and a SetHaversineImpl in between wins.
+		const HaversineImpl best = GetBestHaversineImpl();
+		impl = activeImpl.compare_exchange_strong(impl, best, std::memory_order_relaxed) ? best : impl;
+	}
+
+	return impl;
+}
+
+bool SetHaversineImpl(const HaversineImpl impl)
+{
+	if (!IsSupported(impl)) {
+		return false;
+	}
+
+	activeImpl.store(impl, std::memory_order_relaxed);
+	return true;
+}
+
+const char* GetHaversineImplName(const HaversineImpl impl)
+{
+	if (impl >= HaversineImpl::Count) {
+		return "Unknown";
+	}
+
+	return IMPLEMENTATIONS[static_cast<size_t>(impl)].name;
+}
+
+void Haversine(std::span<const f64> x0, std::span<const f64> y0, std::span<const f64> x1, std::span<const f64> y1,
+			   std::span<f64> out, const f64 earthRadius)
+{
+	const u64 count = out.size();
+	assert((x0.size() == count) && (y0.size() == count) && (x1.size() == count) && (y1.size() == count));
+
+	const HaversineImplInfo& impl = GetActiveHaversineImplInfo();
+	const u64 vectorCount = count - (count % impl.laneCount);
+	impl.array(x0.data(), y0.data(), x1.data(), y1.data(), out.data(), vectorCount, earthRadius);
+
+	HaversineScalar::HaversineArray(x0.data() + vectorCount, y0.data() + vectorCount, x1.data() + vectorCount, y1.data() + vectorCount,
+									out.data() + vectorCount, count - vectorCount, earthRadius);
+}
+
+f64 HaversineSum(std::span<const f64> x0, std::span<const f64> y0, std::span<const f64> x1, std::span<const f64> y1,
+				 const f64 earthRadius)
+{
+	const u64 count = x0.size();
+	assert((y0.size() == count) && (x1.size() == count) && (y1.size() == count));
+
+	const HaversineImplInfo& impl = GetActiveHaversineImplInfo();
+	const u64 vectorCount = count - (count % impl.laneCount);
+	const f64 vectorSum = impl.arraySum(x0.data(), y0.data(), x1.data(), y1.data(), vectorCount, earthRadius);
+
+	return vectorSum + HaversineScalar::HaversineArraySum(x0.data() + vectorCount, y0.data() + vectorCount, x1.data() + vectorCount,
+														  y1.data() + vectorCount, count - vectorCount, earthRadius);
+}
+
+void HaversineQuantized(std::span<const s32> x0, std::span<const s32> y0, std::span<const s32> x1, std::span<const s32> y1,
+						std::span<f64> out, const f64 earthRadius)
+{
+	const u64 count = out.size();
+	assert((x0.size() == count) && (y0.size() == count) && (x1.size() == count) && (y1.size() == count));
+
+	const HaversineImplInfo& impl = GetActiveHaversineImplInfo();
+	const u64 vectorCount = count - (count % impl.laneCount);
+	impl.quantizedArray(x0.data(), y0.data(), x1.data(), y1.data(), out.data(), vectorCount, earthRadius);
+
+	HaversineScalar::HaversineQuantizedArray(x0.data() + vectorCount, y0.data() + vectorCount, x1.data() + vectorCount, y1.data() + vectorCount,
+											 out.data() + vectorCount, count - vectorCount, earthRadius);
+}
+
+f64 HaversineQuantizedSum(std::span<const s32> x0, std::span<const s32> y0, std::span<const s32> x1, std::span<const s32> y1,
+						  const f64 earthRadius)
+{
+	const u64 count = x0.size();
+	assert((y0.size() == count) && (x1.size() == count) && (y1.size() == count));
+
+	const HaversineImplInfo& impl = GetActiveHaversineImplInfo();
+	const u64 vectorCount = count - (count % impl.laneCount);
+	const f64 vectorSum = impl.quantizedArraySum(x0.data(), y0.data(), x1.data(), y1.data(), vectorCount, earthRadius);
+
+	return vectorSum + HaversineScalar::HaversineQuantizedArraySum(x0.data() + vectorCount, y0.data() + vectorCount, x1.data() + vectorCount,
+																   y1.data() + vectorCount, count - vectorCount, earthRadius);
+}
+
+struct PairChunk
+{
+	f64 x0[PAIR_CHUNK_SIZE];
+	f64 y0[PAIR_CHUNK_SIZE];
+	f64 x1[PAIR_CHUNK_SIZE];
+	f64 y1[PAIR_CHUNK_SIZE];
+};
+
+static void TransposePairs(const HaversinePair* pairs, const u64 count, PairChunk& chunk)
+{
+	for (u64 i = 0; i < count; ++i) {
+		chunk.x0[i] = pairs[i].p0.x;
+		chunk.y0[i] = pairs[i].p0.y;
+		chunk.x1[i] = pairs[i].p1.x;
+		chunk.y1[i] = pairs[i].p1.y;
+	}
+}
+
+void Haversine(std::span<const HaversinePair> pairs, std::span<f64> out, const f64 earthRadius)
+{
+	assert(pairs.size() == out.size());
+
+	PairChunk chunk;
+	for (u64 start = 0; start < pairs.size(); start += PAIR_CHUNK_SIZE) {
+		const u64 count = (pairs.size() - start < PAIR_CHUNK_SIZE) ? (pairs.size() - start) : PAIR_CHUNK_SIZE;
+		TransposePairs(pairs.data() + start, count, chunk);
+		Haversine({ chunk.x0, count }, { chunk.y0, count }, { chunk.x1, count }, { chunk.y1, count }, out.subspan(start, count), earthRadius);
+	}
+}
+
+f64 HaversineSum(std::span<const HaversinePair> pairs, const f64 earthRadius)
+{
+	f64 sum = 0.0;
+
+	PairChunk chunk;
+	for (u64 start = 0; start < pairs.size(); start += PAIR_CHUNK_SIZE) {
+		const u64 count = (pairs.size() - start < PAIR_CHUNK_SIZE) ? (pairs.size() - start) : PAIR_CHUNK_SIZE;
+		TransposePairs(pairs.data() + start, count, chunk);
+		sum += HaversineSum({ chunk.x0, count }, { chunk.y0, count }, { chunk.x1, count }, { chunk.y1, count }, earthRadius);
+	}
+
+	return sum;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "haversine.h"
+
+/* NOTE(Umut): Internal to the haversine code. The public API in haversine.h hides the per instruction set
+   kernels, but blocked algorithms built on top of them (distance matrix, spatial queries) need to call the
+   row kernels directly so they can pick their own tiling. Every kernel only accepts counts that are a
+   multiple of laneCount, the HaversineScalar fallback is exposed through GetHaversineImplInfo(Scalar). */
+using HaversineArrayFunction = void (*)(const f64*, const f64*, const f64*, const f64*, f64*, const u64, const f64);
+using HaversineArraySumFunction = f64 (*)(const f64*, const f64*, const f64*, const f64*, const u64, const f64);
+using HaversineQuantizedArrayFunction = void (*)(const s32*, const s32*, const s32*, const s32*, f64*, const u64, const f64);
+using HaversineQuantizedArraySumFunction = f64 (*)(const s32*, const s32*, const s32*, const s32*, const u64, const f64);
+
+// Row kernels over unit vectors, the first three arguments are the fixed point of the row.
+using UnitVectorChordSquaredFunction = void (*)(const f64, const f64, const f64, const f64*, const f64*, const f64*, f64*, const u64);
+using ChordSquaredToDistanceFunction = void (*)(f64*, const u64, const f64);
+using UnitVectorMinChordSquaredFunction = void (*)(const f64, const f64, const f64, const f64*, const f64*, const f64*, const u64,
+												   const u64, f64*, u64*);
+using UnitVectorDistanceSumFunction = f64 (*)(const f64, const f64, const f64, const f64*, const f64*, const f64*, const u64, const f64);
+
+struct HaversineImplInfo
+{
+	const char* name;
+	u64 laneCount;
+	HaversineArrayFunction array;
+	HaversineArraySumFunction arraySum;
+	HaversineQuantizedArrayFunction quantizedArray;
+	HaversineQuantizedArraySumFunction quantizedArraySum;
+	UnitVectorChordSquaredFunction chordSquared;
+	ChordSquaredToDistanceFunction chordSquaredToDistance;
+	UnitVectorMinChordSquaredFunction minChordSquared;
+	UnitVectorDistanceSumFunction distanceSum;
+};
+
+const HaversineImplInfo& GetHaversineImplInfo(HaversineImpl impl);
+const HaversineImplInfo& GetActiveHaversineImplInfo();
@@ -0,0 +1,203 @@
+// NOTE(Umut): Included once per instruction set by haversine_batch.cpp, inside a namespace that defines
+// Vec, Mask, LANE_COUNT and the Set1/Load/LoadQuantized/Store/Add/Sub/Mul/MulAdd/Min/Max/Sqrt/CmpGt/Select/ReduceAdd/
+// LaneIndices wrappers. Keep it free of anything that is not one of those wrappers so every copy evaluates the
+// same formulas for its own lane width. MulAdd is only fused where the instruction set has FMA, so the copies
+// round differently by a few ulps.
+
+static Vec RoundToNearestKernel(const Vec x)
+{
+	// NOTE(Umut): Adding 1.5 * 2^52 pushes the fraction bits out of the mantissa, valid for |x| < 2^51.
+	const Vec magic = Set1(6755399441055744.0);
+	return Sub(Add(x, magic), magic);
+}
+
+static Vec OddPolynomialKernel(const Vec x, const f64* coefficients, const u32 count)
+{
+	const Vec x2 = Mul(x, x);
+	Vec result = Set1(coefficients[count - 1]);
+	for (u32 i = count - 1; i > 0; --i) {
+		result = MulAdd(result, x2, Set1(coefficients[i - 1]));
+	}
+
+	return Mul(result, x);
+}
+
+static Vec SinKernel(const Vec angle)
+{
+	const Vec k = RoundToNearestKernel(Mul(angle, Set1(INV_TWO_PI64)));
+	Vec x = Sub(Sub(angle, Mul(k, Set1(TWO_PI64_HI))), Mul(k, Set1(TWO_PI64_LO)));
+
+	// sin(pi - x) = sin(x), folds [-pi, pi] into [-pi/2, pi/2] without branches.
+	x = Min(x, Sub(Set1(PI64), x));
+	x = Max(x, Sub(Set1(-PI64), x));
+
+	return OddPolynomialKernel(x, SIN_COEFFICIENTS.data(), SIN_TERM_COUNT);
+}
+
+static Vec CosKernel(const Vec angle)
+{
+	return SinKernel(Add(angle, Set1(HALF_PI64)));
+}
+
+// NOTE(Umut): Only valid for x in [0, 1], which is all haversine needs.
+static Vec AsinKernel(const Vec x)
+{
+	const Mask isLarge = CmpGt(x, Set1(0.5));
+	const Vec reduced = Sqrt(Mul(Set1(0.5), Sub(Set1(1.0), x)));
+	const Vec poly = OddPolynomialKernel(Select(isLarge, reduced, x), ASIN_COEFFICIENTS.data(), ASIN_TERM_COUNT);
+
+	return Select(isLarge, Sub(Set1(HALF_PI64), Add(poly, poly)), poly);
+}
+
+static Vec HaversineKernel(const Vec x0, const Vec y0, const Vec x1, const Vec y1, const Vec earthRadius)
+{
+	const Vec degreesToRadians = Set1(0.01745329251994329577);
+	const Vec half = Set1(0.5);
+
+	const Vec dLat = Mul(Sub(y1, y0), degreesToRadians);
+	const Vec dLon = Mul(Sub(x1, x0), degreesToRadians);
+	const Vec lat1 = Mul(y0, degreesToRadians);
+	const Vec lat2 = Mul(y1, degreesToRadians);
+
+	const Vec sinHalfDLat = SinKernel(Mul(dLat, half));
+	const Vec sinHalfDLon = SinKernel(Mul(dLon, half));
+	const Vec cosLatProduct = Mul(CosKernel(lat1), CosKernel(lat2));
+
+	Vec a = MulAdd(cosLatProduct, Mul(sinHalfDLon, sinHalfDLon), Mul(sinHalfDLat, sinHalfDLat));
+	a = Min(a, Set1(1.0));
+
+	const Vec c = Mul(Set1(2.0), AsinKernel(Sqrt(a)));
+	return Mul(earthRadius, c);
+}
+
+// NOTE(Umut): count has to be a multiple of LANE_COUNT, the caller handles the tail.
+static void HaversineArray(const f64* x0, const f64* y0, const f64* x1, const f64* y1, f64* out, const u64 count, const f64 earthRadius)
+{
+	const Vec radius = Set1(earthRadius);
+	for (u64 i = 0; i < count; i += LANE_COUNT) {
+		Store(out + i, HaversineKernel(Load(x0 + i), Load(y0 + i), Load(x1 + i), Load(y1 + i), radius));
+	}
+}
+
+static f64 HaversineArraySum(const f64* x0, const f64* y0, const f64* x1, const f64* y1, const u64 count, const f64 earthRadius)
+{
+	const Vec radius = Set1(earthRadius);
+	Vec sum = Set1(0.0);
+	for (u64 i = 0; i < count; i += LANE_COUNT) {
+		sum = Add(sum, HaversineKernel(Load(x0 + i), Load(y0 + i), Load(x1 + i), Load(y1 + i), radius));
+	}
+
+	return ReduceAdd(sum);
+}
+
+static void HaversineQuantizedArray(const s32* x0, const s32* y0, const s32* x1, const s32* y1, f64* out, const u64 count, const f64 earthRadius)
+{
+	const Vec radius = Set1(earthRadius);
+	const Vec lonScale = Set1(QUANTIZED_LON_SCALE);
+	const Vec latScale = Set1(QUANTIZED_LAT_SCALE);
+	for (u64 i = 0; i < count; i += LANE_COUNT) {
+		Store(out + i, HaversineKernel(Mul(LoadQuantized(x0 + i), lonScale), Mul(LoadQuantized(y0 + i), latScale),
+									   Mul(LoadQuantized(x1 + i), lonScale), Mul(LoadQuantized(y1 + i), latScale), radius));
+	}
+}
+
+static f64 HaversineQuantizedArraySum(const s32* x0, const s32* y0, const s32* x1, const s32* y1, const u64 count, const f64 earthRadius)
+{
+	const Vec radius = Set1(earthRadius);
+	const Vec lonScale = Set1(QUANTIZED_LON_SCALE);
+	const Vec latScale = Set1(QUANTIZED_LAT_SCALE);
+	Vec sum = Set1(0.0);
+	for (u64 i = 0; i < count; i += LANE_COUNT) {
+		sum = Add(sum, HaversineKernel(Mul(LoadQuantized(x0 + i), lonScale), Mul(LoadQuantized(y0 + i), latScale),
+									   Mul(LoadQuantized(x1 + i), lonScale), Mul(LoadQuantized(y1 + i), latScale), radius));
+	}
+
+	return ReduceAdd(sum);
+}
+
+/* NOTE(Umut): All-pairs kernels work on precomputed unit vectors instead of angles. The squared chord
+   between two points on the unit sphere equals 4 * a of the haversine formula, and differencing the
+   components keeps it accurate for nearby points, unlike the 1 - cos(angle) form. Distance is monotonic
+   in the chord, so min searches never need the asin. */
+static Vec ChordSquaredKernel(const Vec px, const Vec py, const Vec pz, const Vec x, const Vec y, const Vec z)
+{
+	const Vec dx = Sub(px, x);
+	const Vec dy = Sub(py, y);
+	const Vec dz = Sub(pz, z);
+	return MulAdd(dz, dz, MulAdd(dy, dy, Mul(dx, dx)));
+}
+
+static Vec ChordDistanceKernel(const Vec chordSquared, const Vec diameter)
+{
+	// distance = 2R * asin(chord / 2), chord can exceed 2 by rounding.
+	const Vec halfChord = Min(Mul(Sqrt(chordSquared), Set1(0.5)), Set1(1.0));
+	return Mul(diameter, AsinKernel(halfChord));
+}
+
+static void UnitVectorChordSquared(const f64 px, const f64 py, const f64 pz, const f64* x, const f64* y, const f64* z, f64* out, const u64 count)
+{
+	const Vec pxVec = Set1(px);
+	const Vec pyVec = Set1(py);
+	const Vec pzVec = Set1(pz);
+	for (u64 i = 0; i < count; i += LANE_COUNT) {
+		Store(out + i, ChordSquaredKernel(pxVec, pyVec, pzVec, Load(x + i), Load(y + i), Load(z + i)));
+	}
+}
+
+static void ChordSquaredToDistance(f64* values, const u64 count, const f64 earthRadius)
+{
+	const Vec diameter = Set1(2.0 * earthRadius);
+	for (u64 i = 0; i < count; i += LANE_COUNT) {
+		Store(values + i, ChordDistanceKernel(Load(values + i), diameter));
+	}
+}
+
+// NOTE(Umut): Updates minOut/argminOut in place, ties keep the lowest index. indexBase is added to the reported index.
+static void UnitVectorMinChordSquared(const f64 px, const f64 py, const f64 pz, const f64* x, const f64* y, const f64* z, const u64 count,
+									  const u64 indexBase, f64* minOut, u64* argminOut)
+{
+	const Vec pxVec = Set1(px);
+	const Vec pyVec = Set1(py);
+	const Vec pzVec = Set1(pz);
+	const Vec laneIndices = LaneIndices();
+
+	Vec minVec = Set1(*minOut);
+	Vec argminVec = Set1(-1.0);
+	for (u64 i = 0; i < count; i += LANE_COUNT) {
+		const Vec chordSquared = ChordSquaredKernel(pxVec, pyVec, pzVec, Load(x + i), Load(y + i), Load(z + i));
+		const Mask isLess = CmpGt(minVec, chordSquared);
+		minVec = Select(isLess, chordSquared, minVec);
+		argminVec = Select(isLess, Add(Set1(static_cast<f64>(i)), laneIndices), argminVec);
+	}
+
+	f64 mins[LANE_COUNT];
+	f64 argmins[LANE_COUNT];
+	Store(mins, minVec);
+	Store(argmins, argminVec);
+	for (u64 lane = 0; lane < LANE_COUNT; ++lane) {
+		if (argmins[lane] < 0.0) {
+			continue;
+		}
+
+		const u64 index = indexBase + static_cast<u64>(argmins[lane]);
+		if ((mins[lane] < *minOut) || ((mins[lane] == *minOut) && (index < *argminOut))) {
+			*minOut = mins[lane];
+			*argminOut = index;
+		}
+	}
+}
+
+static f64 UnitVectorDistanceSum(const f64 px, const f64 py, const f64 pz, const f64* x, const f64* y, const f64* z, const u64 count, const f64 earthRadius)
+{
+	const Vec pxVec = Set1(px);
+	const Vec pyVec = Set1(py);
+	const Vec pzVec = Set1(pz);
+	const Vec diameter = Set1(2.0 * earthRadius);
+
+	Vec sum = Set1(0.0);
+	for (u64 i = 0; i < count; i += LANE_COUNT) {
+		sum = Add(sum, ChordDistanceKernel(ChordSquaredKernel(pxVec, pyVec, pzVec, Load(x + i), Load(y + i), Load(z + i)), diameter));
+	}
+
+	return ReduceAdd(sum);
+}
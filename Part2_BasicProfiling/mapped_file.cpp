@@ -0,0 +1,215 @@
+#include "mapped_file.h"
+
+#if _WIN32
+
+MappedFile MapFileReadOnly(const char* fileName)
+{
+	MappedFile result = {};
+
+	result.fileHandle = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+									FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (result.fileHandle == INVALID_HANDLE_VALUE) {
+		return result;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(result.fileHandle, &fileSize) || (fileSize.QuadPart == 0)) {
+		UnmapFile(result);
+		return result;
+	}
+
+	result.mappingHandle = CreateFileMappingA(result.fileHandle, 0, PAGE_READONLY, 0, 0, 0);
+	if (!result.mappingHandle) {
+		UnmapFile(result);
+		return result;
+	}
+
+	result.data = static_cast<const u8*>(MapViewOfFile(result.mappingHandle, FILE_MAP_READ, 0, 0, 0));
+	if (!result.data) {
+		UnmapFile(result);
+		return result;
+	}
+
+	result.size = fileSize.QuadPart;
+	return result;
+}
+
+MappedFile CreateSharedMapping(const char* fileName, const u64 size)
+{
+	MappedFile result = {};
+
+	// NOTE(Umut): Readers open the file while it is written, so both sides share read and write access.
+	result.fileHandle = CreateFileA(fileName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, 0,
+									OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (result.fileHandle == INVALID_HANDLE_VALUE) {
+		return result;
+	}
+
+	result.mappingHandle = CreateFileMappingA(result.fileHandle, 0, PAGE_READWRITE, static_cast<DWORD>(size >> 32),
+											  static_cast<DWORD>(size), 0);
+	if (!result.mappingHandle) {
+		UnmapFile(result);
+		return result;
+	}
+
+	result.data = static_cast<const u8*>(MapViewOfFile(result.mappingHandle, FILE_MAP_WRITE, 0, 0, 0));
+	if (!result.data) {
+		UnmapFile(result);
+		return result;
+	}
+
+	result.size = size;
+	return result;
+}
+
+MappedFile OpenSharedMapping(const char* fileName)
+{
+	MappedFile result = {};
+
+	result.fileHandle = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, 0, OPEN_EXISTING,
+									FILE_ATTRIBUTE_NORMAL, 0);
+	if (result.fileHandle == INVALID_HANDLE_VALUE) {
+		return result;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(result.fileHandle, &fileSize) || (fileSize.QuadPart == 0)) {
+		UnmapFile(result);
+		return result;
+	}
+
+	result.mappingHandle = CreateFileMappingA(result.fileHandle, 0, PAGE_READONLY, 0, 0, 0);
+	if (!result.mappingHandle) {
+		UnmapFile(result);
+		return result;
+	}
+
+	result.data = static_cast<const u8*>(MapViewOfFile(result.mappingHandle, FILE_MAP_READ, 0, 0, 0));
+	if (!result.data) {
+		UnmapFile(result);
+		return result;
+	}
+
+	result.size = fileSize.QuadPart;
+	return result;
+}
+
+void UnmapFile(MappedFile& file)
+{
+	if (file.data) {
+		UnmapViewOfFile(file.data);
+	}
+
+	if (file.mappingHandle) {
+		CloseHandle(file.mappingHandle);
+	}
+
+	if (file.fileHandle != INVALID_HANDLE_VALUE) {
+		CloseHandle(file.fileHandle);
+	}
+
+	file = MappedFile{};
+}
+
+#else
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MappedFile MapFileReadOnly(const char* fileName)
+{
+	MappedFile result = {};
+
+	result.fileDescriptor = open(fileName, O_RDONLY);
+	if (result.fileDescriptor < 0) {
+		return result;
+	}
+
+	struct stat fileStat;
+	if ((fstat(result.fileDescriptor, &fileStat) != 0) || (fileStat.st_size == 0)) {
+		UnmapFile(result);
+		return result;
+	}
+
+	void* data = mmap(0, fileStat.st_size, PROT_READ, MAP_PRIVATE, result.fileDescriptor, 0);
+	if (data == MAP_FAILED) {
+		UnmapFile(result);
+		return result;
+	}
+
+	// NOTE(Umut): Readers of mapped files walk them front to back, let the kernel read ahead aggressively.
+	madvise(data, fileStat.st_size, MADV_SEQUENTIAL);
+
+	result.data = static_cast<const u8*>(data);
+	result.size = fileStat.st_size;
+	return result;
+}
+
+MappedFile CreateSharedMapping(const char* fileName, const u64 size)
+{
+	MappedFile result = {};
+
+	result.fileDescriptor = open(fileName, O_RDWR | O_CREAT, 0644);
+	if (result.fileDescriptor < 0) {
+		return result;
+	}
+
+	if (ftruncate(result.fileDescriptor, static_cast<off_t>(size)) != 0) {
+		UnmapFile(result);
+		return result;
+	}
+
+	void* data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, result.fileDescriptor, 0);
+	if (data == MAP_FAILED) {
+		UnmapFile(result);
+		return result;
+	}
+
+	result.data = static_cast<const u8*>(data);
+	result.size = size;
+	return result;
+}
+
+MappedFile OpenSharedMapping(const char* fileName)
+{
+	MappedFile result = {};
+
+	result.fileDescriptor = open(fileName, O_RDONLY);
+	if (result.fileDescriptor < 0) {
+		return result;
+	}
+
+	struct stat fileStat;
+	if ((fstat(result.fileDescriptor, &fileStat) != 0) || (fileStat.st_size == 0)) {
+		UnmapFile(result);
+		return result;
+	}
+
+	// NOTE(Umut): Shared, a private mapping may keep showing the pages as they were when first touched.
+	void* data = mmap(0, fileStat.st_size, PROT_READ, MAP_SHARED, result.fileDescriptor, 0);
+	if (data == MAP_FAILED) {
+		UnmapFile(result);
+		return result;
+	}
+
+	result.data = static_cast<const u8*>(data);
+	result.size = fileStat.st_size;
+	return result;
+}
+
+void UnmapFile(MappedFile& file)
+{
+	if (file.data) {
+		munmap(const_cast<u8*>(file.data), file.size);
+	}
+
+	if (file.fileDescriptor >= 0) {
+		close(file.fileDescriptor);
+	}
+
+	file = MappedFile{};
+}
+
+#endif
@@ -0,0 +1,45 @@
+#pragma once
+
+#if _WIN32
+#include <windows.h>
+#endif
+
+#include "basedef.h"
+
+struct MappedFile
+{
+	const u8* data = nullptr;
+	u64 size = 0;
+
+#if _WIN32
+	HANDLE fileHandle = INVALID_HANDLE_VALUE;
+	HANDLE mappingHandle = nullptr;
+#else
+	int fileDescriptor = -1;
+#endif
+};
+
+inline b32 IsValid(const MappedFile& file)
+{
+	return !!file.data;
+}
+
+/**
+ * @brief Map a whole file read-only into the address space. Pages are faulted in on first touch,
+ *        so nothing is copied up front. Returns an invalid MappedFile on failure.
+ */
+MappedFile MapFileReadOnly(const char* fileName);
+void UnmapFile(MappedFile& file);
+
+/**
+ * @brief Create a file of the given size, or resize an existing one, and map it read-write and shared, so every
+ *        process mapping the same file sees the writes as they happen. An existing file is not truncated first,
+ *        a reader still mapping it keeps valid pages. Returns an invalid MappedFile on failure.
+ */
+MappedFile CreateSharedMapping(const char* fileName, const u64 size);
+
+/**
+ * @brief Map a file another process keeps writing through CreateSharedMapping, read-only and shared.
+ *        Returns an invalid MappedFile on failure.
+ */
+MappedFile OpenSharedMapping(const char* fileName);
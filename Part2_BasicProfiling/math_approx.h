@@ -0,0 +1,120 @@
+#pragma once
+
+#include <array>
+#include <emmintrin.h>
+#include <xmmintrin.h>
+
+#include "basedef.h"
+
+// NOTE(Umut): Candidate replacements for the libm calls in ReferenceHaversine. They are meant to be
+// benchmarked against libm before we switch, not to be bit exact with it.
+
+const f64 PI64 = 3.14159265358979323846;
+const f64 HALF_PI64 = 1.57079632679489661923;
+const f64 TWO_PI64 = 6.28318530717958647692;
+const f64 INV_TWO_PI64 = 0.15915494309189533577;
+
+// NOTE(Umut): 2pi split into a high part with trailing zero bits and the remainder (Cody-Waite),
+// so k * TWO_PI64_HI is exact for |k| < 2^20.
+const f64 TWO_PI64_HI = 6.2831853069365025;
+const f64 TWO_PI64_LO = 2.430840202602477e-10;
+
+const u32 SIN_TERM_COUNT = 11;
+const u32 ASIN_TERM_COUNT = 24;
+
+constexpr std::array<f64, SIN_TERM_COUNT> MakeSinCoefficients()
+{
+	std::array<f64, SIN_TERM_COUNT> result = {};
+
+	// NOTE(Umut): Taylor series, (-1)^n / (2n + 1)!
+	f64 term = 1.0;
+	for (u32 n = 0; n < SIN_TERM_COUNT; ++n) {
+		result[n] = term;
+		term = -term / static_cast<f64>((2 * n + 2) * (2 * n + 3));
+	}
+
+	return result;
+}
+
+constexpr std::array<f64, ASIN_TERM_COUNT> MakeAsinCoefficients()
+{
+	std::array<f64, ASIN_TERM_COUNT> result = {};
+
+	// NOTE(Umut): Taylor series, (2n)! / (4^n (n!)^2 (2n + 1))
+	f64 binomial = 1.0;
+	for (u32 n = 0; n < ASIN_TERM_COUNT; ++n) {
+		result[n] = binomial / static_cast<f64>(2 * n + 1);
+		binomial *= static_cast<f64>(2 * n + 1) / static_cast<f64>(2 * n + 2);
+	}
+
+	return result;
+}
+
+inline constexpr std::array<f64, SIN_TERM_COUNT> SIN_COEFFICIENTS = MakeSinCoefficients();
+inline constexpr std::array<f64, ASIN_TERM_COUNT> ASIN_COEFFICIENTS = MakeAsinCoefficients();
+
+template <size_t N>
+inline f64 OddPolynomial(const f64 x, const std::array<f64, N>& coefficients)
+{
+	const f64 x2 = x * x;
+	f64 result = coefficients[N - 1];
+	for (size_t i = N - 1; i > 0; --i) {
+		result = result * x2 + coefficients[i - 1];
+	}
+
+	return result * x;
+}
+
+inline f64 RoundToNearest(const f64 value)
+{
+	// NOTE(Umut): cvtsd2si rounds with the current MXCSR mode, which is round-to-nearest by default.
+	return static_cast<f64>(_mm_cvtsd_si64(_mm_set_sd(value)));
+}
+
+inline f64 SqrtSse(const f64 x)
+{
+	return _mm_cvtsd_f64(_mm_sqrt_sd(_mm_setzero_pd(), _mm_set_sd(x)));
+}
+
+/**
+ * @brief sqrt from the single precision rsqrt estimate (~12 bits), refined by two Newton-Raphson
+ *        steps in double precision (~46 bits).
+ */
+inline f64 SqrtApprox(const f64 x)
+{
+	f64 y = static_cast<f64>(_mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(static_cast<f32>(x)))));
+	y = y * (1.5 - 0.5 * x * y * y);
+	y = y * (1.5 - 0.5 * x * y * y);
+
+	return (x > 0.0) ? x * y : 0.0;
+}
+
+inline f64 SinApprox(f64 x)
+{
+	// Range reduction to [-pi, pi].
+	const f64 k = RoundToNearest(x * INV_TWO_PI64);
+	x = (x - k * TWO_PI64_HI) - k * TWO_PI64_LO;
+
+	// sin(pi - x) = sin(x), folds [-pi, pi] into [-pi/2, pi/2].
+	x = (x > HALF_PI64) ? (PI64 - x) : x;
+	x = (x < -HALF_PI64) ? (-PI64 - x) : x;
+
+	return OddPolynomial(x, SIN_COEFFICIENTS);
+}
+
+inline f64 CosApprox(const f64 x)
+{
+	return SinApprox(x + HALF_PI64);
+}
+
+inline f64 AsinApprox(const f64 x)
+{
+	const f64 absX = (x < 0.0) ? -x : x;
+	if (absX <= 0.5) {
+		return OddPolynomial(x, ASIN_COEFFICIENTS);
+	}
+
+	// asin(x) = pi/2 - 2 asin(sqrt((1 - x) / 2)), keeps the series argument below 0.5.
+	const f64 result = HALF_PI64 - 2.0 * OddPolynomial(SqrtSse(0.5 * (1.0 - absX)), ASIN_COEFFICIENTS);
+	return (x < 0.0) ? -result : result;
+}
@@ -0,0 +1,78 @@
+#include "os_counters.h"
+
+#include <stdlib.h>
+
+#if _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+
+static const char* OS_COUNTER_NAMES[OS_COUNTER_COUNT] = {
+	"minor faults",
+	"major faults",
+	"voluntary switches",
+	"involuntary switches",
+	"resident bytes",
+};
+
+const char* GetOsCounterName(const u32 counter)
+{
+	return (counter < OS_COUNTER_COUNT) ? OS_COUNTER_NAMES[counter] : "unknown";
+}
+
+#if _WIN32
+
+void ReadOsCounters(u64* countsOut)
+{
+	PROCESS_MEMORY_COUNTERS memoryCounters = {};
+	memoryCounters.cb = sizeof(memoryCounters);
+	GetProcessMemoryInfo(GetCurrentProcess(), &memoryCounters, sizeof(memoryCounters));
+
+	countsOut[OS_COUNTER_MINOR_FAULTS] = memoryCounters.PageFaultCount;
+	countsOut[OS_COUNTER_MAJOR_FAULTS] = 0;
+	countsOut[OS_COUNTER_VOLUNTARY_SWITCHES] = 0;
+	countsOut[OS_COUNTER_INVOLUNTARY_SWITCHES] = 0;
+	countsOut[OS_COUNTER_RESIDENT_BYTES] = memoryCounters.WorkingSetSize;
+}
+
+#else
+
+static u64 ReadResidentBytes()
+{
+	// NOTE(Umut): Kept open for the whole run, pread from the start gives a fresh snapshot without reopening.
+	static const s32 statmFd = open("/proc/self/statm", O_RDONLY);
+	static const u64 pageSize = static_cast<u64>(sysconf(_SC_PAGESIZE));
+	if (statmFd < 0) {
+		return 0;
+	}
+
+	char buffer[128];
+	const ssize_t size = pread(statmFd, buffer, sizeof(buffer) - 1, 0);
+	if (size <= 0) {
+		return 0;
+	}
+	buffer[size] = '\0';
+
+	// Second field is the resident page count.
+	char* next = nullptr;
+	strtoull(buffer, &next, 10);
+	return strtoull(next, nullptr, 10) * pageSize;
+}
+
+void ReadOsCounters(u64* countsOut)
+{
+	rusage usage = {};
+	getrusage(RUSAGE_THREAD, &usage);
+
+	countsOut[OS_COUNTER_MINOR_FAULTS] = static_cast<u64>(usage.ru_minflt);
+	countsOut[OS_COUNTER_MAJOR_FAULTS] = static_cast<u64>(usage.ru_majflt);
+	countsOut[OS_COUNTER_VOLUNTARY_SWITCHES] = static_cast<u64>(usage.ru_nvcsw);
+	countsOut[OS_COUNTER_INVOLUNTARY_SWITCHES] = static_cast<u64>(usage.ru_nivcsw);
+	countsOut[OS_COUNTER_RESIDENT_BYTES] = ReadResidentBytes();
+}
+
+#endif
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "basedef.h"
+
+enum OsCounter : u32
+{
+	OS_COUNTER_MINOR_FAULTS,
+	OS_COUNTER_MAJOR_FAULTS,
+	OS_COUNTER_VOLUNTARY_SWITCHES,
+	OS_COUNTER_INVOLUNTARY_SWITCHES,
+	OS_COUNTER_RESIDENT_BYTES,
+
+	OS_COUNTER_COUNT,
+};
+
+/* NOTE(Umut): Faults and context switches come from getrusage(RUSAGE_THREAD) and only count the calling
+   thread. The resident set comes from /proc/self/statm and is process wide, so blocks on other threads move
+   it too. Costs a couple of syscalls per read, only meant for finding blocks that fault, not for timing.
+   Windows only reports the process fault count (as minor faults) and the working set. */
+void ReadOsCounters(u64* countsOut);
+
+const char* GetOsCounterName(const u32 counter);
@@ -0,0 +1,83 @@
+#include "output_file.h"
+
+#if _WIN32
+
+// NOTE(Umut): WriteFile takes a DWORD size, larger writes are split into chunks below 4GB.
+const u64 MAX_WRITE_SIZE = 1ull << 30;
+
+OutputFile OpenOutputFile(const char* fileName)
+{
+	OutputFile result = {};
+	result.fileHandle = CreateFileA(fileName, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	return result;
+}
+
+bool WriteAt(const OutputFile& file, const u64 offset, const void* data, const u64 size)
+{
+	const u8* bytes = static_cast<const u8*>(data);
+	for (u64 written = 0; written < size;) {
+		const u64 remaining = size - written;
+		const DWORD chunkSize = static_cast<DWORD>((remaining < MAX_WRITE_SIZE) ? remaining : MAX_WRITE_SIZE);
+
+		// An OVERLAPPED offset on a synchronous handle makes this a positional write.
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = static_cast<DWORD>(offset + written);
+		overlapped.OffsetHigh = static_cast<DWORD>((offset + written) >> 32);
+
+		DWORD chunkWritten = 0;
+		if (!WriteFile(file.fileHandle, bytes + written, chunkSize, &chunkWritten, &overlapped) || !chunkWritten) {
+			return false;
+		}
+
+		written += chunkWritten;
+	}
+
+	return true;
+}
+
+void CloseOutputFile(OutputFile& file)
+{
+	if (file.fileHandle != INVALID_HANDLE_VALUE) {
+		CloseHandle(file.fileHandle);
+	}
+
+	file = OutputFile{};
+}
+
+#else
+
+#include <fcntl.h>
+#include <unistd.h>
+
+OutputFile OpenOutputFile(const char* fileName)
+{
+	OutputFile result = {};
+	result.fileDescriptor = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	return result;
+}
+
+bool WriteAt(const OutputFile& file, const u64 offset, const void* data, const u64 size)
+{
+	const u8* bytes = static_cast<const u8*>(data);
+	for (u64 written = 0; written < size;) {
+		const ssize_t chunkWritten = pwrite(file.fileDescriptor, bytes + written, size - written, offset + written);
+		if (chunkWritten <= 0) {
+			return false;
+		}
+
+		written += chunkWritten;
+	}
+
+	return true;
+}
+
+void CloseOutputFile(OutputFile& file)
+{
+	if (file.fileDescriptor >= 0) {
+		close(file.fileDescriptor);
+	}
+
+	file = OutputFile{};
+}
+
+#endif
@@ -0,0 +1,38 @@
+#pragma once
+
+#if _WIN32
+#include <windows.h>
+#endif
+
+#include "basedef.h"
+
+struct OutputFile
+{
+#if _WIN32
+	HANDLE fileHandle = INVALID_HANDLE_VALUE;
+#else
+	int fileDescriptor = -1;
+#endif
+};
+
+inline b32 IsValid(const OutputFile& file)
+{
+#if _WIN32
+	return file.fileHandle != INVALID_HANDLE_VALUE;
+#else
+	return file.fileDescriptor >= 0;
+#endif
+}
+
+/**
+ * @brief Create or truncate a file for writing. Returns an invalid OutputFile on failure.
+ */
+OutputFile OpenOutputFile(const char* fileName);
+
+/**
+ * @brief Positional write that leaves no shared file pointer behind, so several threads can write
+ *        disjoint ranges of the same file at once. Returns false unless every byte was written.
+ */
+bool WriteAt(const OutputFile& file, const u64 offset, const void* data, const u64 size);
+
+void CloseOutputFile(OutputFile& file);
@@ -0,0 +1,433 @@
+#include "pair_generator.h"
+
+#include "haversine.h"
+#include "output_file.h"
+#include "profiler.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+
+// NOTE(Umut): Pairs per unit of work. The chunk grid does not depend on the thread count, so neither do
+// the chunk sums the mean is reduced from.
+const u64 GENERATOR_CHUNK_PAIR_COUNT = 8192;
+
+const u32 PAIR_STREAM = 0;
+const u32 CLUSTER_STREAM = 1;
+
+struct PhiloxBlock
+{
+	u64 values[2];
+};
+
+/**
+ * @brief Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3").
+ */
+static PhiloxBlock Philox(const u64 index, const u32 stream, const u32 block, const u64 seed)
+{
+	u32 counter[4] = { static_cast<u32>(index), static_cast<u32>(index >> 32), stream, block };
+	u32 key[2] = { static_cast<u32>(seed), static_cast<u32>(seed >> 32) };
+
+	for (u32 round = 0; round < 10; ++round) {
+		const u64 product0 = static_cast<u64>(0xD2511F53u) * counter[0];
+		const u64 product1 = static_cast<u64>(0xCD9E8D57u) * counter[2];
+
+		const u32 next[4] = {
+			static_cast<u32>(product1 >> 32) ^ counter[1] ^ key[0],
+			static_cast<u32>(product1),
+			static_cast<u32>(product0 >> 32) ^ counter[3] ^ key[1],
+			static_cast<u32>(product0),
+		};
+		memcpy(counter, next, sizeof(counter));
+
+		key[0] += 0x9E3779B9u;
+		key[1] += 0xBB67AE85u;
+	}
+
+	PhiloxBlock result;
+	result.values[0] = (static_cast<u64>(counter[1]) << 32) | counter[0];
+	result.values[1] = (static_cast<u64>(counter[3]) << 32) | counter[2];
+	return result;
+}
+
+static f64 ToUniform(const u64 bits, const f64 min, const f64 max)
+{
+	// Top 53 bits as a fraction in [0, 1).
+	const f64 unit = static_cast<f64>(bits >> 11) * (1.0 / 9007199254740992.0);
+	return min + unit * (max - min);
+}
+
+static f64 WrapToRange(const f64 value, const f64 min, const f64 max)
+{
+	const f64 range = max - min;
+	return (value < 0 ? max : min) + fmod(value, range);
+}
+
+struct ClusterBounds
+{
+	f64 minX;
+	f64 maxX;
+	f64 minY;
+	f64 maxY;
+};
+
+// NOTE(Umut): Clusters are contiguous and equally populated, the last one takes the remainder.
+static u64 GetClusterIndex(const PairGeneratorParameters& params, const u64 pairIndex)
+{
+	const u64 clusterCount = (params.isCluster && params.clusterCount) ? params.clusterCount : 1;
+	const u64 population = params.pairCount / clusterCount;
+	return (population && (pairIndex / population < clusterCount)) ? (pairIndex / population) : (clusterCount - 1);
+}
+
+static ClusterBounds GetClusterBounds(const PairGeneratorParameters& params, const u64 cluster)
+{
+	if (!params.isCluster) {
+		return { -180.0, 180.0, -90.0, 90.0 };
+	}
+
+	const PhiloxBlock center = Philox(cluster, CLUSTER_STREAM, 0, params.seed);
+	const PhiloxBlock range = Philox(cluster, CLUSTER_STREAM, 1, params.seed);
+	const f64 centerX = ToUniform(center.values[0], -180.0, 180.0);
+	const f64 centerY = ToUniform(center.values[1], -90.0, 90.0);
+	const f64 rangeX = ToUniform(range.values[0], 0.0, 180.0);
+	const f64 rangeY = ToUniform(range.values[1], 0.0, 90.0);
+
+	return { centerX - rangeX, centerX + rangeX, centerY - rangeY, centerY + rangeY };
+}
+
+static HaversinePair GeneratePair(const PairGeneratorParameters& params, const ClusterBounds& bounds, const u64 pairIndex)
+{
+	const PhiloxBlock p0 = Philox(pairIndex, PAIR_STREAM, 0, params.seed);
+	const PhiloxBlock p1 = Philox(pairIndex, PAIR_STREAM, 1, params.seed);
+
+	return {
+		WrapToRange(ToUniform(p0.values[0], bounds.minX, bounds.maxX), -180.0, 180.0),
+		WrapToRange(ToUniform(p0.values[1], bounds.minY, bounds.maxY), -90.0, 90.0),
+		WrapToRange(ToUniform(p1.values[0], bounds.minX, bounds.maxX), -180.0, 180.0),
+		WrapToRange(ToUniform(p1.values[1], bounds.minY, bounds.maxY), -90.0, 90.0)
+	};
+}
+
+HaversinePair GeneratePair(const PairGeneratorParameters& params, const u64 pairIndex)
+{
+	return GeneratePair(params, GetClusterBounds(params, GetClusterIndex(params, pairIndex)), pairIndex);
+}
+
+void GeneratePairs(const PairGeneratorParameters& params, const u64 firstPairIndex, std::span<HaversinePair> pairsOut)
+{
+	u64 cluster = GetClusterIndex(params, firstPairIndex);
+	ClusterBounds bounds = GetClusterBounds(params, cluster);
+	for (u64 i = 0; i < pairsOut.size(); ++i) {
+		if (GetClusterIndex(params, firstPairIndex + i) != cluster) {
+			cluster = GetClusterIndex(params, firstPairIndex + i);
+			bounds = GetClusterBounds(params, cluster);
+		}
+
+		pairsOut[i] = GeneratePair(params, bounds, firstPairIndex + i);
+	}
+}
+
+static const char DIGIT_PAIRS[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+/**
+ * @brief Right aligned %<width>.16f replacement. The 16 decimals come from the exact fraction of the value,
+ *        rounded once, so they are within one unit of the last digit of what printf prints.
+ */
+static void FormatFixed16(const f64 value, const u32 width, char* out)
+{
+	const u64 FRACTION_SCALE = 10000000000000000ull;
+
+	const f64 magnitude = fabs(value);
+	u64 integer = static_cast<u64>(magnitude);
+	u64 fraction = static_cast<u64>((magnitude - static_cast<f64>(integer)) * static_cast<f64>(FRACTION_SCALE) + 0.5);
+	if (fraction >= FRACTION_SCALE) {
+		fraction -= FRACTION_SCALE;
+		++integer;
+	}
+
+	char* cursor = out + width;
+	for (u32 i = 0; i < 8; ++i) {
+		cursor -= 2;
+		memcpy(cursor, DIGIT_PAIRS + 2 * (fraction % 100), 2);
+		fraction /= 100;
+	}
+
+	*--cursor = '.';
+	do {
+		*--cursor = static_cast<char>('0' + integer % 10);
+		integer /= 10;
+	} while (integer);
+
+	if (value < 0.0) {
+		*--cursor = '-';
+	}
+
+	assert(cursor >= out);
+	memset(out, ' ', cursor - out);
+}
+
+void FormatPairRecord(const HaversinePair& pair, const bool isLast, char* out)
+{
+	// {"x0":<21>, "y0":<20>, "x1":<21>, "y1":<20>},\n
+	char* cursor = out;
+	memcpy(cursor, "{\"x0\":", 6);
+	FormatFixed16(pair.p0.x, 21, cursor + 6);
+	cursor += 27;
+	memcpy(cursor, ", \"y0\":", 7);
+	FormatFixed16(pair.p0.y, 20, cursor + 7);
+	cursor += 27;
+	memcpy(cursor, ", \"x1\":", 7);
+	FormatFixed16(pair.p1.x, 21, cursor + 7);
+	cursor += 28;
+	memcpy(cursor, ", \"y1\":", 7);
+	FormatFixed16(pair.p1.y, 20, cursor + 7);
+	cursor += 27;
+
+	// NOTE(Umut): The last record pads with a space instead of a comma so every record has the same size.
+	memcpy(cursor, isLast ? "} \n" : "},\n", 3);
+	assert(cursor + 3 - out == PAIR_RECORD_SIZE);
+}
+
+static u32 GetThreadCount(const PairGeneratorParameters& params)
+{
+	const u32 threadCount = params.threadCount ? params.threadCount : std::thread::hardware_concurrency();
+	return threadCount ? threadCount : 1;
+}
+
+/* NOTE(Umut): Word at a time multiply-rotate hash, not cryptographic, only meant to tell two generated data
+   sets apart. Chunks are hashed on their own and folded in chunk order, so the parallel and the streaming
+   writers end up with the same content hash. */
+const u64 HASH_PRIME0 = 0x9E3779B97F4A7C15ull;
+const u64 HASH_PRIME1 = 0xC2B2AE3D27D4EB4Full;
+
+static u64 CombineHash(const u64 hash, const u64 value)
+{
+	const u64 mixed = hash ^ (value * HASH_PRIME1);
+	return ((mixed << 31) | (mixed >> 33)) * HASH_PRIME0;
+}
+
+static u64 HashBytes(const void* data, const u64 size, u64 hash)
+{
+	const u8* bytes = static_cast<const u8*>(data);
+	hash = CombineHash(hash, size);
+
+	u64 i = 0;
+	for (; i + sizeof(u64) <= size; i += sizeof(u64)) {
+		u64 word;
+		memcpy(&word, bytes + i, sizeof(word));
+		hash = CombineHash(hash, word);
+	}
+
+	u64 word = 0;
+	memcpy(&word, bytes + i, size - i);
+	hash = CombineHash(hash, word);
+
+	hash ^= hash >> 33;
+	hash *= HASH_PRIME1;
+	return hash ^ (hash >> 29);
+}
+
+struct GeneratorChunk
+{
+	std::vector<char> text;
+	std::vector<f64> answers;
+
+	u64 first = 0;
+	u64 count = 0;
+	f64 sum = 0;
+	u64 hash = 0;
+};
+
+static u64 GetChunkCount(const PairGeneratorParameters& params)
+{
+	return (params.pairCount + GENERATOR_CHUNK_PAIR_COUNT - 1) / GENERATOR_CHUNK_PAIR_COUNT;
+}
+
+/**
+ * @brief Generate, format, answer and hash one chunk. Fills chunk.text and chunk.answers, which stay allocated
+ *        between calls so a worker never allocates after its first chunk.
+ */
+static void GenerateChunk(const PairGeneratorParameters& params, const u64 chunkIndex, GeneratorChunk& chunk)
+{
+	const u64 pairCount = params.pairCount;
+	chunk.text.resize(GENERATOR_CHUNK_PAIR_COUNT * PAIR_RECORD_SIZE);
+	chunk.answers.resize(GENERATOR_CHUNK_PAIR_COUNT);
+	chunk.first = chunkIndex * GENERATOR_CHUNK_PAIR_COUNT;
+	chunk.count = (pairCount - chunk.first < GENERATOR_CHUNK_PAIR_COUNT) ? (pairCount - chunk.first) : GENERATOR_CHUNK_PAIR_COUNT;
+
+	u64 cluster = GetClusterIndex(params, chunk.first);
+	ClusterBounds bounds = GetClusterBounds(params, cluster);
+
+	f64 sum = 0;
+	for (u64 i = 0; i < chunk.count; ++i) {
+		// A chunk can straddle two clusters, only look the bounds up again when it does.
+		const u64 pairIndex = chunk.first + i;
+		if (GetClusterIndex(params, pairIndex) != cluster) {
+			cluster = GetClusterIndex(params, pairIndex);
+			bounds = GetClusterBounds(params, cluster);
+		}
+
+		const HaversinePair pair = GeneratePair(params, bounds, pairIndex);
+
+		FormatPairRecord(pair, pairIndex == pairCount - 1, chunk.text.data() + i * PAIR_RECORD_SIZE);
+		chunk.answers[i] = ReferenceHaversine(pair.p0.x, pair.p0.y, pair.p1.x, pair.p1.y, EARTH_RADIUS);
+		sum += chunk.answers[i];
+	}
+
+	chunk.sum = sum;
+	chunk.hash = HashBytes(chunk.answers.data(), chunk.count * sizeof(f64), HashBytes(chunk.text.data(), chunk.count * PAIR_RECORD_SIZE, 0));
+}
+
+static const char PAIR_FILE_HEADER[] = "{\"pairs\":[";
+static const char PAIR_FILE_FOOTER[] = "]}";
+static_assert(sizeof(PAIR_FILE_HEADER) - 1 == PAIR_FILE_HEADER_SIZE);
+
+static void InitializeResult(const PairGeneratorParameters& params, PairGeneratorResult& result)
+{
+	result.dataBytes = PAIR_FILE_HEADER_SIZE + params.pairCount * PAIR_RECORD_SIZE + sizeof(PAIR_FILE_FOOTER) - 1;
+	result.answersBytes = (params.pairCount + 1) * sizeof(f64);
+	result.contentHash = HashBytes(PAIR_FILE_HEADER, PAIR_FILE_HEADER_SIZE, 0);
+}
+
+static void FinalizeResult(const PairGeneratorParameters& params, const f64 sum, PairGeneratorResult& result)
+{
+	result.mean = params.pairCount ? (sum / static_cast<f64>(params.pairCount)) : 0.0;
+	result.contentHash = CombineHash(result.contentHash, HashBytes(PAIR_FILE_FOOTER, sizeof(PAIR_FILE_FOOTER) - 1, 0));
+	result.contentHash = CombineHash(result.contentHash, HashBytes(&result.mean, sizeof(result.mean), 0));
+}
+
+PairGeneratorResult WritePairFiles(const PairGeneratorParameters& params, const char* dataFileName, const char* answersFileName)
+{
+	PairGeneratorResult result;
+	InitializeResult(params, result);
+
+	PROFILE_GROUP_FUNCTION("generate", result.dataBytes + result.answersBytes);
+
+	OutputFile dataFile = OpenOutputFile(dataFileName);
+	OutputFile answersFile = OpenOutputFile(answersFileName);
+	if (!IsValid(dataFile) || !IsValid(answersFile)) {
+		CloseOutputFile(dataFile);
+		CloseOutputFile(answersFile);
+		return result;
+	}
+
+	const u64 pairCount = params.pairCount;
+	const u64 chunkCount = GetChunkCount(params);
+	std::vector<f64> chunkSums(chunkCount);
+	std::vector<u64> chunkHashes(chunkCount);
+	std::atomic<u64> nextChunk = 0;
+	std::atomic<bool> failed = false;
+
+	auto worker = [&]() {
+		GeneratorChunk chunk;
+		for (u64 chunkIndex = nextChunk++; (chunkIndex < chunkCount) && !failed; chunkIndex = nextChunk++) {
+			GenerateChunk(params, chunkIndex, chunk);
+			chunkSums[chunkIndex] = chunk.sum;
+			chunkHashes[chunkIndex] = chunk.hash;
+
+			const bool written = WriteAt(dataFile, PAIR_FILE_HEADER_SIZE + chunk.first * PAIR_RECORD_SIZE, chunk.text.data(), chunk.count * PAIR_RECORD_SIZE) &&
+								 WriteAt(answersFile, chunk.first * sizeof(f64), chunk.answers.data(), chunk.count * sizeof(f64));
+			if (!written) {
+				failed = true;
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	const u32 threadCount = GetThreadCount(params);
+	for (u32 i = 1; (i < threadCount) && (i < chunkCount); ++i) {
+		threads.emplace_back(worker);
+	}
+
+	worker();
+
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	f64 sum = 0;
+	for (u64 i = 0; i < chunkCount; ++i) {
+		sum += chunkSums[i];
+		result.contentHash = CombineHash(result.contentHash, chunkHashes[i]);
+	}
+	FinalizeResult(params, sum, result);
+
+	const bool headerWritten = WriteAt(dataFile, 0, PAIR_FILE_HEADER, PAIR_FILE_HEADER_SIZE) &&
+							   WriteAt(dataFile, PAIR_FILE_HEADER_SIZE + pairCount * PAIR_RECORD_SIZE, PAIR_FILE_FOOTER, sizeof(PAIR_FILE_FOOTER) - 1) &&
+							   WriteAt(answersFile, pairCount * sizeof(f64), &result.mean, sizeof(f64));
+
+	CloseOutputFile(dataFile);
+	CloseOutputFile(answersFile);
+
+	result.succeeded = headerWritten && !failed;
+	return result;
+}
+
+static bool WriteChunk(FILE* dataFile, FILE* answersFile, const GeneratorChunk& chunk)
+{
+	return (fwrite(chunk.text.data(), PAIR_RECORD_SIZE, chunk.count, dataFile) == chunk.count) &&
+		   (fwrite(chunk.answers.data(), sizeof(f64), chunk.count, answersFile) == chunk.count);
+}
+
+PairGeneratorResult StreamPairFiles(const PairGeneratorParameters& params, const char* dataFileName, const char* answersFileName)
+{
+	PairGeneratorResult result;
+	InitializeResult(params, result);
+
+	PROFILE_GROUP_FUNCTION("generate", result.dataBytes + result.answersBytes);
+
+	FILE* dataFile = nullptr;
+	FILE* answersFile = nullptr;
+	const errno_t dataErr = fopen_s(&dataFile, dataFileName, "wb");
+	const errno_t answersErr = fopen_s(&answersFile, answersFileName, "wb");
+	if (dataErr || answersErr || !dataFile || !answersFile) {
+		if (dataFile) {
+			fclose(dataFile);
+		}
+		if (answersFile) {
+			fclose(answersFile);
+		}
+		return result;
+	}
+
+	bool written = fwrite(PAIR_FILE_HEADER, 1, PAIR_FILE_HEADER_SIZE, dataFile) == PAIR_FILE_HEADER_SIZE;
+
+	// NOTE(Umut): Two chunks in flight, the next one is generated while the previous one is written.
+	GeneratorChunk chunks[2];
+	std::future<bool> pendingWrite;
+
+	f64 sum = 0;
+	const u64 chunkCount = GetChunkCount(params);
+	for (u64 chunkIndex = 0; (chunkIndex < chunkCount) && written; ++chunkIndex) {
+		GeneratorChunk& chunk = chunks[chunkIndex % 2];
+		GenerateChunk(params, chunkIndex, chunk);
+		sum += chunk.sum;
+		result.contentHash = CombineHash(result.contentHash, chunk.hash);
+
+		if (pendingWrite.valid()) {
+			written = pendingWrite.get();
+		}
+		pendingWrite = std::async(std::launch::async, WriteChunk, dataFile, answersFile, std::cref(chunk));
+	}
+
+	if (pendingWrite.valid()) {
+		written = pendingWrite.get() && written;
+	}
+
+	FinalizeResult(params, sum, result);
+	written = written && (fwrite(PAIR_FILE_FOOTER, 1, sizeof(PAIR_FILE_FOOTER) - 1, dataFile) == sizeof(PAIR_FILE_FOOTER) - 1);
+	written = written && (fwrite(&result.mean, sizeof(f64), 1, answersFile) == 1);
+
+	const bool closed = !fclose(dataFile) && !fclose(answersFile);
+
+	result.succeeded = written && closed;
+	return result;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <span>
+
+#include "basedef.h"
+
+struct HaversinePair;
+
+/* NOTE(Umut): Every random number is a pure function of (seed, stream, index), drawn from a Philox4x32-10
+   counter based generator. Pair i is therefore the same no matter which thread makes it or in what order,
+   and any range of the data set can be regenerated on its own. */
+struct PairGeneratorParameters
+{
+	u64 pairCount = 0;
+	u64 seed = 0x5eed;
+
+	bool isCluster = true;
+	u32 clusterCount = 32;
+
+	// 0 picks std::thread::hardware_concurrency().
+	u32 threadCount = 0;
+};
+
+struct PairGeneratorResult
+{
+	f64 mean = 0;
+	u64 dataBytes = 0;
+	u64 answersBytes = 0;
+	// Hash of both files, identical for every writer and thread count given the same parameters.
+	u64 contentHash = 0;
+	bool succeeded = false;
+};
+
+/* NOTE(Umut): Each pair is written as a fixed width record, the numbers right aligned with spaces so the
+   JSON stays valid. The byte offset of pair i in the data file is PAIR_FILE_HEADER_SIZE + i * PAIR_RECORD_SIZE
+   and in the answers file i * sizeof(f64), which lets every worker write its slice without coordination. */
+const u64 PAIR_FILE_HEADER_SIZE = 10;
+const u64 PAIR_RECORD_SIZE = 112;
+
+HaversinePair GeneratePair(const PairGeneratorParameters& params, const u64 pairIndex);
+void GeneratePairs(const PairGeneratorParameters& params, const u64 firstPairIndex, std::span<HaversinePair> pairsOut);
+
+/**
+ * @brief Write the JSON data file and the binary answers file (per-pair reference distances followed by
+ *        the mean) for params.pairCount pairs, generated and written in parallel.
+ */
+PairGeneratorResult WritePairFiles(const PairGeneratorParameters& params, const char* dataFileName, const char* answersFileName);
+
+/**
+ * @brief Same files as WritePairFiles, written front to back by a single generator with one chunk being
+ *        written while the next is generated. Memory stays at two chunks (~2MB) whatever the pair count, and
+ *        the outputs only need to support sequential writes.
+ */
+PairGeneratorResult StreamPairFiles(const PairGeneratorParameters& params, const char* dataFileName, const char* answersFileName);
+
+/**
+ * @brief Fixed width record of a pair, exactly PAIR_RECORD_SIZE bytes including the trailing separator.
+ */
+void FormatPairRecord(const HaversinePair& pair, const bool isLast, char* out);
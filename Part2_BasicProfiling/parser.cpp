@@ -168,6 +168,16 @@ std::vector<HaversinePair> JsonParser::Parse()
 	return pairs;
 }
 
+std::unique_ptr<JsonValue> JsonParser::ParseTree()
+{
+	if (buffer.empty()) {
+		return nullptr;
+	}
+
+	bufIdx = 0;
+	return CreateTree();
+}
+
 void JsonParser::ParsePairs(std::vector<HaversinePair>& pairsOut, const std::unique_ptr<JsonValue>& root)
 {
 	const JsonValue& pairs = root->FindByLabel("pairs");
@@ -275,7 +285,8 @@ std::unique_ptr<JsonValue> JsonParser::GetJsonValue(const Token& token)
 		case TokenType::NullValue:
 		case TokenType::Number:
 		case TokenType::String:
-			return std::make_unique<JsonValue>(std::string_view(&buffer[token.startIdx], (token.endIdx - token.startIdx)));
+			// Token ends are inclusive, like for labels.
+			return std::make_unique<JsonValue>(std::string_view(&buffer[token.startIdx], (token.endIdx + 1) - token.startIdx));
 		case TokenType::OpenCurlyBrace:
 		case TokenType::OpenSquareBracket:
 			return GetJsonList(token);
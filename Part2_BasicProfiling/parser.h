@@ -70,9 +70,13 @@ class JsonParser
 		void Read(const std::string fileName);
 		std::vector<HaversinePair> Parse();
 
+		// Whole document as a tree, nullptr if nothing was read. Values point into the parser's buffer, so the
+		// parser has to outlive the tree, and the tree has to be freed with DestroyTree.
+		std::unique_ptr<JsonValue> ParseTree();
+		void DestroyTree(std::unique_ptr<JsonValue>& node);
+
 	private:
 		std::unique_ptr<JsonValue> CreateTree();
-		void DestroyTree(std::unique_ptr<JsonValue>& node);
 
 		void ParsePairs(std::vector<HaversinePair>& pairsOut, const std::unique_ptr<JsonValue>& root);
 
@@ -0,0 +1,139 @@
+#include "perf_counters.h"
+
+#include <atomic>
+
+#if !_WIN32
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+static const char* PERF_COUNTER_NAMES[PERF_COUNTER_COUNT] = {
+	"cycles",
+	"instructions",
+	"llc miss",
+	"branch miss",
+	"dtlb miss",
+};
+
+static std::atomic<const char*> lastError = nullptr;
+
+const char* GetPerfCounterName(const u32 counter)
+{
+	return (counter < PERF_COUNTER_COUNT) ? PERF_COUNTER_NAMES[counter] : "unknown";
+}
+
+const char* GetPerfCounterError()
+{
+	return lastError;
+}
+
+PerfCounterSet::~PerfCounterSet()
+{
+	Close();
+}
+
+#if _WIN32
+
+bool PerfCounterSet::Open()
+{
+	lastError = "perf counters are only supported on Linux";
+	return false;
+}
+
+void PerfCounterSet::Close()
+{
+}
+
+#else
+
+struct PerfCounterConfig
+{
+	u32 type;
+	u64 config;
+};
+
+static const PerfCounterConfig PERF_COUNTER_CONFIGS[PERF_COUNTER_COUNT] = {
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+};
+
+static s32 OpenPerfEvent(const PerfCounterConfig& config, const s32 groupFd)
+{
+	perf_event_attr attr = {};
+	attr.size = sizeof(attr);
+	attr.type = config.type;
+	attr.config = config.config;
+	// NOTE(Umut): User mode only, which is also what perf_event_paranoid 2 still allows.
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return static_cast<s32>(syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0));
+}
+
+bool PerfCounterSet::Open()
+{
+	Close();
+
+	const long pageSize = sysconf(_SC_PAGESIZE);
+	for (u32 i = 0; i < PERF_COUNTER_COUNT; ++i) {
+		fds[i] = OpenPerfEvent(PERF_COUNTER_CONFIGS[i], (i == 0) ? -1 : fds[0]);
+		if (fds[i] < 0) {
+			if (i == 0) {
+				lastError = (errno == EACCES || errno == EPERM)
+					? "perf_event_open not permitted, see /proc/sys/kernel/perf_event_paranoid"
+					: "perf_event_open failed, no hardware counters on this machine";
+				return false;
+			}
+
+			// Missing members only drop that counter.
+			continue;
+		}
+
+		void* page = mmap(nullptr, pageSize, PROT_READ, MAP_SHARED, fds[i], 0);
+		if (page == MAP_FAILED) {
+			continue;
+		}
+
+		if (!static_cast<perf_event_mmap_page*>(page)->cap_user_rdpmc) {
+			munmap(page, pageSize);
+			continue;
+		}
+
+		pages[i] = page;
+	}
+
+	if (!pages[0]) {
+		lastError = "rdpmc not permitted, see /sys/bus/event_source/devices/cpu/rdpmc";
+		Close();
+		return false;
+	}
+
+	isOpen = true;
+	return true;
+}
+
+void PerfCounterSet::Close()
+{
+	const long pageSize = sysconf(_SC_PAGESIZE);
+	for (u32 i = 0; i < PERF_COUNTER_COUNT; ++i) {
+		if (pages[i]) {
+			munmap(pages[i], pageSize);
+			pages[i] = nullptr;
+		}
+
+		if (fds[i] >= 0) {
+			close(fds[i]);
+			fds[i] = -1;
+		}
+	}
+
+	isOpen = false;
+}
+
+#endif
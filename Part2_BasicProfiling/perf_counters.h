@@ -0,0 +1,87 @@
+#pragma once
+
+#include "basedef.h"
+
+#if !_WIN32
+#include <x86intrin.h>
+#include <linux/perf_event.h>
+#endif
+
+enum PerfCounter : u32
+{
+	PERF_COUNTER_CYCLES,
+	PERF_COUNTER_INSTRUCTIONS,
+	PERF_COUNTER_LLC_MISSES,
+	PERF_COUNTER_BRANCH_MISSES,
+	PERF_COUNTER_DTLB_MISSES,
+
+	PERF_COUNTER_COUNT,
+};
+
+/* NOTE(Umut): One group of hardware counters for the calling thread, opened with perf_event_open and counting
+   user mode only. Each counter's page is mapped so it can be read with rdpmc from user space, no syscall on the
+   hot path. Counters the machine or the kernel refuses are left out, and if the group leader (cycles) can't be
+   opened, or rdpmc isn't allowed, the whole set stays closed and reads return zeros. Linux only. */
+struct PerfCounterSet
+{
+	PerfCounterSet() = default;
+	PerfCounterSet(const PerfCounterSet&) = delete;
+	PerfCounterSet& operator=(const PerfCounterSet&) = delete;
+	~PerfCounterSet();
+
+	bool Open();
+	void Close();
+
+	bool IsOpen() const { return isOpen; }
+	bool IsAvailable(const u32 counter) const { return isOpen && pages[counter]; }
+
+	void Read(u64* countsOut) const
+	{
+		for (u32 i = 0; i < PERF_COUNTER_COUNT; ++i) {
+			countsOut[i] = IsAvailable(i) ? ReadCounter(i) : 0;
+		}
+	}
+
+private:
+#if _WIN32
+	u64 ReadCounter(const u32) const
+	{
+		return 0;
+	}
+#else
+	u64 ReadCounter(const u32 counter) const
+	{
+		// NOTE(Umut): The kernel bumps lock around every update of the page, retry if it moved while reading.
+		const volatile perf_event_mmap_page* page = static_cast<const volatile perf_event_mmap_page*>(pages[counter]);
+		u32 sequence;
+		u64 count;
+		do {
+			sequence = page->lock;
+			__atomic_signal_fence(__ATOMIC_ACQUIRE);
+
+			const u32 index = page->index;
+			count = page->offset;
+			if (index) {
+				const u32 shift = 64 - page->pmc_width;
+				count += static_cast<u64>((static_cast<s64>(__rdpmc(index - 1)) << shift) >> shift);
+			}
+
+			__atomic_signal_fence(__ATOMIC_ACQUIRE);
+		} while (page->lock != sequence);
+
+		return count;
+	}
+#endif
+
+private:
+	bool isOpen = false;
+	s32 fds[PERF_COUNTER_COUNT] = { -1, -1, -1, -1, -1 };
+	void* pages[PERF_COUNTER_COUNT] = {};
+};
+
+const char* GetPerfCounterName(const u32 counter);
+
+/**
+ * @brief Why the last PerfCounterSet::Open failed, nullptr if it did not.
+ */
+const char* GetPerfCounterError();
@@ -1,6 +1,7 @@
 #include "platform_metrics.h"
+#include "tsc_frequency.h"
 
-u64 GetEstimatedCPUFrequency()
+static u64 MeasureCPUFrequency()
 {
 	const u64 MILISECONDS_TO_WAIT = 100;
 	const u64 OSFreq = GetOSTimerFreq();
@@ -24,3 +25,10 @@ u64 GetEstimatedCPUFrequency()
 
 	return cpuFreq;
 }
+
+u64 GetEstimatedCPUFrequency()
+{
+	// NOTE(Umut): Resolved once per process, every report and the profiler ask for it.
+	static const u64 cpuFreq = DiscoverTscFrequency(MeasureCPUFrequency);
+	return cpuFreq;
+}
@@ -0,0 +1,200 @@
+#include "profile_compare.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "parser.h"
+
+// Blocks faster than this in both profiles are too short to judge.
+const f64 MIN_COMPARED_MILLISECONDS = 0.005;
+
+struct ProfileBlockSummary
+{
+	std::string name;
+	u64 processedByteCount;
+	f64 inclusiveMilliseconds;
+	// Median run and how far it sits above the fastest one, relative. Both zero for a single run.
+	f64 runMedianMilliseconds;
+	f64 runSpread;
+};
+
+struct ProfileSummary
+{
+	std::string cpu;
+	std::string buildFlags;
+	std::string dataset;
+	std::vector<ProfileBlockSummary> blocks;
+};
+
+static f64 ReadNumber(const JsonValue& value)
+{
+	// NOTE(Umut): The view ends inside the buffer, at the delimiter after the number, so strtod stops there.
+	return value.value.empty() ? 0.0 : strtod(value.value.data(), nullptr);
+}
+
+static std::string ReadString(const JsonValue& value)
+{
+	std::string result;
+	for (size_t i = 0; i < value.value.size(); ++i) {
+		const char c = value.value[i];
+		if ((c == '\\') && (i + 1 < value.value.size())) {
+			result += value.value[++i];
+			continue;
+		}
+		result += c;
+	}
+
+	return result;
+}
+
+static bool LoadProfile(const char* fileName, ProfileSummary& profileOut)
+{
+	JsonParser parser;
+	parser.Read(fileName);
+
+	std::unique_ptr<JsonValue> root = parser.ParseTree();
+	if (!root) {
+		fprintf(stderr, "ERROR: Unable to read profile %s\n", fileName);
+		return false;
+	}
+
+	const JsonValue& blocks = root->FindByLabel("blocks");
+	if (blocks.label == "Null") {
+		fprintf(stderr, "ERROR: No blocks in profile %s\n", fileName);
+		parser.DestroyTree(root);
+		return false;
+	}
+
+	profileOut.cpu = ReadString(root->FindByLabel("cpu"));
+	profileOut.buildFlags = ReadString(root->FindByLabel("build_flags"));
+	profileOut.dataset = ReadString(root->FindByLabel("dataset"));
+
+	for (const JsonValue* block = blocks.firstSubValue.get(); block; block = block->nextSibling.get()) {
+		ProfileBlockSummary summary = {};
+		summary.name = ReadString(block->FindByLabel("name"));
+		summary.inclusiveMilliseconds = ReadNumber(block->FindByLabel("inclusive_ms"));
+		summary.processedByteCount = static_cast<u64>(ReadNumber(block->FindByLabel("processed_bytes")));
+
+		// NOTE(Umut): The slowest run is left out on purpose, one cold first run would otherwise hide any regression.
+		summary.runMedianMilliseconds = ReadNumber(block->FindByLabel("run_median_ms"));
+		if (summary.runMedianMilliseconds > 0.0) {
+			summary.runSpread = 1.0 - ReadNumber(block->FindByLabel("run_min_ms")) / summary.runMedianMilliseconds;
+		}
+
+		profileOut.blocks.push_back(summary);
+	}
+
+	parser.DestroyTree(root);
+	return true;
+}
+
+/**
+ * @brief Blocks sharing a name across source locations added up into one, in the order they first appear.
+ */
+static std::vector<ProfileBlockSummary> MergeBlocksByName(const std::vector<ProfileBlockSummary>& blocks)
+{
+	std::vector<ProfileBlockSummary> merged;
+	std::unordered_map<std::string, size_t> indices;
+	for (const ProfileBlockSummary& block : blocks) {
+		const auto [found, isNew] = indices.try_emplace(block.name, merged.size());
+		if (isNew) {
+			merged.push_back(block);
+			continue;
+		}
+
+		ProfileBlockSummary& mergedBlock = merged[found->second];
+		mergedBlock.processedByteCount += block.processedByteCount;
+		mergedBlock.inclusiveMilliseconds += block.inclusiveMilliseconds;
+		mergedBlock.runMedianMilliseconds += block.runMedianMilliseconds;
+		mergedBlock.runSpread = std::max(mergedBlock.runSpread, block.runSpread);
+	}
+
+	return merged;
+}
+
+static f64 GetGigabytesPerSecond(const ProfileBlockSummary& block)
+{
+	if (!block.processedByteCount || (block.inclusiveMilliseconds <= 0.0)) {
+		return 0.0;
+	}
+
+	return static_cast<f64>(block.processedByteCount) / (1024.0 * 1024.0 * 1024.0) / (block.inclusiveMilliseconds / 1000.0);
+}
+
+static void PrintMismatch(const char* label, const std::string& baseline, const std::string& current)
+{
+	if (baseline != current) {
+		printf("WARNING: %s differs, %s vs %s\n", label, baseline.c_str(), current.c_str());
+	}
+}
+
+s32 CompareProfiles(const char* baselineFileName, const char* currentFileName, const f64 threshold)
+{
+	ProfileSummary baseline;
+	ProfileSummary current;
+	if (!LoadProfile(baselineFileName, baseline) || !LoadProfile(currentFileName, current)) {
+		return -1;
+	}
+
+	printf("Comparing %s against baseline %s, threshold %.1f%%\n", currentFileName, baselineFileName, threshold * 100.0);
+	PrintMismatch("CPU", baseline.cpu, current.cpu);
+	PrintMismatch("build flags", baseline.buildFlags, current.buildFlags);
+	PrintMismatch("dataset", baseline.dataset, current.dataset);
+
+	const std::vector<ProfileBlockSummary> baselineBlocks = MergeBlocksByName(baseline.blocks);
+	const std::vector<ProfileBlockSummary> currentBlocks = MergeBlocksByName(current.blocks);
+	std::unordered_map<std::string, const ProfileBlockSummary*> baselineByName;
+	for (const ProfileBlockSummary& block : baselineBlocks) {
+		baselineByName[block.name] = &block;
+	}
+
+	s32 regressionCount = 0;
+	for (const ProfileBlockSummary& block : currentBlocks) {
+		const auto found = baselineByName.find(block.name);
+		if (found == baselineByName.end()) {
+			printf("  %s: new, %.4fms\n", block.name.c_str(), block.inclusiveMilliseconds);
+			continue;
+		}
+
+		const ProfileBlockSummary& base = *found->second;
+		baselineByName.erase(found);
+
+		// Profiles that both ran several times compare their median runs, the total would scale with the run count.
+		const bool hasRuns = (base.runMedianMilliseconds > 0.0) && (block.runMedianMilliseconds > 0.0);
+		const f64 baseTime = hasRuns ? base.runMedianMilliseconds : base.inclusiveMilliseconds;
+		const f64 time = hasRuns ? block.runMedianMilliseconds : block.inclusiveMilliseconds;
+
+		const f64 noise = std::max({ threshold, base.runSpread, block.runSpread });
+		const f64 timeChange = (baseTime > 0.0) ? time / baseTime - 1.0 : 0.0;
+		const bool isJudged = std::max(baseTime, time) >= MIN_COMPARED_MILLISECONDS;
+		bool isSlower = isJudged && (timeChange > noise);
+		const bool isFaster = isJudged && (timeChange < -noise);
+
+		printf("  %s: %.4fms -> %.4fms%s %+.1f%%", block.name.c_str(), baseTime, time, hasRuns ? " per run" : "", timeChange * 100.0);
+
+		const f64 baseBandwidth = GetGigabytesPerSecond(base);
+		const f64 bandwidth = GetGigabytesPerSecond(block);
+		if ((baseBandwidth > 0.0) && (bandwidth > 0.0)) {
+			const f64 bandwidthChange = bandwidth / baseBandwidth - 1.0;
+			printf(", %.2f -> %.2fgb/s %+.1f%%", baseBandwidth, bandwidth, bandwidthChange * 100.0);
+			isSlower |= isJudged && (bandwidthChange < -noise);
+		}
+
+		printf(" (noise %.1f%%)%s\n", noise * 100.0, isSlower ? " REGRESSED" : (isFaster ? " improved" : ""));
+		regressionCount += isSlower;
+	}
+
+	for (const ProfileBlockSummary& block : baselineBlocks) {
+		if (baselineByName.count(block.name)) {
+			printf("  %s: removed, was %.4fms\n", block.name.c_str(), block.inclusiveMilliseconds);
+		}
+	}
+
+	printf("%d block%s regressed\n", regressionCount, (regressionCount == 1) ? "" : "s");
+	return regressionCount;
+}
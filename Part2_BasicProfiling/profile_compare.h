@@ -0,0 +1,17 @@
+#pragma once
+
+#include "basedef.h"
+
+// Relative change a block may move by before it is flagged, when the profiles carry no larger run spread.
+const f64 DEFAULT_PROFILE_COMPARE_THRESHOLD = 0.05;
+
+/* NOTE(Umut): Reads two profiles written by Profiler::WriteProfileJson and matches their blocks by name. A
+   block regresses when its corrected inclusive time, per median run if both profiles repeated the workload,
+   grows or its bandwidth drops by more than the threshold or the run to run noise either profile recorded,
+   whichever is larger. Blocks under a few microseconds are listed but never flagged. */
+/**
+ * @brief Print the block by block comparison of current against baseline.
+ *
+ * @return Number of regressed blocks, -1 if either profile could not be read.
+ */
+s32 CompareProfiles(const char* baselineFileName, const char* currentFileName, const f64 threshold = DEFAULT_PROFILE_COMPARE_THRESHOLD);
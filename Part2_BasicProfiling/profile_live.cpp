@@ -0,0 +1,173 @@
+#include "profile_live.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include "mapped_file.h"
+
+// NOTE(Umut): Publishing takes microseconds, a torn copy is retried a few times before waiting for the next one.
+const u32 SNAPSHOT_READ_ATTEMPT_COUNT = 8;
+
+static u64 LoadAcquire(const u64& value)
+{
+	// The mapping is read-only, an aligned 64 bit atomic load still never writes.
+	return std::atomic_ref<u64>(const_cast<u64&>(value)).load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Copy of the last published snapshot, only the blocks in use.
+ *
+ * @return Epoch of the copy, 0 if nothing was published yet or the writer overwrote the slot while copying.
+ */
+static u64 ReadSnapshot(const ProfilerLiveFile& live, ProfilerLiveSnapshot& snapshotOut)
+{
+	const u64 epoch = LoadAcquire(live.header.publishedEpoch);
+	if (!epoch) {
+		return 0;
+	}
+
+	const ProfilerLiveSnapshot& slot = live.snapshots[epoch & 1];
+	memcpy(&snapshotOut, &slot, offsetof(ProfilerLiveSnapshot, blocks));
+	snapshotOut.blockCount = std::min(snapshotOut.blockCount, MAX_PROFILE_BLOCK_COUNT);
+	snapshotOut.threadCount = std::min(snapshotOut.threadCount, MAX_PROFILER_LIVE_THREAD_COUNT);
+	memcpy(snapshotOut.blocks, slot.blocks, snapshotOut.blockCount * sizeof(ProfilerLiveBlock));
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (LoadAcquire(live.header.writingEpoch) > epoch + 1) {
+		return 0;
+	}
+
+	for (u32 i = 0; i < snapshotOut.blockCount; ++i) {
+		snapshotOut.blocks[i].name[PROFILER_LIVE_NAME_SIZE - 1] = '\0';
+	}
+
+	return epoch;
+}
+
+static void PrintInterval(const ProfilerLiveSnapshot& previous, const ProfilerLiveSnapshot& current, const ProfilerLiveHeader& header)
+{
+	const f64 timerFrequency = static_cast<f64>(header.timerFrequency);
+	const f64 intervalTime = static_cast<f64>(current.time - previous.time);
+	const f64 intervalSeconds = intervalTime / timerFrequency;
+	printf("\n+%.1fs, last %.2fs:\n", static_cast<f64>(current.time - header.beginTime) / timerFrequency, intervalSeconds);
+
+	// NOTE(Umut): Times are summed over threads like in PrintBlocks, blocks running in parallel can pass 100%.
+	bool isIdle = true;
+	for (u32 i = 1; i < current.blockCount; ++i) {
+		const ProfilerLiveBlock& block = current.blocks[i];
+		const ProfilerLiveBlock empty = {};
+		const ProfilerLiveBlock& before = (i < previous.blockCount) ? previous.blocks[i] : empty;
+
+		const u64 hitCount = block.hitCount - before.hitCount;
+		const u64 elapsedTime = block.elapsedTimeInclusive - before.elapsedTimeInclusive;
+		const u64 byteCount = block.processedByteCount - before.processedByteCount;
+		if (!hitCount && !byteCount) {
+			continue;
+		}
+
+		isIdle = false;
+		printf("  %s[%llu]: %.1f hits/s, %.4fms (%.2f%%)", block.name, hitCount, static_cast<f64>(hitCount) / intervalSeconds,
+			   static_cast<f64>(elapsedTime) * 1000.0 / timerFrequency, 100.0 * static_cast<f64>(elapsedTime) / intervalTime);
+		if (byteCount && elapsedTime) {
+			const f64 gigabytes = static_cast<f64>(byteCount) / (1024.0 * 1024.0 * 1024.0);
+			printf(" %.3fmb at %.2fgb/s", gigabytes * 1024.0, gigabytes * timerFrequency / static_cast<f64>(elapsedTime));
+		}
+		printf("\n");
+	}
+
+	if (isIdle) {
+		printf("  no block closed\n");
+	}
+
+	for (u32 thread = 0; thread < current.threadCount; ++thread) {
+		const u32 openBlock = current.openBlocks[thread];
+		if (openBlock && (openBlock < current.blockCount)) {
+			printf("  thread %u in %s\n", thread, current.blocks[openBlock].name);
+		}
+	}
+}
+
+s32 WatchLiveProfile(const char* fileName, const u32 intervalMilliseconds)
+{
+	printf("Watching %s every %ums\n", fileName, intervalMilliseconds);
+
+	// NOTE(Umut): Snapshots are a few hundred kilobytes, too much for the stack.
+	std::unique_ptr<ProfilerLiveSnapshot> previous = std::make_unique<ProfilerLiveSnapshot>();
+	std::unique_ptr<ProfilerLiveSnapshot> current = std::make_unique<ProfilerLiveSnapshot>();
+	u64 previousEpoch = 0;
+	u64 attachedBeginTime = 0;
+	bool isWaiting = false;
+
+	MappedFile file = {};
+	for (;; std::this_thread::sleep_for(std::chrono::milliseconds(intervalMilliseconds))) {
+		if (!IsValid(file)) {
+			file = OpenSharedMapping(fileName);
+			if (IsValid(file) && (file.size < sizeof(ProfilerLiveFile))) {
+				UnmapFile(file);
+			}
+		}
+
+		const ProfilerLiveFile* live = IsValid(file) ? reinterpret_cast<const ProfilerLiveFile*>(file.data) : nullptr;
+		const bool isReady = live && (std::atomic_ref<u32>(const_cast<u32&>(live->header.magic)).load(std::memory_order_acquire) == PROFILER_LIVE_MAGIC);
+		if (!isReady) {
+			if (!isWaiting) {
+				printf("Waiting for a profiled process to publish...\n");
+				isWaiting = true;
+			}
+			continue;
+		}
+
+		if (live->header.version != PROFILER_LIVE_VERSION) {
+			fprintf(stderr, "ERROR: %s is version %u, expected %u\n", fileName, live->header.version, PROFILER_LIVE_VERSION);
+			UnmapFile(file);
+			return 1;
+		}
+
+		// A new process reuses the file, its totals start over.
+		if (live->header.beginTime != attachedBeginTime) {
+			attachedBeginTime = live->header.beginTime;
+			previousEpoch = 0;
+		}
+
+		u64 epoch = 0;
+		for (u32 attempt = 0; !epoch && (attempt < SNAPSHOT_READ_ATTEMPT_COUNT); ++attempt) {
+			epoch = ReadSnapshot(*live, *current);
+		}
+
+		if (!epoch || (epoch == previousEpoch)) {
+			continue;
+		}
+
+		if (previousEpoch) {
+			PrintInterval(*previous, *current, live->header);
+		}
+		// NOTE(Umut): Finding the last snapshot first means the file is left over from a process that already ended.
+		else if (current->isFinal) {
+			previousEpoch = epoch;
+			if (!isWaiting) {
+				printf("Waiting for a profiled process to publish...\n");
+				isWaiting = true;
+			}
+			continue;
+		}
+		else {
+			printf("Attached, timer frequency %llu\n", live->header.timerFrequency);
+			isWaiting = false;
+		}
+
+		std::swap(previous, current);
+		previousEpoch = epoch;
+
+		if (previous->isFinal) {
+			printf("\nProfiled process ended\n");
+			UnmapFile(file);
+			return 0;
+		}
+	}
+}
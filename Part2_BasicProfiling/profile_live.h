@@ -0,0 +1,74 @@
+#pragma once
+
+#include "basedef.h"
+#include "profiler.h"
+
+#ifndef PROFILER_LIVE_FILE_NAME
+#define PROFILER_LIVE_FILE_NAME "profile_live.bin"
+#endif
+
+#ifndef PROFILER_LIVE_INTERVAL_MS
+// Milliseconds between two snapshots the profiler publishes, and the default refresh of the viewer.
+#define PROFILER_LIVE_INTERVAL_MS 1000
+#endif
+
+/* NOTE(Umut): Layout of the file a PROFILER_LIVE build publishes its block totals to. It holds a header and two
+   snapshot slots. Publishing epoch N first marks N as being written, then fills slot N & 1 and then marks N
+   as published, so the slot of the last published epoch is stable until the writer starts on the epoch after
+   next. A reader copies the published slot and only keeps the copy if the writer did not get that far in the
+   meantime. Both sides only ever use plain loads and stores, the worker threads are never stopped. */
+const u32 PROFILER_LIVE_MAGIC = 0x564c5250; // "PRLV"
+const u32 PROFILER_LIVE_VERSION = 1;
+const u32 PROFILER_LIVE_NAME_SIZE = 64;
+// Threads past this still count in the block totals, only their open block is not shown.
+const u32 MAX_PROFILER_LIVE_THREAD_COUNT = 64;
+
+/* NOTE(Umut): Totals since the profiler began. Time and hits are only added when a block closes, bytes when it
+   opens, so a block that stays open across a snapshot shows up in the interval it closes in. */
+struct ProfilerLiveBlock
+{
+	char name[PROFILER_LIVE_NAME_SIZE];
+	u64 hitCount;
+	u64 elapsedTimeInclusive;
+	u64 processedByteCount;
+};
+
+struct ProfilerLiveSnapshot
+{
+	u64 time;
+	u32 blockCount;
+	u32 threadCount;
+	// Set on the last snapshot, published once the profiler ended.
+	u32 isFinal;
+	u32 padding;
+	// Innermost block every thread has open, 0 when it is outside of any block.
+	u32 openBlocks[MAX_PROFILER_LIVE_THREAD_COUNT];
+	ProfilerLiveBlock blocks[MAX_PROFILE_BLOCK_COUNT];
+};
+
+struct ProfilerLiveHeader
+{
+	// Cleared while a writer sets the file up and written last, a reader that finds it unset waits.
+	u32 magic;
+	u32 version;
+	u64 timerFrequency;
+	// Timer at Profiler::Begin, tells a restarted process apart from the one a reader attached to.
+	u64 beginTime;
+	u64 writingEpoch;
+	u64 publishedEpoch;
+};
+
+struct ProfilerLiveFile
+{
+	ProfilerLiveHeader header;
+	ProfilerLiveSnapshot snapshots[2];
+};
+
+/**
+ * @brief Attach to the file a PROFILER_LIVE build publishes to and print, every interval, what each block did
+ *        since the previous one: hits and hits per second, inclusive time and share of the interval, GB/s.
+ *        Waits for the file to show up and returns once the profiled process ends.
+ *
+ * @return 0 once the process ended, 1 if the file has a layout this build does not know.
+ */
+s32 WatchLiveProfile(const char* fileName = PROFILER_LIVE_FILE_NAME, const u32 intervalMilliseconds = PROFILER_LIVE_INTERVAL_MS);
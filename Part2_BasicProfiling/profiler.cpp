@@ -1,6 +1,42 @@
 #include "profiler.h"
+#include "bandwidth_peaks.h"
+#include "tsc_frequency.h"
 
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if PROFILER_SAMPLING
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <cxxabi.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+#if PROFILER_RUNTIME_TOGGLE && !_WIN32
+#include <signal.h>
+#endif
+
+#if PROFILER_LIVE
+#include <chrono>
+#include <condition_variable>
+#include <thread>
+#include "mapped_file.h"
+#include "profile_live.h"
+#endif
 
 inline f64 ToMegabyte(const u64 bytes)
 {
@@ -12,52 +48,983 @@ inline f64 ToGigabyte(const u64 bytes)
 	return static_cast<f64>(bytes) / (1024.0 * 1024.0 * 1024.0);
 }
 
+// NOTE(Umut): Only touched when a block or a thread shows up for the first time, never on the hot path.
+static std::atomic<u32> blockCount = 0;
+
+static std::mutex threadStatesMutex;
+static std::vector<std::unique_ptr<ProfilerThreadState>> threadStates;
+
+// Bit i of a group mask is registeredGroupNames[i].
+static const char* registeredGroupNames[MAX_PROFILE_GROUP_COUNT] = {};
+static std::atomic<u32> groupCount = 0;
+
+#if PROFILER_SAMPLING
+static std::atomic<bool> isSampling = false;
+#endif
+
+u32 Profiler::RegisterBlock()
+{
+	// Index 0 is the root every top level block reports its time to.
+	const u32 index = ++blockCount;
+	if (index < PROFILE_BLOCK_OVERFLOW) {
+		return index;
+	}
+
+	// NOTE(Umut): Runs before main, so this is the only place to say it. The profile keeps working with the
+	// extra blocks merged into one entry.
+	if (index == PROFILE_BLOCK_OVERFLOW) {
+		fprintf(stderr, "Profiler: more than %u profile blocks, the rest are merged into one entry. Raise MAX_PROFILE_BLOCK_COUNT.\n",
+				PROFILE_BLOCK_OVERFLOW - 1);
+	}
+
+	return PROFILE_BLOCK_OVERFLOW;
+}
+
+static u64 FindGroup(const char* groupName)
+{
+	const u32 count = std::min(groupCount.load(), MAX_PROFILE_GROUP_COUNT);
+	for (u32 i = 0; i < count; ++i) {
+		if (!strcmp(registeredGroupNames[i], groupName)) {
+			return 1ull << i;
+		}
+	}
+
+	return 0;
+}
+
+u64 Profiler::RegisterGroup(const char* groupName)
+{
+	// NOTE(Umut): Called before main for every block like RegisterBlock, the blocks of a group after its first find its bit.
+	if (const u64 groupMask = FindGroup(groupName)) {
+		return groupMask;
+	}
+
+	const u32 index = groupCount++;
+	if (index < MAX_PROFILE_GROUP_COUNT) {
+		registeredGroupNames[index] = groupName;
+		return 1ull << index;
+	}
+
+	if (index == MAX_PROFILE_GROUP_COUNT) {
+		fprintf(stderr, "Profiler: more than %u block groups, the rest share the last one's switch.\n", MAX_PROFILE_GROUP_COUNT);
+	}
+
+	return 1ull << (MAX_PROFILE_GROUP_COUNT - 1);
+}
+
+void Profiler::EnableGroups(const char* groupNames)
+{
+#if PROFILER_RUNTIME_TOGGLE
+	u64 groupMask = 0;
+	const std::string names = groupNames;
+	for (size_t start = 0; start <= names.size();) {
+		const size_t end = std::min(names.find(',', start), names.size());
+		std::string name = names.substr(start, end - start);
+		name.erase(0, name.find_first_not_of(' '));
+		name.erase(name.find_last_not_of(' ') + 1);
+		start = end + 1;
+
+		if (name == "all") {
+			groupMask = ~0ull;
+		}
+		else if (!name.empty() && (name != "none")) {
+			const u64 group = FindGroup(name.c_str());
+			if (!group) {
+				fprintf(stderr, "Profiler: no block group named %s\n", name.c_str());
+			}
+			groupMask |= group;
+		}
+	}
+
+	enabledGroups = groupMask;
+	toggledGroups = groupMask ? groupMask : ~0ull;
+#else
+	(void)groupNames;
+#endif
+}
+
+void Profiler::StartGroupToggleSignal()
+{
+#if PROFILER_RUNTIME_TOGGLE && !_WIN32
+	struct sigaction action = {};
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	action.sa_handler = [](int) {
+		const u64 groupMask = enabledGroups.load(std::memory_order_relaxed) ? 0 : toggledGroups.load(std::memory_order_relaxed);
+		enabledGroups.store(groupMask, std::memory_order_relaxed);
+	};
+	sigaction(SIGUSR1, &action, nullptr);
+#endif
+}
+
+static u32 GetLastBlockIndex()
+{
+	const u32 count = blockCount;
+	return (count < PROFILE_BLOCK_OVERFLOW) ? count : PROFILE_BLOCK_OVERFLOW;
+}
+
+/**
+ * @brief Name of a block from the first thread that opened it. threadStatesMutex has to be held.
+ */
+static const char* GetBlockName(const u32 index)
+{
+	if (index == PROFILE_BLOCK_OVERFLOW) {
+		return "[block table full]";
+	}
+
+	for (const std::unique_ptr<ProfilerThreadState>& state : threadStates) {
+		const char* name = LoadLiveField(state->blocks[index].name);
+		if (name) {
+			return name;
+		}
+	}
+
+	return "[unnamed]";
+}
+
+/**
+ * @brief A block's entries from every thread added up. threadStatesMutex has to be held.
+ */
+static ProfilerBlockInfo MergeThreadBlocks(const u32 index)
+{
+	ProfilerBlockInfo merged = {};
+	merged.name = GetBlockName(index);
+#if PROFILER_OS_COUNTERS
+	u32 hitThreadCount = 0;
+	u64 residentBytes = 0;
+#endif
+	for (const std::unique_ptr<ProfilerThreadState>& state : threadStates) {
+		const ProfilerBlockInfo& info = state->blocks[index];
+		merged.elapsedTimeExclusive += info.elapsedTimeExclusive;
+		merged.elapsedTimeInclusive += info.elapsedTimeInclusive;
+		merged.hitCount += info.hitCount;
+		merged.processedByteCount += info.processedByteCount;
+		merged.readByteCount += info.readByteCount;
+		merged.writeByteCount += info.writeByteCount;
+		merged.flopCount += info.flopCount;
+		merged.childHitCount += info.childHitCount;
+		merged.inclusiveHitCount += info.inclusiveHitCount;
+		merged.inclusiveDescendantHitCount += info.inclusiveDescendantHitCount;
+#if PROFILER_PERF_COUNTERS
+		for (u32 counter = 0; counter < PERF_COUNTER_COUNT; ++counter) {
+			merged.perfCountsInclusive[counter] += info.perfCountsInclusive[counter];
+		}
+#endif
+#if PROFILER_OS_COUNTERS
+		for (u32 counter = 0; counter < OS_COUNTER_COUNT; ++counter) {
+			merged.osCountsInclusive[counter] += info.osCountsInclusive[counter];
+		}
+		if (info.hitCount) {
+			++hitThreadCount;
+			residentBytes = info.osCountsInclusive[OS_COUNTER_RESIDENT_BYTES];
+		}
+#endif
+#if PROFILER_HISTOGRAMS
+		merged.maxHitTime = std::max(merged.maxHitTime, info.maxHitTime);
+		merged.invertedMinHitTime = std::max(merged.invertedMinHitTime, info.invertedMinHitTime);
+		for (u32 bucket = 0; bucket < PROFILE_HISTOGRAM_BUCKET_COUNT; ++bucket) {
+			merged.hitHistogram[bucket] += info.hitHistogram[bucket];
+		}
+#endif
+	}
+
+#if PROFILER_OS_COUNTERS
+	// NOTE(Umut): The resident set is process wide, every thread running the block saw the same change, adding them
+	// up counts it once per thread. It is only kept for a block hit on one thread, the per thread rows show the rest.
+	merged.osCountsInclusive[OS_COUNTER_RESIDENT_BYTES] = (hitThreadCount == 1) ? residentBytes : 0;
+#endif
+
+	return merged;
+}
+
+ProfilerThreadState* Profiler::RegisterThread()
+{
+	std::lock_guard<std::mutex> lock(threadStatesMutex);
+
+	threadStates.push_back(std::make_unique<ProfilerThreadState>());
+	ProfilerThreadState* state = threadStates.back().get();
+	state->threadIndex = static_cast<u32>(threadStates.size() - 1);
+#if PROFILER_PERF_COUNTERS
+	// NOTE(Umut): perf events count the thread that opened them, so every thread opens its own group here.
+	state->perfCounters.Open();
+#endif
+#if PROFILER_SAMPLING
+	if (isSampling) {
+		StartThreadSampling(*state);
+	}
+#endif
+	return state;
+}
+
+/* NOTE(Umut): Timer ticks a block costs that end up in the profile. Inside is the part of opening and
+   closing a block that falls between its own two timer reads, outside is the rest, which lands in the
+   parent's exclusive time. Both are measured at Begin() on empty blocks. */
+struct ProfilerOverhead
+{
+	f64 inside;
+	f64 outside;
+};
+
+static ProfilerOverhead overhead = {};
+
+#if PROFILER_PERF_COUNTERS
+// Set by PrintBlocks from the first thread's group, every thread opens the same counters.
+static bool perfCounterAvailable[PERF_COUNTER_COUNT] = {};
+#endif
+
 #if PROFILER
-u32 Profiler::GetNewIndex()
+
+// NOTE(Umut): Rounds of nested empty blocks, the cheapest round is kept so interrupts and cold caches drop out.
+const u32 CALIBRATION_ROUND_COUNT = 16;
+const u32 CALIBRATION_HIT_COUNT = 1024;
+
+static const char* CALIBRATION_OUTER_NAME = "ProfilerCalibrationOuter";
+static const char* CALIBRATION_INNER_NAME = "ProfilerCalibrationInner";
+
+static f64 CorrectOverhead(const u64 elapsedTime, const u64 insideCount, const u64 outsideCount)
+{
+	const f64 corrected = static_cast<f64>(elapsedTime) - static_cast<f64>(insideCount) * overhead.inside
+		- static_cast<f64>(outsideCount) * overhead.outside;
+	return (corrected > 0.0) ? corrected : 0.0;
+}
+
+static f64 GetCorrectedExclusive(const ProfilerBlockInfo& info)
+{
+	return CorrectOverhead(info.elapsedTimeExclusive, info.hitCount, info.childHitCount);
+}
+
+static f64 GetCorrectedInclusive(const ProfilerBlockInfo& info)
+{
+	// Every descendant hit costs both parts, the block itself only the inside.
+	return CorrectOverhead(info.elapsedTimeInclusive, info.inclusiveHitCount + info.inclusiveDescendantHitCount,
+						   info.inclusiveDescendantHitCount);
+}
+
+#if PROFILER_PERF_COUNTERS
+static void PrintPerfCounts(const ProfilerBlockInfo& info)
+{
+	const u64* counts = info.perfCountsInclusive;
+	if (!perfCounterAvailable[PERF_COUNTER_CYCLES] || !counts[PERF_COUNTER_CYCLES]) {
+		return;
+	}
+
+	const bool hasInstructions = perfCounterAvailable[PERF_COUNTER_INSTRUCTIONS] && counts[PERF_COUNTER_INSTRUCTIONS];
+	if (hasInstructions) {
+		printf(" ipc %.2f", static_cast<f64>(counts[PERF_COUNTER_INSTRUCTIONS]) / static_cast<f64>(counts[PERF_COUNTER_CYCLES]));
+	}
+
+	// NOTE(Umut): Misses per KB the block processed, per thousand instructions for blocks without a byte count.
+	if (!info.processedByteCount && !hasInstructions) {
+		return;
+	}
+
+	const f64 scale = info.processedByteCount ? 1024.0 / static_cast<f64>(info.processedByteCount)
+											  : 1000.0 / static_cast<f64>(counts[PERF_COUNTER_INSTRUCTIONS]);
+	const char* unit = info.processedByteCount ? "/kb" : "/kinst";
+	for (u32 i = PERF_COUNTER_LLC_MISSES; i < PERF_COUNTER_COUNT; ++i) {
+		if (perfCounterAvailable[i]) {
+			printf(" %s %.3f%s", GetPerfCounterName(i), static_cast<f64>(counts[i]) * scale, unit);
+		}
+	}
+}
+#endif
+
+#if PROFILER_OS_COUNTERS
+static void PrintOsCounts(const ProfilerBlockInfo& info)
+{
+	const u64* counts = info.osCountsInclusive;
+	const u64 faultCount = counts[OS_COUNTER_MINOR_FAULTS] + counts[OS_COUNTER_MAJOR_FAULTS];
+	if (faultCount) {
+		printf(" faults %llu (%llu major", faultCount, counts[OS_COUNTER_MAJOR_FAULTS]);
+		if (info.processedByteCount) {
+			printf(", %.3f/kb", static_cast<f64>(faultCount) * 1024.0 / static_cast<f64>(info.processedByteCount));
+		}
+		printf(")");
+	}
+
+	if (counts[OS_COUNTER_VOLUNTARY_SWITCHES] || counts[OS_COUNTER_INVOLUNTARY_SWITCHES]) {
+		printf(" switches %llu+%llu", counts[OS_COUNTER_VOLUNTARY_SWITCHES], counts[OS_COUNTER_INVOLUNTARY_SWITCHES]);
+	}
+
+	const s64 residentBytes = static_cast<s64>(counts[OS_COUNTER_RESIDENT_BYTES]);
+	if (residentBytes) {
+		printf(" rss %+.3fmb", static_cast<f64>(residentBytes) / (1024.0 * 1024.0));
+	}
+}
+#endif
+
+#if PROFILER_HISTOGRAMS
+/**
+ * @brief Duration under which the given fraction of the hits fall, the middle of the bucket it lands in.
+ */
+static u64 GetHitTimePercentile(const ProfilerBlockInfo& info, const f64 fraction)
+{
+	const u64 minHitTime = ~info.invertedMinHitTime;
+	const u64 targetCount = static_cast<u64>(ceil(fraction * static_cast<f64>(info.hitCount)));
+	u64 count = 0;
+	for (u32 bucket = 0; bucket < PROFILE_HISTOGRAM_BUCKET_COUNT; ++bucket) {
+		count += info.hitHistogram[bucket];
+		if (!info.hitHistogram[bucket] || (count < targetCount)) {
+			continue;
+		}
+
+		const u64 start = GetHistogramBucketStart(bucket);
+		const u64 end = (bucket + 1 < PROFILE_HISTOGRAM_BUCKET_COUNT) ? GetHistogramBucketStart(bucket + 1) : info.maxHitTime + 1;
+		return std::clamp(start + (end - start - 1) / 2, minHitTime, info.maxHitTime);
+	}
+
+	return info.maxHitTime;
+}
+
+static void PrintHitDistribution(const ProfilerBlockInfo& info)
+{
+	printf("      per hit: min %llu p50 %llu p90 %llu p99 %llu max %llu\n", ~info.invertedMinHitTime,
+		   GetHitTimePercentile(info, 0.5), GetHitTimePercentile(info, 0.9), GetHitTimePercentile(info, 0.99),
+		   info.maxHitTime);
+
+	// Hits per power of two of ticks, each entry is where its range starts.
+	const u32 subBucketCount = 1u << PROFILE_HISTOGRAM_SUB_BUCKET_BITS;
+	u64 rangeCount = 0;
+	printf("      hits by ticks:");
+	for (u32 bucket = 0; bucket < PROFILE_HISTOGRAM_BUCKET_COUNT; ++bucket) {
+		rangeCount += info.hitHistogram[bucket];
+		const bool isRangeEnd = ((bucket + 1) % subBucketCount == 0) || (bucket + 1 == PROFILE_HISTOGRAM_BUCKET_COUNT);
+		if (isRangeEnd && rangeCount) {
+			printf(" %llu+:%llu", GetHistogramBucketStart(bucket & ~(subBucketCount - 1)), rangeCount);
+			rangeCount = 0;
+		}
+	}
+	printf("\n");
+}
+#endif
+
+/* NOTE(Umut): A block is held against the level its bytes per hit fit in, and against the peak of the kind
+   of traffic it declared: reads, writes, or copy when it does both. A plain byte count is taken as reads. */
+struct ProfilerRoofline
+{
+	MemoryLevel level;
+	const char* peakKind;
+	f64 peakBytesPerSecond;
+};
+
+static ProfilerRoofline GetRoofline(const ProfilerBlockInfo& info)
+{
+	const BandwidthPeaks& peaks = GetBandwidthPeaks();
+	const MemoryLevel level = GetMemoryLevel(peaks, info.processedByteCount / info.hitCount);
+	if (info.readByteCount && info.writeByteCount) {
+		return { level, "copy", peaks.copyBytesPerSecond[level] };
+	}
+
+	if (info.writeByteCount) {
+		return { level, "write", peaks.writeBytesPerSecond[level] };
+	}
+
+	return { level, "read", peaks.readBytesPerSecond[level] };
+}
+
+static void PrintRoofline(const ProfilerBlockInfo& info, const f64 durationSec)
 {
-	return ++indexCounter;
+	const ProfilerRoofline roofline = GetRoofline(info);
+	if (roofline.peakBytesPerSecond > 0.0) {
+		const f64 bytesPerSecond = static_cast<f64>(info.processedByteCount) / durationSec;
+		printf(" %.0f%% of %s %s peak", 100.0 * bytesPerSecond / roofline.peakBytesPerSecond, GetMemoryLevelName(roofline.level),
+			   roofline.peakKind);
+	}
+
+	if (info.flopCount) {
+		printf(" %.3f flop/byte at %.2f gflop/s", static_cast<f64>(info.flopCount) / static_cast<f64>(info.processedByteCount),
+			   static_cast<f64>(info.flopCount) / durationSec / 1e9);
+	}
 }
 
-void PrintBlockInfo(const ProfilerBlockInfo& info, const u64 totalCpuElapsed, const u64 cpuFreq)
+static void PrintBandwidthPeaks()
 {
+	const BandwidthPeaks& peaks = GetBandwidthPeaks();
+	const f64 toGigabytes = 1.0 / (1024.0 * 1024.0 * 1024.0);
+	printf("Bandwidth peaks (read/write/copy gb/s):");
+	for (u32 level = 0; level < MEMORY_LEVEL_COUNT; ++level) {
+		printf(" %s %.1f/%.1f/%.1f", GetMemoryLevelName(level), peaks.readBytesPerSecond[level] * toGigabytes,
+			   peaks.writeBytesPerSecond[level] * toGigabytes, peaks.copyBytesPerSecond[level] * toGigabytes);
+	}
+	printf("\n");
+}
+
+// NOTE(Umut): name replaces info.name when given, the per thread rows print under the thread's name.
+void PrintBlockInfo(const ProfilerBlockInfo& info, const u64 totalCpuElapsed, const u64 cpuFreq, const char* indent = "  ",
+					const char* name = nullptr)
+{
+	const bool hasChildren = info.elapsedTimeInclusive != info.elapsedTimeExclusive;
 	const f64 percentageExclusive = 100.0 * static_cast<f64>(info.elapsedTimeExclusive) / static_cast<f64>(totalCpuElapsed);
-	printf("  %s[%llu]: %llu (%.2f%%", info.name, info.hitCount, info.elapsedTimeExclusive, percentageExclusive);
+	printf("%s%s[%llu]: %llu (%.2f%%", indent, name ? name : info.name, info.hitCount, info.elapsedTimeExclusive, percentageExclusive);
 
-	if (info.elapsedTimeInclusive != info.elapsedTimeExclusive) {
+	if (hasChildren) {
 		const f64 percentageInclusive = 100.0 * static_cast<f64>(info.elapsedTimeInclusive) / static_cast<f64>(totalCpuElapsed);
 		printf(", %.2f%% w/children", percentageInclusive);
 	}
 
+	const f64 correctedExclusive = GetCorrectedExclusive(info);
+	const f64 correctedInclusive = GetCorrectedInclusive(info);
+	printf(") corrected %.0f (%.2f%%", correctedExclusive, 100.0 * correctedExclusive / static_cast<f64>(totalCpuElapsed));
+
+	if (hasChildren) {
+		printf(", %.2f%% w/children", 100.0 * correctedInclusive / static_cast<f64>(totalCpuElapsed));
+	}
+
 	printf(")");
 
-	if (info.processedByteCount) {
-		const f64 durationSec = static_cast<f64>(info.elapsedTimeInclusive) / static_cast<f64>(cpuFreq);
+#if PROFILER_PERF_COUNTERS
+	PrintPerfCounts(info);
+#endif
+
+	if (info.processedByteCount && (correctedInclusive > 0.0)) {
+		const f64 durationSec = correctedInclusive / static_cast<f64>(cpuFreq);
 		const f64 gigabytesPerSec = ToGigabyte(info.processedByteCount) / durationSec;
 		const f64 processedMegabytes = ToMegabyte(info.processedByteCount);
-		printf("  %.3fmb at %.2fgb/s ", processedMegabytes, gigabytesPerSec);
+		printf("  %.3fmb at %.2fgb/s", processedMegabytes, gigabytesPerSec);
+		PrintRoofline(info, durationSec);
+		printf(" ");
 	}
 
+#if PROFILER_OS_COUNTERS
+	PrintOsCounts(info);
+#endif
+
 	printf("\n");
 }
 
+struct CallTreeNode
+{
+	u32 blockIndex = 0;
+	u32 parent = 0;
+	u64 elapsedTimeExclusive = 0;
+	u64 elapsedTimeInclusive = 0;
+	u64 hitCount = 0;
+	u64 childHitCount = 0;
+	u64 subtreeHitCount = 0;
+	std::vector<u32> children;
+};
+
+/**
+ * @brief Merge the path tables of every thread into one tree, node 0 being the root and every node coming after its
+ *        parent. Children are sorted by inclusive time. threadStatesMutex has to be held.
+ */
+static std::vector<CallTreeNode> BuildCallTree()
+{
+	std::vector<CallTreeNode> nodes(1);
+	std::unordered_map<u64, u32> nodeLookup;
+	std::vector<u32> mergedPaths;
+	for (const std::unique_ptr<ProfilerThreadState>& state : threadStates) {
+		mergedPaths.assign(state->pathCount, 0);
+		for (u32 i = 1; i < state->pathCount; ++i) {
+			const ProfilerPathInfo& path = state->paths[i];
+			const u32 parent = mergedPaths[path.parentPath];
+			const u64 key = (static_cast<u64>(parent) << 32) | path.blockIndex;
+
+			const auto [entry, isNew] = nodeLookup.try_emplace(key, static_cast<u32>(nodes.size()));
+			if (isNew) {
+				CallTreeNode child;
+				child.blockIndex = path.blockIndex;
+				child.parent = parent;
+				nodes.push_back(std::move(child));
+				nodes[parent].children.push_back(entry->second);
+			}
+
+			CallTreeNode& node = nodes[entry->second];
+			node.elapsedTimeExclusive += path.elapsedTimeExclusive;
+			node.hitCount += path.hitCount;
+			mergedPaths[i] = entry->second;
+		}
+	}
+
+	for (size_t i = nodes.size() - 1; i > 0; --i) {
+		CallTreeNode& node = nodes[i];
+		node.elapsedTimeInclusive += node.elapsedTimeExclusive;
+		node.subtreeHitCount += node.hitCount;
+
+		CallTreeNode& parent = nodes[node.parent];
+		parent.elapsedTimeInclusive += node.elapsedTimeInclusive;
+		parent.subtreeHitCount += node.subtreeHitCount;
+		parent.childHitCount += node.hitCount;
+	}
+
+	for (CallTreeNode& node : nodes) {
+		std::sort(node.children.begin(), node.children.end(), [&nodes](const u32 a, const u32 b) {
+			return nodes[a].elapsedTimeInclusive > nodes[b].elapsedTimeInclusive;
+		});
+	}
+
+	return nodes;
+}
+
+static const char* GetCallTreeNodeName(const CallTreeNode& node)
+{
+	return node.blockIndex ? GetBlockName(node.blockIndex) : "[path table full]";
+}
+
+static void PrintCallTreeNode(const std::vector<CallTreeNode>& nodes, const u32 index, const u32 depth, const u64 totalCpuElapsed)
+{
+	const CallTreeNode& node = nodes[index];
+	if (!node.hitCount) {
+		return;
+	}
+
+	const f64 total = static_cast<f64>(totalCpuElapsed);
+	const f64 correctedExclusive = CorrectOverhead(node.elapsedTimeExclusive, node.hitCount, node.childHitCount);
+	const f64 correctedInclusive = CorrectOverhead(node.elapsedTimeInclusive, node.subtreeHitCount, node.subtreeHitCount - node.hitCount);
+	printf("%*s%s[%llu]: %llu (%.2f%%, %.2f%% self) corrected %.0f (%.2f%%, %.2f%% self)\n", 2 * (depth + 1), "",
+		   GetCallTreeNodeName(node), node.hitCount, node.elapsedTimeInclusive, 100.0 * static_cast<f64>(node.elapsedTimeInclusive) / total,
+		   100.0 * static_cast<f64>(node.elapsedTimeExclusive) / total, correctedInclusive, 100.0 * correctedInclusive / total,
+		   100.0 * correctedExclusive / total);
+
+	for (const u32 child : node.children) {
+		PrintCallTreeNode(nodes, child, depth + 1, totalCpuElapsed);
+	}
+}
+
+static void WriteCollapsedStack(FILE* file, const std::vector<CallTreeNode>& nodes, const u32 index, std::string& stack)
+{
+	const CallTreeNode& node = nodes[index];
+	const size_t stackLength = stack.size();
+	if (index) {
+		stack += stackLength ? ";" : "";
+		stack += GetCallTreeNodeName(node);
+
+		const u64 ticks = llround(CorrectOverhead(node.elapsedTimeExclusive, node.hitCount, node.childHitCount));
+		if (ticks) {
+			fprintf(file, "%s %llu\n", stack.c_str(), ticks);
+		}
+	}
+
+	for (const u32 child : node.children) {
+		WriteCollapsedStack(file, nodes, child, stack);
+	}
+
+	stack.resize(stackLength);
+}
+
+void Profiler::CalibrateOverhead()
+{
+	// NOTE(Umut): Runs on a scratch table so none of the calibration hits show up in the real profile.
+	std::unique_ptr<ProfilerThreadState> calibrationState = std::make_unique<ProfilerThreadState>();
+#if PROFILER_PERF_COUNTERS
+	calibrationState->perfCounters.Open();
+#endif
+	ProfilerThreadState* profiledState = threadState;
+	threadState = calibrationState.get();
+	// The calibration blocks are in the default group, which may be off already.
+	const u64 profiledGroups = enabledGroups.exchange(~0ull);
+
+	f64 minInside = INFINITY;
+	f64 minOutside = INFINITY;
+	for (u32 round = 0; round < CALIBRATION_ROUND_COUNT; ++round) {
+		// Only the registered entries, the rest were never touched and clearing the whole table dominates the round.
+		for (u32 i = 0; i <= GetLastBlockIndex(); ++i) {
+			calibrationState->blocks[i] = {};
+		}
+
+		for (u32 i = 0; i < CALIBRATION_HIT_COUNT; ++i) {
+			PROFILE_BLOCK(CALIBRATION_OUTER_NAME);
+			PROFILE_BLOCK(CALIBRATION_INNER_NAME);
+		}
+
+		const ProfilerBlockInfo* outer = nullptr;
+		const ProfilerBlockInfo* inner = nullptr;
+		for (u32 i = 1; i <= GetLastBlockIndex(); ++i) {
+			const ProfilerBlockInfo& block = calibrationState->blocks[i];
+			outer = (block.name == CALIBRATION_OUTER_NAME) ? &block : outer;
+			inner = (block.name == CALIBRATION_INNER_NAME) ? &block : inner;
+		}
+
+		// NOTE(Umut): With a full block table both can land in the shared overflow entry, nothing to measure then.
+		if (!outer || !inner) {
+			break;
+		}
+
+		// Inner is an empty block, outer is an empty block with exactly one child.
+		const f64 inside = static_cast<f64>(inner->elapsedTimeExclusive) / CALIBRATION_HIT_COUNT;
+		const f64 outside = static_cast<f64>(outer->elapsedTimeExclusive) / CALIBRATION_HIT_COUNT - inside;
+		minInside = (inside < minInside) ? inside : minInside;
+		minOutside = (outside < minOutside) ? outside : minOutside;
+	}
+
+	threadState = profiledState;
+	enabledGroups = profiledGroups;
+	overhead.inside = (minInside < INFINITY) ? minInside : 0.0;
+	overhead.outside = ((minOutside > 0.0) && (minOutside < INFINITY)) ? minOutside : 0.0;
+}
+
 #else
 #define PrintBlockInfo(...)
+#define PrintHitDistribution(...)
+#define PrintBandwidthPeaks(...)
+#define PrintCallTreeNode(...)
+
+void Profiler::CalibrateOverhead()
+{
+}
 #endif
 
 u64 Profiler::beginCpuTime;
 u64 Profiler::endCpuTime;
-u32 Profiler::indexCounter;
-u32 Profiler::parentBlockIndex;
-ProfilerBlockInfo Profiler::blocks[4096];
+
+/* NOTE(Umut): One entry per Profiler::Repeat run, the run's own length and every block's inclusive time during
+   it, summed over threads and indexed like the block table. Taken from the running totals between runs, so
+   the hot path does not know about runs at all. */
+struct ProfilerRun
+{
+	u64 elapsedTime;
+	std::vector<u64> blockTimes;
+};
+
+static std::vector<ProfilerRun> runs;
+static std::vector<u64> lastRunBlockTotals;
+
+void Profiler::EndRun(const u64 runBeginTime)
+{
+	const u64 runEndTime = ProfilerTimer::Read();
+
+	std::lock_guard<std::mutex> lock(threadStatesMutex);
+	const u32 registeredBlockCount = GetLastBlockIndex();
+	std::vector<u64> blockTotals(registeredBlockCount + 1);
+	for (const std::unique_ptr<ProfilerThreadState>& state : threadStates) {
+		for (u32 i = 1; i <= registeredBlockCount; ++i) {
+			blockTotals[i] += state->blocks[i].elapsedTimeInclusive;
+		}
+	}
+
+	ProfilerRun run = { runEndTime - runBeginTime, std::vector<u64>(registeredBlockCount + 1) };
+	for (u32 i = 1; i <= registeredBlockCount; ++i) {
+		run.blockTimes[i] = blockTotals[i] - ((i < lastRunBlockTotals.size()) ? lastRunBlockTotals[i] : 0);
+	}
+
+	runs.push_back(std::move(run));
+	lastRunBlockTotals = std::move(blockTotals);
+}
+
+struct ProfilerRunSpread
+{
+	u64 min;
+	f64 median;
+	u64 max;
+};
+
+static ProfilerRunSpread GetRunSpread(std::vector<u64> times)
+{
+	if (times.empty()) {
+		return {};
+	}
+
+	std::sort(times.begin(), times.end());
+	const size_t count = times.size();
+	return { times.front(), 0.5 * static_cast<f64>(times[(count - 1) / 2] + times[count / 2]), times.back() };
+}
+
+static std::vector<u64> GetBlockRunTimes(const u32 blockIndex)
+{
+	std::vector<u64> blockTimes;
+	for (const ProfilerRun& run : runs) {
+		blockTimes.push_back((blockIndex < run.blockTimes.size()) ? run.blockTimes[blockIndex] : 0);
+	}
+
+	return blockTimes;
+}
+
+static void PrintRunSpread(const char* label, const ProfilerRunSpread& spread, const u64 cpuFreq)
+{
+	const f64 toMilliseconds = 1000.0 / static_cast<f64>(cpuFreq);
+	printf("%s: min %.4fms median %.4fms max %.4fms", label, static_cast<f64>(spread.min) * toMilliseconds,
+		   spread.median * toMilliseconds, static_cast<f64>(spread.max) * toMilliseconds);
+	if (spread.median > 0.0) {
+		printf(" (spread %.1f%%)", 100.0 * static_cast<f64>(spread.max - spread.min) / spread.median);
+	}
+	printf("\n");
+}
+
+#if PROFILER_SAMPLING
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+// Symbols listed per block in the sample report.
+const u32 MAX_PRINTED_SYMBOL_COUNT = 8;
+
+void Profiler::StartThreadSampling(ProfilerThreadState& state)
+{
+	// NOTE(Umut): Thread CPU time, so blocked threads aren't sampled and the signal always lands on the thread it measures.
+	sigevent event = {};
+	event.sigev_notify = SIGEV_THREAD_ID;
+	event.sigev_signo = SIGPROF;
+	event.sigev_notify_thread_id = static_cast<pid_t>(syscall(SYS_gettid));
+	if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &state.sampleTimer)) {
+		return;
+	}
+
+	const u64 intervalNs = 1000000000ull / PROFILER_SAMPLE_FREQUENCY;
+	itimerspec interval = {};
+	interval.it_interval.tv_sec = static_cast<time_t>(intervalNs / 1000000000ull);
+	interval.it_interval.tv_nsec = static_cast<long>(intervalNs % 1000000000ull);
+	interval.it_value = interval.it_interval;
+	timer_settime(state.sampleTimer, 0, &interval, nullptr);
+	state.hasSampleTimer = true;
+}
+
+void Profiler::StartSampling()
+{
+	struct sigaction action = {};
+	action.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	action.sa_sigaction = [](int, siginfo_t*, void* context) {
+		ProfilerThreadState* state = threadState;
+		if (!state) {
+			return;
+		}
+
+		// Counts past the buffer are kept so the report can say how many were dropped.
+		if (state->sampleCount < MAX_PROFILER_SAMPLE_COUNT) {
+			const ucontext_t* userContext = static_cast<const ucontext_t*>(context);
+			state->samples[state->sampleCount] = { static_cast<u64>(userContext->uc_mcontext.gregs[REG_RIP]), state->parentBlockIndex };
+		}
+		++state->sampleCount;
+	};
+	sigaction(SIGPROF, &action, nullptr);
+
+	isSampling = true;
+	StartThreadSampling(GetThreadState());
+}
+
+void Profiler::StopSampling()
+{
+	isSampling = false;
+
+	std::lock_guard<std::mutex> lock(threadStatesMutex);
+	for (const std::unique_ptr<ProfilerThreadState>& state : threadStates) {
+		if (state->hasSampleTimer) {
+			timer_delete(state->sampleTimer);
+			state->hasSampleTimer = false;
+		}
+	}
+}
+
+static std::string ResolveSymbol(const u64 instructionPointer)
+{
+	char buffer[64];
+	Dl_info info = {};
+	if (!dladdr(reinterpret_cast<void*>(instructionPointer), &info) || !info.dli_fname) {
+		snprintf(buffer, sizeof(buffer), "0x%llx", instructionPointer);
+		return buffer;
+	}
+
+	const char* separator = strrchr(info.dli_fname, '/');
+	const char* moduleName = separator ? separator + 1 : info.dli_fname;
+	if (info.dli_sname) {
+		s32 status = 0;
+		char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+		std::string result = std::string(demangled ? demangled : info.dli_sname) + " (" + moduleName + ")";
+		free(demangled);
+		return result;
+	}
+
+	// NOTE(Umut): Internal functions have no dynamic symbol, they are grouped per module so a hot library still
+	// adds up to one line. The executable only exports its own symbols when linked with -rdynamic.
+	return std::string("[internal] (") + moduleName + ")";
+}
+
+/**
+ * @brief Hottest symbols under each block, by samples whose innermost open block it was. threadStatesMutex has to be held.
+ */
+static void PrintSamples()
+{
+	std::unordered_map<u64, u32> instructionSymbols;
+	std::unordered_map<std::string, u32> symbolIndices;
+	std::vector<std::string> symbols;
+	std::vector<std::unordered_map<u32, u64>> blockSymbolCounts(GetLastBlockIndex() + 1);
+
+	u64 totalSampleCount = 0;
+	u64 droppedSampleCount = 0;
+	for (const std::unique_ptr<ProfilerThreadState>& state : threadStates) {
+		const u64 storedCount = (state->sampleCount < MAX_PROFILER_SAMPLE_COUNT) ? state->sampleCount : MAX_PROFILER_SAMPLE_COUNT;
+		droppedSampleCount += state->sampleCount - storedCount;
+
+		for (u64 i = 0; i < storedCount; ++i) {
+			const ProfilerSample& sample = state->samples[i];
+			auto symbol = instructionSymbols.find(sample.instructionPointer);
+			if (symbol == instructionSymbols.end()) {
+				std::string name = ResolveSymbol(sample.instructionPointer);
+				const auto [entry, isNew] = symbolIndices.try_emplace(std::move(name), static_cast<u32>(symbols.size()));
+				if (isNew) {
+					symbols.push_back(entry->first);
+				}
+				symbol = instructionSymbols.emplace(sample.instructionPointer, entry->second).first;
+			}
+
+			++blockSymbolCounts[sample.blockIndex][symbol->second];
+			++totalSampleCount;
+		}
+	}
+
+	printf("\nSamples: %llu at %uHz", totalSampleCount, PROFILER_SAMPLE_FREQUENCY);
+	if (droppedSampleCount) {
+		printf(", %llu dropped", droppedSampleCount);
+	}
+	printf("\n");
+
+	for (u32 blockIndex = 0; blockIndex < blockSymbolCounts.size(); ++blockIndex) {
+		std::vector<std::pair<u32, u64>> counts(blockSymbolCounts[blockIndex].begin(), blockSymbolCounts[blockIndex].end());
+		u64 blockSampleCount = 0;
+		for (const std::pair<u32, u64>& count : counts) {
+			blockSampleCount += count.second;
+		}
+
+		if (!blockSampleCount) {
+			continue;
+		}
+
+		const size_t printedCount = (counts.size() < MAX_PRINTED_SYMBOL_COUNT) ? counts.size() : MAX_PRINTED_SYMBOL_COUNT;
+		std::partial_sort(counts.begin(), counts.begin() + printedCount, counts.end(),
+						  [](const std::pair<u32, u64>& a, const std::pair<u32, u64>& b) { return a.second > b.second; });
+
+		printf("  %s: %llu samples (%.2f%%)\n", blockIndex ? GetBlockName(blockIndex) : "[outside blocks]", blockSampleCount,
+			   100.0 * static_cast<f64>(blockSampleCount) / static_cast<f64>(totalSampleCount));
+		for (size_t i = 0; i < printedCount; ++i) {
+			printf("      %6.2f%% %s\n", 100.0 * static_cast<f64>(counts[i].second) / static_cast<f64>(blockSampleCount),
+				   symbols[counts[i].first].c_str());
+		}
+	}
+}
+
+#endif
+
+#if PROFILER_LIVE
+
+static MappedFile liveFile = {};
+static std::thread livePublisher;
+static std::mutex liveMutex;
+static std::condition_variable liveStopCondition;
+static bool isLiveStopping = false;
+
+/* NOTE(Umut): Runs on the publisher thread and reads the block tables while their threads keep writing them,
+   through the same relaxed atomics the hot path stores with, so a total is at worst a hit behind.
+   threadStatesMutex only holds off threads registering meanwhile. */
+static void PublishLiveSnapshot(ProfilerLiveFile& live, const bool isFinal)
+{
+	// Only this thread writes the epochs.
+	const u64 epoch = live.header.publishedEpoch + 1;
+	std::atomic_ref<u64>(live.header.writingEpoch).store(epoch, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	ProfilerLiveSnapshot& snapshot = live.snapshots[epoch & 1];
+	{
+		std::lock_guard<std::mutex> lock(threadStatesMutex);
+		const u32 registeredBlockCount = GetLastBlockIndex();
+		snapshot.time = ProfilerTimer::Read();
+		snapshot.blockCount = registeredBlockCount + 1;
+		snapshot.threadCount = std::min(static_cast<u32>(threadStates.size()), MAX_PROFILER_LIVE_THREAD_COUNT);
+		snapshot.isFinal = isFinal;
+		for (u32 thread = 0; thread < snapshot.threadCount; ++thread) {
+			snapshot.openBlocks[thread] = LoadLiveField(threadStates[thread]->parentBlockIndex);
+		}
+
+		for (u32 i = 1; i <= registeredBlockCount; ++i) {
+			ProfilerLiveBlock& block = snapshot.blocks[i];
+			block.hitCount = 0;
+			block.elapsedTimeInclusive = 0;
+			block.processedByteCount = 0;
+			for (const std::unique_ptr<ProfilerThreadState>& state : threadStates) {
+				const ProfilerBlockInfo& info = state->blocks[i];
+				block.hitCount += LoadLiveField(info.hitCount);
+				block.elapsedTimeInclusive += LoadLiveField(info.elapsedTimeInclusive);
+				block.processedByteCount += LoadLiveField(info.processedByteCount);
+			}
+
+			snprintf(block.name, PROFILER_LIVE_NAME_SIZE, "%s", GetBlockName(i));
+		}
+	}
+
+	std::atomic_ref<u64>(live.header.publishedEpoch).store(epoch, std::memory_order_release);
+}
+
+static ProfilerLiveFile& GetLiveFile()
+{
+	return *reinterpret_cast<ProfilerLiveFile*>(const_cast<u8*>(liveFile.data));
+}
+
+void Profiler::StartLiveSnapshots()
+{
+	liveFile = CreateSharedMapping(PROFILER_LIVE_FILE_NAME, sizeof(ProfilerLiveFile));
+	if (!IsValid(liveFile)) {
+		fprintf(stderr, "Profiler: unable to create the live snapshot file %s\n", PROFILER_LIVE_FILE_NAME);
+		return;
+	}
+
+	// NOTE(Umut): A viewer may still be attached to the file from an earlier run, it waits while the magic is unset.
+	ProfilerLiveFile& live = GetLiveFile();
+	std::atomic_ref<u32>(live.header.magic).store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	live.header.version = PROFILER_LIVE_VERSION;
+	live.header.timerFrequency = ProfilerTimer::GetFrequency();
+	live.header.beginTime = beginCpuTime;
+	live.header.writingEpoch = 0;
+	live.header.publishedEpoch = 0;
+	std::atomic_ref<u32>(live.header.magic).store(PROFILER_LIVE_MAGIC, std::memory_order_release);
+
+	isLiveStopping = false;
+	livePublisher = std::thread([]() {
+		std::unique_lock<std::mutex> lock(liveMutex);
+		while (!liveStopCondition.wait_for(lock, std::chrono::milliseconds(PROFILER_LIVE_INTERVAL_MS), []() { return isLiveStopping; })) {
+			PublishLiveSnapshot(GetLiveFile(), false);
+		}
+	});
+}
+
+void Profiler::StopLiveSnapshots()
+{
+	if (!livePublisher.joinable()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(liveMutex);
+		isLiveStopping = true;
+	}
+	liveStopCondition.notify_one();
+	livePublisher.join();
+
+	PublishLiveSnapshot(GetLiveFile(), true);
+	UnmapFile(liveFile);
+}
+
+#endif
 
 void Profiler::Begin()
 {
-	beginCpuTime = TimerFunc();
+	// Registers the calling thread first so it shows up as thread 0 in the breakdown.
+	GetThreadState();
+	CalibrateOverhead();
+#if PROFILER_RUNTIME_TOGGLE
+	if (const char* groupNames = getenv("PROFILER_GROUPS")) {
+		EnableGroups(groupNames);
+	}
+	StartGroupToggleSignal();
+#endif
+#if PROFILER_SAMPLING
+	StartSampling();
+#endif
+	beginCpuTime = ProfilerTimer::Read();
+#if PROFILER_LIVE
+	StartLiveSnapshots();
+#endif
 }
 
 void Profiler::End()
 {
-	endCpuTime = TimerFunc();
+	endCpuTime = ProfilerTimer::Read();
+#if PROFILER_SAMPLING
+	StopSampling();
+#endif
+#if PROFILER_LIVE
+	StopLiveSnapshots();
+#endif
 }
 
 void Profiler::PrintBlocks()
@@ -67,11 +1034,399 @@ void Profiler::PrintBlocks()
 	}
 
 	const u64 totalCpuElapsed = endCpuTime - beginCpuTime;
-	const u64 cpuFreq = CpuFrequencyFunc();
+	const u64 cpuFreq = ProfilerTimer::GetFrequency();
 	const f64 totalCpuTime = static_cast<f64>(totalCpuElapsed) * 1000 / static_cast<f64>(cpuFreq);
 	printf("Total time: %.4fms (CPU freq %llu)\n", totalCpuTime, cpuFreq);
 
-	for (size_t i = 1; i <= indexCounter; ++i) {
-		PrintBlockInfo(blocks[i], totalCpuElapsed, cpuFreq);
+	// NOTE(Umut): Merged times are summed over threads, so blocks running in parallel can pass 100%.
+	std::lock_guard<std::mutex> lock(threadStatesMutex);
+	const u32 registeredBlockCount = GetLastBlockIndex();
+	if (blockCount >= PROFILE_BLOCK_OVERFLOW) {
+		printf("Block table full: %u blocks share the last entry, raise MAX_PROFILE_BLOCK_COUNT\n", blockCount - PROFILE_BLOCK_OVERFLOW + 1);
+	}
+
+	u64 totalHitCount = 0;
+	for (const std::unique_ptr<ProfilerThreadState>& state : threadStates) {
+		totalHitCount += state->closedBlockCount;
+	}
+
+	const f64 totalOverhead = static_cast<f64>(totalHitCount) * (overhead.inside + overhead.outside);
+	printf("Profiler overhead: %.1f inside + %.1f outside per block, %.4fms over %llu blocks (%.2f%%)\n", overhead.inside,
+		   overhead.outside, totalOverhead * 1000 / static_cast<f64>(cpuFreq), totalHitCount,
+		   100.0 * totalOverhead / static_cast<f64>(totalCpuElapsed));
+
+	// NOTE(Umut): A single run has nothing to compare against, the per-run lines only show up for more.
+	const bool hasRuns = runs.size() > 1;
+	if (hasRuns) {
+		std::vector<u64> runTimes;
+		for (const ProfilerRun& run : runs) {
+			runTimes.push_back(run.elapsedTime);
+		}
+
+		char label[32];
+		snprintf(label, sizeof(label), "%zu runs", runs.size());
+		PrintRunSpread(label, GetRunSpread(runTimes), cpuFreq);
+	}
+
+	// NOTE(Umut): The peaks are only measured, or loaded, once a block has something to hold against them.
+	bool hasByteCounts = false;
+	for (const std::unique_ptr<ProfilerThreadState>& state : threadStates) {
+		for (u32 i = 1; i <= registeredBlockCount; ++i) {
+			hasByteCounts |= (state->blocks[i].processedByteCount != 0);
+		}
+	}
+
+	if (hasByteCounts) {
+		PrintBandwidthPeaks();
+	}
+
+#if PROFILER_PERF_COUNTERS
+	for (u32 i = 0; i < PERF_COUNTER_COUNT; ++i) {
+		perfCounterAvailable[i] = !threadStates.empty() && threadStates[0]->perfCounters.IsAvailable(i);
 	}
-}
\ No newline at end of file
+
+	if (!perfCounterAvailable[PERF_COUNTER_CYCLES]) {
+		const char* error = GetPerfCounterError();
+		printf("Perf counters unavailable: %s\n", error ? error : "not opened");
+	}
+#endif
+
+#if PROFILER_RUNTIME_TOGGLE
+	// NOTE(Umut): The switches as they are now, a group toggled during the run only has the hits from while it was on.
+	const u64 groupMask = enabledGroups;
+	printf("Block groups:");
+	for (u32 i = 0; i < std::min(groupCount.load(), MAX_PROFILE_GROUP_COUNT); ++i) {
+		printf(" %s %s", registeredGroupNames[i], (groupMask & (1ull << i)) ? "on" : "off");
+	}
+	printf("\n");
+#endif
+
+	for (u32 i = 1; i <= registeredBlockCount; ++i) {
+		const ProfilerBlockInfo merged = MergeThreadBlocks(i);
+		u32 hitThreadCount = 0;
+		for (const std::unique_ptr<ProfilerThreadState>& state : threadStates) {
+			hitThreadCount += (state->blocks[i].hitCount != 0);
+		}
+
+		// Blocks that were only ever opened while calibrating.
+		if (!merged.hitCount) {
+			continue;
+		}
+
+		PrintBlockInfo(merged, totalCpuElapsed, cpuFreq);
+#if PROFILER_HISTOGRAMS
+		PrintHitDistribution(merged);
+#endif
+		if (hasRuns) {
+			PrintRunSpread("      per run", GetRunSpread(GetBlockRunTimes(i)), cpuFreq);
+		}
+
+		if (hitThreadCount < 2) {
+			continue;
+		}
+
+		for (const std::unique_ptr<ProfilerThreadState>& state : threadStates) {
+			if (!state->blocks[i].hitCount) {
+				continue;
+			}
+
+			char threadName[32];
+			snprintf(threadName, sizeof(threadName), "thread %u", state->threadIndex);
+
+			PrintBlockInfo(state->blocks[i], totalCpuElapsed, cpuFreq, "      ", threadName);
+		}
+	}
+
+#if PROFILER
+	printf("\nCall tree:\n");
+	const std::vector<CallTreeNode> callTree = BuildCallTree();
+	for (const u32 child : callTree[0].children) {
+		PrintCallTreeNode(callTree, child, 0, totalCpuElapsed);
+	}
+#endif
+
+#if PROFILER_SAMPLING
+	PrintSamples();
+#endif
+}
+
+bool Profiler::WriteCollapsedStacks(const char* fileName)
+{
+#if PROFILER
+	FILE* file = nullptr;
+	if (fopen_s(&file, fileName, "wb") || !file) {
+		fprintf(stderr, "Failed to open collapsed stack file %s\n", fileName);
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(threadStatesMutex);
+	const std::vector<CallTreeNode> callTree = BuildCallTree();
+	std::string stack;
+	WriteCollapsedStack(file, callTree, 0, stack);
+
+	fclose(file);
+	return true;
+#else
+	(void)fileName;
+	return false;
+#endif
+}
+
+bool Profiler::WriteTrace(const char* fileName)
+{
+#if PROFILER && PROFILER_TRACE
+	FILE* file = nullptr;
+	if (fopen_s(&file, fileName, "wb") || !file) {
+		fprintf(stderr, "Failed to open trace file %s\n", fileName);
+		return false;
+	}
+
+	const f64 ticksToMicroseconds = 1000000.0 / static_cast<f64>(ProfilerTimer::GetFrequency());
+	const char* separator = "";
+	u64 writtenCount = 0;
+	u64 overwrittenCount = 0;
+
+	std::lock_guard<std::mutex> lock(threadStatesMutex);
+	fprintf(file, "{\"traceEvents\":[\n");
+	for (const std::unique_ptr<ProfilerThreadState>& state : threadStates) {
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+				separator, state->threadIndex, state->threadIndex);
+		separator = ",\n";
+
+		const u64 eventCount = state->traceEventCount;
+		const u64 firstEvent = (eventCount > PROFILER_TRACE_RING_SIZE) ? (eventCount - PROFILER_TRACE_RING_SIZE) : 0;
+		overwrittenCount += firstEvent;
+
+		// NOTE(Umut): Blocks nest, so an end always closes the last open begin. An end with nothing open lost its
+		// begin to the ring wrapping, blocks still open at the end of the ring are skipped.
+		std::vector<ProfilerTraceEvent> openEvents;
+		for (u64 i = firstEvent; i < eventCount; ++i) {
+			const ProfilerTraceEvent& event = state->traceEvents[i & (PROFILER_TRACE_RING_SIZE - 1)];
+			if (!event.isEnd) {
+				openEvents.push_back(event);
+				continue;
+			}
+
+			if (openEvents.empty()) {
+				continue;
+			}
+
+			const ProfilerTraceEvent begin = openEvents.back();
+			openEvents.pop_back();
+			assert(begin.blockIndex == event.blockIndex);
+
+			const f64 start = static_cast<f64>(static_cast<s64>(begin.time - beginCpuTime)) * ticksToMicroseconds;
+			const f64 duration = static_cast<f64>(event.time - begin.time) * ticksToMicroseconds;
+			fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+					GetBlockName(begin.blockIndex), state->threadIndex, start, duration);
+			++writtenCount;
+		}
+	}
+
+	fprintf(file, "\n]}\n");
+	fclose(file);
+
+	printf("Trace: %llu blocks written to %s", writtenCount, fileName);
+	if (overwrittenCount) {
+		printf(", %llu oldest events overwritten", overwrittenCount);
+	}
+	printf("\n");
+
+	return true;
+#else
+	(void)fileName;
+	return false;
+#endif
+}
+
+#if PROFILER
+
+/* NOTE(Umut): Exported times are the overhead corrected ones in milliseconds so profiles from machines with
+   different timer rates compare directly, ticks are the raw totals. Run and per-hit columns are zero when the
+   profile has a single run or was built without PROFILER_HISTOGRAMS. */
+struct ProfilerBlockStats
+{
+	ProfilerBlockInfo info;
+	f64 exclusiveMilliseconds;
+	f64 inclusiveMilliseconds;
+	f64 gigabytesPerSecond;
+	ProfilerRunSpread runSpread;
+	u64 hitTimeMin;
+	u64 hitTimeP50;
+	u64 hitTimeP90;
+	u64 hitTimeP99;
+	u64 hitTimeMax;
+};
+
+/**
+ * @brief Merged statistics of every block that was hit. threadStatesMutex has to be held.
+ */
+static std::vector<ProfilerBlockStats> GetBlockStats(const u64 cpuFreq)
+{
+	const f64 toMilliseconds = 1000.0 / static_cast<f64>(cpuFreq);
+	std::vector<ProfilerBlockStats> blockStats;
+	for (u32 i = 1; i <= GetLastBlockIndex(); ++i) {
+		ProfilerBlockStats stats = {};
+		stats.info = MergeThreadBlocks(i);
+		if (!stats.info.hitCount) {
+			continue;
+		}
+
+		stats.exclusiveMilliseconds = GetCorrectedExclusive(stats.info) * toMilliseconds;
+		stats.inclusiveMilliseconds = GetCorrectedInclusive(stats.info) * toMilliseconds;
+		if (stats.info.processedByteCount && (stats.inclusiveMilliseconds > 0.0)) {
+			stats.gigabytesPerSecond = ToGigabyte(stats.info.processedByteCount) * 1000.0 / stats.inclusiveMilliseconds;
+		}
+
+		if (runs.size() > 1) {
+			stats.runSpread = GetRunSpread(GetBlockRunTimes(i));
+		}
+
+#if PROFILER_HISTOGRAMS
+		stats.hitTimeMin = ~stats.info.invertedMinHitTime;
+		stats.hitTimeP50 = GetHitTimePercentile(stats.info, 0.5);
+		stats.hitTimeP90 = GetHitTimePercentile(stats.info, 0.9);
+		stats.hitTimeP99 = GetHitTimePercentile(stats.info, 0.99);
+		stats.hitTimeMax = stats.info.maxHitTime;
+#endif
+		blockStats.push_back(stats);
+	}
+
+	return blockStats;
+}
+
+static std::string GetProfilerBuildFlags()
+{
+	char flags[256];
+	snprintf(flags, sizeof(flags), "PROFILER_TRACE=%d PROFILER_PERF_COUNTERS=%d PROFILER_OS_COUNTERS=%d PROFILER_SAMPLING=%d PROFILER_HISTOGRAMS=%d PROFILER_LIVE=%d PROFILER_RUNTIME_TOGGLE=%d",
+			 PROFILER_TRACE, PROFILER_PERF_COUNTERS, PROFILER_OS_COUNTERS, PROFILER_SAMPLING, PROFILER_HISTOGRAMS, PROFILER_LIVE, PROFILER_RUNTIME_TOGGLE);
+	return flags;
+}
+
+static void WriteJsonString(FILE* file, const char* str)
+{
+	fputc('"', file);
+	for (; *str; ++str) {
+		const u8 c = static_cast<u8>(*str);
+		if ((c == '"') || (c == '\\')) {
+			fprintf(file, "\\%c", c);
+		}
+		else if (c < 0x20) {
+			fprintf(file, "\\u%04x", c);
+		}
+		else {
+			fputc(c, file);
+		}
+	}
+	fputc('"', file);
+}
+
+static void WriteCsvString(FILE* file, const char* str)
+{
+	fputc('"', file);
+	for (; *str; ++str) {
+		if (*str == '"') {
+			fputc('"', file);
+		}
+		fputc(*str, file);
+	}
+	fputc('"', file);
+}
+
+#endif
+
+bool Profiler::WriteProfileJson(const char* fileName, const char* datasetName)
+{
+#if PROFILER
+	FILE* file = nullptr;
+	if (fopen_s(&file, fileName, "wb") || !file) {
+		fprintf(stderr, "Failed to open profile file %s\n", fileName);
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(threadStatesMutex);
+
+	const u64 cpuFreq = ProfilerTimer::GetFrequency();
+	const f64 totalMilliseconds = static_cast<f64>(endCpuTime - beginCpuTime) * 1000.0 / static_cast<f64>(cpuFreq);
+
+	// NOTE(Umut): One key or block per line and no exponents in numbers, JsonParser reads it back as is.
+	fprintf(file, "{\n\"cpu\": ");
+	WriteJsonString(file, GetCpuIdentity().c_str());
+	fprintf(file, ",\n\"timer\": \"%s\",\n\"timer_frequency\": %llu,\n\"build_flags\": \"%s\",\n\"dataset\": ",
+			ProfilerTimer::name, cpuFreq, GetProfilerBuildFlags().c_str());
+	WriteJsonString(file, datasetName);
+	fprintf(file, ",\n\"timestamp\": %lld,\n\"total_ms\": %.6f,\n\"run_count\": %zu,\n", static_cast<s64>(time(nullptr)),
+			totalMilliseconds, runs.size());
+	fprintf(file, "\"overhead_inside\": %.3f,\n\"overhead_outside\": %.3f,\n\"blocks\": [\n", overhead.inside, overhead.outside);
+
+	const f64 toMilliseconds = 1000.0 / static_cast<f64>(cpuFreq);
+	const char* separator = "";
+	for (const ProfilerBlockStats& stats : GetBlockStats(cpuFreq)) {
+		fprintf(file, "%s{\"name\": ", separator);
+		WriteJsonString(file, stats.info.name);
+		fprintf(file, ", \"hit_count\": %llu, \"exclusive_ticks\": %llu, \"inclusive_ticks\": %llu, \"exclusive_ms\": %.6f, \"inclusive_ms\": %.6f",
+				stats.info.hitCount, stats.info.elapsedTimeExclusive, stats.info.elapsedTimeInclusive, stats.exclusiveMilliseconds,
+				stats.inclusiveMilliseconds);
+		fprintf(file, ", \"processed_bytes\": %llu, \"read_bytes\": %llu, \"write_bytes\": %llu, \"flop_count\": %llu, \"gb_per_sec\": %.6f",
+				stats.info.processedByteCount, stats.info.readByteCount, stats.info.writeByteCount, stats.info.flopCount,
+				stats.gigabytesPerSecond);
+		fprintf(file, ", \"run_min_ms\": %.6f, \"run_median_ms\": %.6f, \"run_max_ms\": %.6f",
+				static_cast<f64>(stats.runSpread.min) * toMilliseconds, stats.runSpread.median * toMilliseconds,
+				static_cast<f64>(stats.runSpread.max) * toMilliseconds);
+		fprintf(file, ", \"hit_min_ticks\": %llu, \"hit_p50_ticks\": %llu, \"hit_p90_ticks\": %llu, \"hit_p99_ticks\": %llu, \"hit_max_ticks\": %llu}",
+				stats.hitTimeMin, stats.hitTimeP50, stats.hitTimeP90, stats.hitTimeP99, stats.hitTimeMax);
+		separator = ",\n";
+	}
+
+	fprintf(file, "\n]\n}\n");
+	fclose(file);
+	return true;
+#else
+	(void)fileName;
+	(void)datasetName;
+	return false;
+#endif
+}
+
+bool Profiler::WriteProfileCsv(const char* fileName, const char* datasetName)
+{
+#if PROFILER
+	FILE* file = nullptr;
+	if (fopen_s(&file, fileName, "wb") || !file) {
+		fprintf(stderr, "Failed to open profile file %s\n", fileName);
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(threadStatesMutex);
+
+	const u64 cpuFreq = ProfilerTimer::GetFrequency();
+	fprintf(file, "# cpu,");
+	WriteCsvString(file, GetCpuIdentity().c_str());
+	fprintf(file, "\n# timer,%s\n# timer_frequency,%llu\n# build_flags,%s\n# dataset,", ProfilerTimer::name, cpuFreq,
+			GetProfilerBuildFlags().c_str());
+	WriteCsvString(file, datasetName);
+	fprintf(file, "\n# timestamp,%lld\n# total_ms,%.6f\n# run_count,%zu\n", static_cast<s64>(time(nullptr)),
+			static_cast<f64>(endCpuTime - beginCpuTime) * 1000.0 / static_cast<f64>(cpuFreq), runs.size());
+	fprintf(file, "name,hit_count,exclusive_ticks,inclusive_ticks,exclusive_ms,inclusive_ms,processed_bytes,read_bytes,write_bytes,flop_count,gb_per_sec,"
+			"run_min_ms,run_median_ms,run_max_ms,hit_min_ticks,hit_p50_ticks,hit_p90_ticks,hit_p99_ticks,hit_max_ticks\n");
+
+	const f64 toMilliseconds = 1000.0 / static_cast<f64>(cpuFreq);
+	for (const ProfilerBlockStats& stats : GetBlockStats(cpuFreq)) {
+		WriteCsvString(file, stats.info.name);
+		fprintf(file, ",%llu,%llu,%llu,%.6f,%.6f,%llu,%llu,%llu,%llu,%.6f,%.6f,%.6f,%.6f,%llu,%llu,%llu,%llu,%llu\n", stats.info.hitCount,
+				stats.info.elapsedTimeExclusive, stats.info.elapsedTimeInclusive, stats.exclusiveMilliseconds,
+				stats.inclusiveMilliseconds, stats.info.processedByteCount, stats.info.readByteCount, stats.info.writeByteCount,
+				stats.info.flopCount, stats.gigabytesPerSecond,
+				static_cast<f64>(stats.runSpread.min) * toMilliseconds, stats.runSpread.median * toMilliseconds,
+				static_cast<f64>(stats.runSpread.max) * toMilliseconds, stats.hitTimeMin, stats.hitTimeP50, stats.hitTimeP90,
+				stats.hitTimeP99, stats.hitTimeMax);
+	}
+
+	fclose(file);
+	return true;
+#else
+	(void)fileName;
+	(void)datasetName;
+	return false;
+#endif
+}
@@ -3,30 +3,224 @@
 #include <source_location>
 #include <assert.h>
 #include <array>
-#include <functional>
+#include <atomic>
+#include <bit>
+#include <memory>
 
 #include "basedef.h"
+#include "cpu_features.h"
 #include "platform_metrics.h"
 
-using TimerFunction = std::function<u64()>;
-using CpuFrequencyFunction = std::function<u64()>;
+/* NOTE(Umut): The timer is picked at compile time so opening and closing a block inlines down to the timer
+   instructions themselves, no indirect call on the path being measured. A block opens with ReadBegin and
+   closes with ReadEnd, everything else that only needs the time reads it with Read.
+   RDTSC:         cheapest, can be reordered with the surrounding instructions.
+   RDTSCP:        waits for earlier instructions to finish before reading.
+   LFENCE_RDTSC:  lfence;rdtsc, plus an lfence after the begin read so the block's own instructions wait for it.
+   RDTSCP_LFENCE: rdtscp;lfence, the same ordering with one fence less.
+   CPUID:         cpuid;rdtsc to begin and rdtscp;cpuid to end, fully serializing. Every cpuid exits to the
+                  hypervisor inside a VM, which makes it cost thousands of cycles there.
+   OS:            QueryPerformanceCounter / clock_gettime, for machines without an invariant TSC.
+   The fenced modes keep the block's work from overlapping its reads at the cost of extra overhead per block.
+   How much that helps short blocks depends on the CPU, RunTimestampModeTests in RepetitionTesting measures
+   both for each mode on the machine it runs on. */
+#define PROFILER_TIMER_RDTSC 0
+#define PROFILER_TIMER_RDTSCP 1
+#define PROFILER_TIMER_LFENCE_RDTSC 2
+#define PROFILER_TIMER_OS 3
+#define PROFILER_TIMER_RDTSCP_LFENCE 4
+#define PROFILER_TIMER_CPUID 5
 
 #ifndef ALTERNATE_TIMER
 #define ALTERNATE_TIMER 0
 #endif
 
+#ifndef PROFILER_TIMER
 #if ALTERNATE_TIMER
-	inline TimerFunction TimerFunc = ReadOSTimer;
-	inline CpuFrequencyFunction CpuFrequencyFunc = GetOSTimerFreq;
+#define PROFILER_TIMER PROFILER_TIMER_OS
 #else
-	inline TimerFunction TimerFunc = ReadCPUTimer;
-	inline CpuFrequencyFunction CpuFrequencyFunc = GetEstimatedCPUFrequency;
+#define PROFILER_TIMER PROFILER_TIMER_RDTSC
+#endif
+#endif
+
+struct RdtscTimer
+{
+	static constexpr const char* name = "rdtsc";
+
+	static u64 Read() { return __rdtsc(); }
+	static u64 ReadBegin() { return __rdtsc(); }
+	static u64 ReadEnd() { return __rdtsc(); }
+	static u64 GetFrequency() { return GetEstimatedCPUFrequency(); }
+};
+
+struct RdtscpTimer
+{
+	static constexpr const char* name = "rdtscp";
+
+	static u64 Read()
+	{
+		u32 processorId;
+		return __rdtscp(&processorId);
+	}
+
+	static u64 ReadBegin() { return Read(); }
+	static u64 ReadEnd() { return Read(); }
+	static u64 GetFrequency() { return GetEstimatedCPUFrequency(); }
+};
+
+struct LfenceRdtscTimer
+{
+	static constexpr const char* name = "lfence_rdtsc";
+
+	static u64 Read()
+	{
+		_mm_lfence();
+		return __rdtsc();
+	}
+
+	static u64 ReadBegin()
+	{
+		const u64 time = Read();
+		_mm_lfence();
+		return time;
+	}
+
+	static u64 ReadEnd() { return Read(); }
+	static u64 GetFrequency() { return GetEstimatedCPUFrequency(); }
+};
+
+struct RdtscpLfenceTimer
+{
+	static constexpr const char* name = "rdtscp_lfence";
+
+	static u64 Read()
+	{
+		u32 processorId;
+		const u64 time = __rdtscp(&processorId);
+		_mm_lfence();
+		return time;
+	}
+
+	static u64 ReadBegin() { return Read(); }
+	static u64 ReadEnd() { return Read(); }
+	static u64 GetFrequency() { return GetEstimatedCPUFrequency(); }
+};
+
+struct CpuidTimer
+{
+	static constexpr const char* name = "cpuid";
+
+	static u64 Read() { return ReadBegin(); }
+
+	static u64 ReadBegin()
+	{
+		u32 registers[4];
+		ReadCpuid(0, 0, registers);
+		return __rdtsc();
+	}
+
+	static u64 ReadEnd()
+	{
+		u32 processorId;
+		const u64 time = __rdtscp(&processorId);
+		u32 registers[4];
+		ReadCpuid(0, 0, registers);
+		return time;
+	}
+
+	static u64 GetFrequency() { return GetEstimatedCPUFrequency(); }
+};
+
+struct OSTimer
+{
+	static constexpr const char* name = "os";
+
+	static u64 Read() { return ReadOSTimer(); }
+	static u64 ReadBegin() { return ReadOSTimer(); }
+	static u64 ReadEnd() { return ReadOSTimer(); }
+	static u64 GetFrequency() { return GetOSTimerFreq(); }
+};
+
+#if PROFILER_TIMER == PROFILER_TIMER_RDTSC
+using ProfilerTimer = RdtscTimer;
+#elif PROFILER_TIMER == PROFILER_TIMER_RDTSCP
+using ProfilerTimer = RdtscpTimer;
+#elif PROFILER_TIMER == PROFILER_TIMER_LFENCE_RDTSC
+using ProfilerTimer = LfenceRdtscTimer;
+#elif PROFILER_TIMER == PROFILER_TIMER_RDTSCP_LFENCE
+using ProfilerTimer = RdtscpLfenceTimer;
+#elif PROFILER_TIMER == PROFILER_TIMER_CPUID
+using ProfilerTimer = CpuidTimer;
+#elif PROFILER_TIMER == PROFILER_TIMER_OS
+using ProfilerTimer = OSTimer;
+#else
+#error Unknown PROFILER_TIMER
 #endif
 
 #ifndef PROFILER
 #define PROFILER 0
 #endif // !PROFILER
 
+#ifndef PROFILER_TRACE
+#define PROFILER_TRACE 0
+#endif
+
+#ifndef PROFILER_PERF_COUNTERS
+#define PROFILER_PERF_COUNTERS 0
+#endif
+
+#if PROFILER_PERF_COUNTERS
+#include "perf_counters.h"
+#endif
+
+#ifndef PROFILER_OS_COUNTERS
+#define PROFILER_OS_COUNTERS 0
+#endif
+
+#if PROFILER_OS_COUNTERS
+#include "os_counters.h"
+#endif
+
+#ifndef PROFILER_SAMPLING
+#define PROFILER_SAMPLING 0
+#endif
+
+// NOTE(Umut): Sampling runs on per-thread CPU time timers delivering SIGPROF, which only exist on Linux.
+#if PROFILER_SAMPLING && _WIN32
+#undef PROFILER_SAMPLING
+#define PROFILER_SAMPLING 0
+#endif
+
+#ifndef PROFILER_SAMPLE_FREQUENCY
+// Samples per second of thread CPU time, a prime keeps it from beating with periodic work.
+#define PROFILER_SAMPLE_FREQUENCY 997
+#endif
+
+#if PROFILER_SAMPLING
+#include <time.h>
+#endif
+
+#ifndef PROFILER_HISTOGRAMS
+#define PROFILER_HISTOGRAMS 0
+#endif
+
+// NOTE(Umut): Publishes the block totals to a shared file every interval for a viewer, see profile_live.h.
+#ifndef PROFILER_LIVE
+#define PROFILER_LIVE 0
+#endif
+
+/* NOTE(Umut): With PROFILER_RUNTIME_TOGGLE every block belongs to a named group and only blocks of enabled
+   groups record anything, so one binary can ship with the profiler in it. A disabled block costs a mask test
+   when it opens and a null check when it closes, both always taken the same way. Groups are picked with the
+   PROFILER_GROUPS environment variable at Profiler::Begin or Profiler::EnableGroups, SIGUSR1 switches them
+   off and back on. Without it the groups are ignored and every block records, with no test at all. */
+#ifndef PROFILER_RUNTIME_TOGGLE
+#define PROFILER_RUNTIME_TOGGLE 0
+#endif
+
+// Group of the blocks that do not name one.
+#define PROFILE_DEFAULT_GROUP "default"
+
 #if PROFILER
 
 #define GET_LOCATION std::source_location::current()
@@ -34,7 +228,9 @@ using CpuFrequencyFunction = std::function<u64()>;
 #define CONCAT2(A, B) A##B
 #define	NAME_CONCAT(A, B) CONCAT2(A, B)
 
-#define PROFILE_BLOCK(blockName, ...) const auto NAME_CONCAT(block, __COUNTER__) = GetProfileBlock<GET_LOCATION, GET_LOCATION>(blockName, __VA_ARGS__);
+#define PROFILE_GROUP_BLOCK(groupName, blockName, ...) const auto NAME_CONCAT(block, __COUNTER__) = GetProfileBlock<GET_LOCATION, GET_LOCATION, groupName>(blockName __VA_OPT__(,) __VA_ARGS__);
+#define PROFILE_GROUP_FUNCTION(groupName, ...) PROFILE_GROUP_BLOCK(groupName, __func__, __VA_ARGS__)
+#define PROFILE_BLOCK(blockName, ...) PROFILE_GROUP_BLOCK(PROFILE_DEFAULT_GROUP, blockName __VA_OPT__(,) __VA_ARGS__)
 #define PROFILE_BLOCK_FUNCTION(...) PROFILE_BLOCK(__func__, __VA_ARGS__)
 
 struct SubStr
@@ -91,15 +287,77 @@ struct SourceLocationInfo
 	unsigned lineNum;
 };
 
-struct Runner
+// A group name literal as a template argument, so every block's group is known before main like its slot.
+template<size_t N>
+struct ProfileGroupName
 {
-	Runner(auto&& callable)
+	constexpr ProfileGroupName(const char (&groupName)[N])
 	{
-		callable();
+		std::copy(groupName, groupName + N, name);
 	}
+
+	char name[N];
 };
 
-class Profiler;
+#else
+#define PROFILE_GROUP_BLOCK(...)
+#define PROFILE_GROUP_FUNCTION(...)
+#define PROFILE_BLOCK(...)
+#define PROFILE_BLOCK_FUNCTION(...)
+
+#endif
+
+/* NOTE(Umut): With PROFILER_HISTOGRAMS every hit's own duration, children included, is also counted in a log
+   scale histogram. Each power of two is split in four, so a bucket is at most a quarter of its start wide and
+   the percentiles read from it are within about 12%. Below 8 ticks buckets are exact, past 2^41 ticks
+   everything shares the last one. */
+const u32 PROFILE_HISTOGRAM_SUB_BUCKET_BITS = 2;
+const u32 PROFILE_HISTOGRAM_BUCKET_COUNT = 40 << PROFILE_HISTOGRAM_SUB_BUCKET_BITS;
+
+inline u32 GetHistogramBucket(const u64 elapsedTime)
+{
+	const u32 subBucketCount = 1u << PROFILE_HISTOGRAM_SUB_BUCKET_BITS;
+	if (elapsedTime < subBucketCount) {
+		return static_cast<u32>(elapsedTime);
+	}
+
+	// Top bit picks the power of two, the next bits below it the quarter.
+	const u32 highBit = static_cast<u32>(std::bit_width(elapsedTime)) - 1;
+	const u32 subBucket = static_cast<u32>(elapsedTime >> (highBit - PROFILE_HISTOGRAM_SUB_BUCKET_BITS)) & (subBucketCount - 1);
+	const u32 bucket = ((highBit - PROFILE_HISTOGRAM_SUB_BUCKET_BITS + 1) << PROFILE_HISTOGRAM_SUB_BUCKET_BITS) | subBucket;
+	return (bucket < PROFILE_HISTOGRAM_BUCKET_COUNT) ? bucket : PROFILE_HISTOGRAM_BUCKET_COUNT - 1;
+}
+
+/**
+ * @brief Smallest duration that lands in the bucket, the next bucket's start is one past its largest.
+ */
+inline u64 GetHistogramBucketStart(const u32 bucket)
+{
+	const u32 subBucketCount = 1u << PROFILE_HISTOGRAM_SUB_BUCKET_BITS;
+	if (bucket < subBucketCount) {
+		return bucket;
+	}
+
+	const u32 highBit = (bucket >> PROFILE_HISTOGRAM_SUB_BUCKET_BITS) + PROFILE_HISTOGRAM_SUB_BUCKET_BITS - 1;
+	return static_cast<u64>(subBucketCount | (bucket & (subBucketCount - 1))) << (highBit - PROFILE_HISTOGRAM_SUB_BUCKET_BITS);
+}
+
+const u32 MAX_PROFILE_BLOCK_COUNT = 4096;
+// Groups past the capacity share the last bit of the mask, they can only be switched together.
+const u32 MAX_PROFILE_GROUP_COUNT = 64;
+// Blocks registered past the capacity all share the last slot, see Profiler::RegisterBlock.
+const u32 PROFILE_BLOCK_OVERFLOW = MAX_PROFILE_BLOCK_COUNT - 1;
+
+/**
+ * @brief Work a block declares per hit when the plain byte count is not enough. Bytes read and written are
+ *        compared against the measured peak of the matching kind, FLOPs give the arithmetic intensity.
+ */
+struct ProfileWork
+{
+	u64 readByteCount;
+	u64 writeByteCount;
+	u64 flopCount;
+};
 
 struct ProfilerBlockInfo
 {
@@ -107,93 +365,458 @@ struct ProfilerBlockInfo
 	u64 elapsedTimeExclusive;
 	u64 elapsedTimeInclusive;
 	u64 hitCount;
+	// Every byte the block touched, either the plain byte count or the reads plus the writes of its ProfileWork.
 	u64 processedByteCount;
+	u64 readByteCount;
+	u64 writeByteCount;
+	u64 flopCount;
+
+	// NOTE(Umut): Hit counts the calibrated overhead is scaled by. Exclusive time carries one block's inside
+	// overhead per hit and one outside overhead per direct child hit. Inclusive time, like elapsedTimeInclusive,
+	// only counts the outermost hits of a recursive block plus every block that closed inside them.
+	u64 childHitCount;
+	u64 inclusiveHitCount;
+	u64 inclusiveDescendantHitCount;
+
+#if PROFILER_PERF_COUNTERS
+	// Hardware counter totals over the inclusive interval, kept recursion safe the same way.
+	u64 perfCountsInclusive[PERF_COUNTER_COUNT];
+#endif
+
+#if PROFILER_OS_COUNTERS
+	// Same for faults, context switches and the resident set change, which can wrap below zero.
+	u64 osCountsInclusive[OS_COUNTER_COUNT];
+#endif
+
+#if PROFILER_HISTOGRAMS
+	// Slowest and fastest single hit. The minimum is kept inverted so a zeroed entry needs no special case.
+	u64 maxHitTime;
+	u64 invertedMinHitTime;
+	u32 hitHistogram[PROFILE_HISTOGRAM_BUCKET_COUNT];
+#endif
 };
 
-// NOTE(Umut): Block name can be even retrieved as template parameter.
-template <SourceLocationInfo S>
+/* NOTE(Umut): Besides the per-block totals every thread keeps one node per call path, keyed by the parent path
+   and the block, so a block called from several places is timed separately for each caller. Parents are
+   always created before their children, and a path's inclusive time is the sum of the exclusive times under
+   it, so nodes only store exclusive time and hits. Once the table is full new paths go to the overflow node. */
+const u32 MAX_PROFILE_PATH_COUNT = 4096;
+const u32 PROFILE_PATH_SLOT_BITS = 13;
+const u32 PROFILE_PATH_SLOT_COUNT = 1u << PROFILE_PATH_SLOT_BITS;
+const u32 PROFILE_PATH_OVERFLOW = 1;
+
+struct ProfilerPathInfo
+{
+	u64 elapsedTimeExclusive;
+	u64 hitCount;
+	u32 parentPath;
+	u32 blockIndex;
+};
+
+/* NOTE(Umut): With PROFILER_SAMPLING every profiled thread gets a timer on its own CPU time. The signal
+   handler runs on that thread, so it appends the interrupted instruction pointer and the innermost open
+   block to the thread's buffer without any locking. A full buffer drops further samples. */
+const u32 MAX_PROFILER_SAMPLE_COUNT = 1u << 16;
+
+struct ProfilerSample
+{
+	u64 instructionPointer;
+	u32 blockIndex;
+};
+
+/* NOTE(Umut): With PROFILER_TRACE every block open and close is also logged to a per-thread ring for a
+   timeline export. Records are fixed size and the ring is a power of two records long, so the write position
+   is a single mask and a record never straddles the wrap. A full ring overwrites its oldest records, the
+   export keeps the most recent window. */
+const u64 PROFILER_TRACE_RING_SIZE = 1ull << 18;
+
+struct ProfilerTraceEvent
+{
+	u64 time;
+	u32 blockIndex;
+	u32 isEnd;
+};
+
+/* NOTE(Umut): With PROFILER_LIVE the publisher thread reads name, hitCount, elapsedTimeInclusive, processedByteCount
+   and parentBlockIndex while their thread updates them, so both sides go through relaxed atomics. Only the owning
+   thread writes, a relaxed load and store is enough for an increment and is a plain move on x86. Without
+   PROFILER_LIVE nothing reads them concurrently and they stay plain accesses. */
+template <typename T>
+inline T LoadLiveField(const T& value)
+{
+#if PROFILER_LIVE
+	return std::atomic_ref<T>(const_cast<T&>(value)).load(std::memory_order_relaxed);
+#else
+	return value;
+#endif
+}
+
+template <typename T>
+inline void StoreLiveField(T& value, const T newValue)
+{
+#if PROFILER_LIVE
+	std::atomic_ref<T>(value).store(newValue, std::memory_order_relaxed);
+#else
+	value = newValue;
+#endif
+}
+
+/* NOTE(Umut): Every thread that opens a block gets its own table and parent index, so the hot path never
+   shares a cache line or needs a read-modify-write atomic. Tables are owned by the profiler and outlive their
+   threads, PrintBlocks merges them and has to be called once the worker threads are done. */
+struct ProfilerThreadState
+{
+	ProfilerBlockInfo blocks[MAX_PROFILE_BLOCK_COUNT] = {};
+	// Blocks closed on this thread so far, the difference over a block's scope is its descendant count.
+	u64 closedBlockCount = 0;
+	u32 parentBlockIndex = 0;
+	u32 threadIndex = 0;
+
+	// Path 0 is the root, PROFILE_PATH_OVERFLOW takes every path that did not fit.
+	ProfilerPathInfo paths[MAX_PROFILE_PATH_COUNT] = {};
+	u32 pathSlots[PROFILE_PATH_SLOT_COUNT] = {};
+	u32 pathCount = PROFILE_PATH_OVERFLOW + 1;
+	u32 currentPath = 0;
+
+#if PROFILER_PERF_COUNTERS
+	PerfCounterSet perfCounters;
+#endif
+
+	u32 GetChildPath(const u32 blockIndex)
+	{
+		// NOTE(Umut): Open addressing with twice the slots of the path table, a probe always ends on a match or an empty slot.
+		const u32 key = currentPath * MAX_PROFILE_BLOCK_COUNT + blockIndex;
+		for (u32 slot = (key * 2654435761u) >> (32 - PROFILE_PATH_SLOT_BITS);; slot = (slot + 1) & (PROFILE_PATH_SLOT_COUNT - 1)) {
+			const u32 path = pathSlots[slot];
+			if (!path) {
+				if (pathCount == MAX_PROFILE_PATH_COUNT) {
+					return PROFILE_PATH_OVERFLOW;
+				}
+
+				paths[pathCount].parentPath = currentPath;
+				paths[pathCount].blockIndex = blockIndex;
+				pathSlots[slot] = pathCount;
+				return pathCount++;
+			}
+
+			if ((paths[path].parentPath == currentPath) && (paths[path].blockIndex == blockIndex)) {
+				return path;
+			}
+		}
+	}
+
+#if PROFILER_SAMPLING
+	std::unique_ptr<ProfilerSample[]> samples = std::make_unique<ProfilerSample[]>(MAX_PROFILER_SAMPLE_COUNT);
+	u64 sampleCount = 0;
+	timer_t sampleTimer = {};
+	bool hasSampleTimer = false;
+#endif
+
+#if PROFILER_TRACE
+	std::unique_ptr<ProfilerTraceEvent[]> traceEvents = std::make_unique<ProfilerTraceEvent[]>(PROFILER_TRACE_RING_SIZE);
+	u64 traceEventCount = 0;
+
+	void AddTraceEvent(const u64 time, const u32 blockIndex, const u32 isEnd)
+	{
+		traceEvents[traceEventCount++ & (PROFILER_TRACE_RING_SIZE - 1)] = { time, blockIndex, isEnd };
+	}
+#endif
+};
+
+class Profiler
+{
+#if PROFILER
+	template <SourceLocationInfo S, ProfileGroupName G>
+	friend class ProfileBlock;
+#endif
+
+public:
+	static void Begin();
+	static void End();
+
+	/**
+	 * @brief Only let blocks of the listed groups record from now on, blocks already open finish as they began.
+	 *
+	 * @groupNames Comma separated group names, "all" or "none".
+	 */
+	static void EnableGroups(const char* groupNames);
+
+	static void PrintBlocks();
+
+	/**
+	 * @brief Run the workload runCount times, snapshotting every block's inclusive time after each run so
+	 *        PrintBlocks can show how much a block moves from run to run. Call it outside of any profile block,
+	 *        a block still open at a snapshot only reports its time once it closes.
+	 */
+	template <typename Workload>
+	static void Repeat(const u32 runCount, Workload&& workload)
+	{
+		for (u32 run = 0; run < runCount; ++run) {
+			const u64 runBeginTime = ProfilerTimer::Read();
+			workload();
+			EndRun(runBeginTime);
+		}
+	}
+
+	/**
+	 * @brief Write the call tree in the collapsed stack format flame graph tools read, one "parent;child <ticks>"
+	 *        line per path with its overhead corrected exclusive time.
+	 */
+	static bool WriteCollapsedStacks(const char* fileName);
+
+	/**
+	 * @brief Write the trace rings as Chrome trace event JSON, loadable in Perfetto or chrome://tracing.
+	 *        Does nothing unless built with PROFILER_TRACE. Like PrintBlocks, the worker threads have to be done.
+	 */
+	static bool WriteTrace(const char* fileName);
+
+	/**
+	 * @brief Write every block's statistics with the run metadata (CPU, timer, build flags, dataset) as JSON,
+	 *        the format CompareProfiles reads back. Like PrintBlocks, the worker threads have to be done.
+	 */
+	static bool WriteProfileJson(const char* fileName, const char* datasetName);
+
+	/**
+	 * @brief Same statistics as WriteProfileJson, one row per block, the metadata on leading "#" lines.
+	 */
+	static bool WriteProfileCsv(const char* fileName, const char* datasetName);
+
+private:
+	static u32 RegisterBlock();
+	static u64 RegisterGroup(const char* groupName);
+
+	/**
+	 * @brief Table of the calling thread when a block of the group should record, nullptr when its group is off.
+	 */
+	static ProfilerThreadState* GetRecordingThreadState(const u64 groupMask)
+	{
+#if PROFILER_RUNTIME_TOGGLE
+		if (!(enabledGroups.load(std::memory_order_relaxed) & groupMask)) {
+			return nullptr;
+		}
+#else
+		(void)groupMask;
+#endif
+		return &GetThreadState();
+	}
+
+	static ProfilerThreadState& GetThreadState()
+	{
+		if (!threadState) {
+			threadState = RegisterThread();
+		}
+
+		return *threadState;
+	}
+
+	static ProfilerThreadState* RegisterThread();
+
+	static void CalibrateOverhead();
+
+	static void EndRun(const u64 runBeginTime);
+
+	static void StartSampling();
+	static void StopSampling();
+	static void StartThreadSampling(ProfilerThreadState& state);
+
+	static void StartLiveSnapshots();
+	static void StopLiveSnapshots();
+
+	static void StartGroupToggleSignal();
+
+private:
+	static u64 beginCpuTime;
+	static u64 endCpuTime;
+
+	static inline thread_local ProfilerThreadState* threadState = nullptr;
+
+	// NOTE(Umut): Atomic only so the signal handler may flip it, a relaxed load is a plain load.
+	static inline std::atomic<u64> enabledGroups = ~0ull;
+	// What SIGUSR1 turns back on, the groups last enabled or every group if that was none.
+	static inline std::atomic<u64> toggledGroups = ~0ull;
+};
+
+#if PROFILER
+
+/* NOTE(Umut): Every source location is its own ProfileBlock type, and its slot is an inline static assigned
+   while globals are initialized, before main. The hot path reads it like any other global, no guard. The
+   name is only known at the call site, so each entry stores it in the thread's own table, on the line
+   that is written anyway. */
+template <SourceLocationInfo S, ProfileGroupName G>
 class ProfileBlock
 {
 public:
 
 	ProfileBlock(const char* blockName, const u64 byteCount = 0)
-		: beginCpuTime(TimerFunc())
-		, parentBlockIndex(Profiler::parentBlockIndex)
-		, elapsedTimeInclusive(Profiler::blocks[blockIndex].elapsedTimeInclusive)
+		: threadState(Profiler::GetRecordingThreadState(groupMask))
 	{
-		static const Runner initialTask{ [&blockName]() {
-			blockIndex = Profiler::GetNewIndex();
-			Profiler::blocks[blockIndex].name = blockName;
-		}};
+#if PROFILER_RUNTIME_TOGGLE
+		if (!threadState) {
+			return;
+		}
+#endif
+		Open(blockName, byteCount);
+	}
 
-		Profiler::blocks[blockIndex].processedByteCount += byteCount;
-		Profiler::parentBlockIndex = blockIndex;
+	ProfileBlock(const char* blockName, const ProfileWork& work)
+		: threadState(Profiler::GetRecordingThreadState(groupMask))
+	{
+#if PROFILER_RUNTIME_TOGGLE
+		if (!threadState) {
+			return;
+		}
+#endif
+		ProfilerBlockInfo& block(threadState->blocks[blockIndex]);
+		block.readByteCount += work.readByteCount;
+		block.writeByteCount += work.writeByteCount;
+		block.flopCount += work.flopCount;
+		Open(blockName, work.readByteCount + work.writeByteCount);
 	}
 
 	~ProfileBlock()
 	{
-		const u64 elapsedTime = TimerFunc() - beginCpuTime;
-		ProfilerBlockInfo& block(Profiler::blocks[blockIndex]);
-		++block.hitCount;
+#if PROFILER_RUNTIME_TOGGLE
+		if (!threadState) {
+			return;
+		}
+#endif
+		const u64 endCpuTime = ProfilerTimer::ReadEnd();
+		const u64 elapsedTime = endCpuTime - beginCpuTime;
+#if PROFILER_TRACE
+		threadState->AddTraceEvent(endCpuTime, blockIndex, 1);
+#endif
+#if PROFILER_PERF_COUNTERS
+		u64 endPerfCounts[PERF_COUNTER_COUNT];
+		threadState->perfCounters.Read(endPerfCounts);
+#endif
+#if PROFILER_OS_COUNTERS
+		u64 endOsCounts[OS_COUNTER_COUNT];
+		ReadOsCounters(endOsCounts);
+#endif
+		ProfilerBlockInfo& block(threadState->blocks[blockIndex]);
+		StoreLiveField(block.hitCount, LoadLiveField(block.hitCount) + 1);
 		block.elapsedTimeExclusive += elapsedTime;
-		block.elapsedTimeInclusive = elapsedTimeInclusive + elapsedTime;
+		StoreLiveField(block.elapsedTimeInclusive, elapsedTimeInclusive + elapsedTime);
+		block.inclusiveHitCount = inclusiveHitCount + 1;
+		block.inclusiveDescendantHitCount = inclusiveDescendantHitCount + (threadState->closedBlockCount - beginClosedBlockCount);
+#if PROFILER_PERF_COUNTERS
+		for (u32 i = 0; i < PERF_COUNTER_COUNT; ++i) {
+			block.perfCountsInclusive[i] = perfCountsInclusive[i] + (endPerfCounts[i] - beginPerfCounts[i]);
+		}
+#endif
+#if PROFILER_OS_COUNTERS
+		for (u32 i = 0; i < OS_COUNTER_COUNT; ++i) {
+			block.osCountsInclusive[i] = osCountsInclusive[i] + (endOsCounts[i] - beginOsCounts[i]);
+		}
+#endif
+#if PROFILER_HISTOGRAMS
+		++block.hitHistogram[GetHistogramBucket(elapsedTime)];
+		block.maxHitTime = (elapsedTime > block.maxHitTime) ? elapsedTime : block.maxHitTime;
+		block.invertedMinHitTime = (~elapsedTime > block.invertedMinHitTime) ? ~elapsedTime : block.invertedMinHitTime;
+#endif
 
-		Profiler::blocks[parentBlockIndex].elapsedTimeExclusive -= elapsedTime;
-		Profiler::parentBlockIndex = parentBlockIndex;
+		ProfilerBlockInfo& parent(threadState->blocks[parentBlockIndex]);
+		parent.elapsedTimeExclusive -= elapsedTime;
+		++parent.childHitCount;
+
+		StoreLiveField(threadState->parentBlockIndex, parentBlockIndex);
+		++threadState->closedBlockCount;
+
+		ProfilerPathInfo& path(threadState->paths[pathIndex]);
+		++path.hitCount;
+		path.elapsedTimeExclusive += elapsedTime;
+		threadState->paths[parentPathIndex].elapsedTimeExclusive -= elapsedTime;
+		threadState->currentPath = parentPathIndex;
 	}
 
 private:
+	void Open(const char* blockName, const u64 byteCount)
+	{
+		ProfilerBlockInfo& block(threadState->blocks[blockIndex]);
+		StoreLiveField(block.name, blockName);
+		parentBlockIndex = LoadLiveField(threadState->parentBlockIndex);
+		elapsedTimeInclusive = LoadLiveField(block.elapsedTimeInclusive);
+		inclusiveHitCount = block.inclusiveHitCount;
+		inclusiveDescendantHitCount = block.inclusiveDescendantHitCount;
+		beginClosedBlockCount = threadState->closedBlockCount;
+
+		StoreLiveField(block.processedByteCount, LoadLiveField(block.processedByteCount) + byteCount);
+		StoreLiveField(threadState->parentBlockIndex, blockIndex);
+
+		parentPathIndex = threadState->currentPath;
+		pathIndex = threadState->GetChildPath(blockIndex);
+		threadState->currentPath = pathIndex;
+
+#if PROFILER_PERF_COUNTERS
+		for (u32 i = 0; i < PERF_COUNTER_COUNT; ++i) {
+			perfCountsInclusive[i] = block.perfCountsInclusive[i];
+		}
+		threadState->perfCounters.Read(beginPerfCounts);
+#endif
+#if PROFILER_OS_COUNTERS
+		for (u32 i = 0; i < OS_COUNTER_COUNT; ++i) {
+			osCountsInclusive[i] = block.osCountsInclusive[i];
+		}
+		ReadOsCounters(beginOsCounts);
+#endif
+
+		beginCpuTime = ProfilerTimer::ReadBegin();
+#if PROFILER_TRACE
+		threadState->AddTraceEvent(beginCpuTime, blockIndex, 0);
+#endif
+	}
+
+private:
+	// Null while the block's group is disabled, set once when it opens so a toggle can't leave it half recorded.
+	ProfilerThreadState* threadState;
+
 	u64 beginCpuTime;
 	u64 elapsedTimeInclusive;
+	u64 inclusiveHitCount;
+	u64 inclusiveDescendantHitCount;
+	u64 beginClosedBlockCount;
+#if PROFILER_PERF_COUNTERS
+	u64 perfCountsInclusive[PERF_COUNTER_COUNT];
+	u64 beginPerfCounts[PERF_COUNTER_COUNT];
+#endif
+#if PROFILER_OS_COUNTERS
+	u64 osCountsInclusive[OS_COUNTER_COUNT];
+	u64 beginOsCounts[OS_COUNTER_COUNT];
+#endif
 
 	u32 parentBlockIndex;
-	static u32 blockIndex;
+	u32 pathIndex;
+	u32 parentPathIndex;
+	static inline const u32 blockIndex = Profiler::RegisterBlock();
+#if PROFILER_RUNTIME_TOGGLE
+	static inline const u64 groupMask = Profiler::RegisterGroup(G.name);
+#else
+	static constexpr u64 groupMask = ~0ull;
+#endif
 };
 
-template <SourceLocationInfo S>
-u32 ProfileBlock<S>::blockIndex = 0;
-
 /**
  * @brief Generate a profile block that profiles CPU and bandwith during its scope.
  *
  * @blockName Name of the block.
  * @byteCount Number of bytes used (to measure bandwith).
  */
-template<SubStringInfo S, SourceLocationInfo<S> A>
+template<SubStringInfo S, SourceLocationInfo<S> A, ProfileGroupName G>
 constexpr auto GetProfileBlock(const char* blockName, const u64 byteCount = 0)
 {
-	return ProfileBlock<A>(blockName, byteCount);
+	return ProfileBlock<A, G>(blockName, byteCount);
 }
 
-#else
-#define PROFILE_BLOCK(...)
-#define PROFILE_BLOCK_FUNCTION PROFILE_BLOCK(...)
-
-struct SourceLocationInfo{};
-struct ProfilerBlockInfo{};
-
-#endif
-
-
-class Profiler
+/**
+ * @brief Same, with separate read and write byte counts and the FLOPs the block does, for the roofline report.
+ *
+ * @blockName Name of the block.
+ * @work Bytes read, bytes written and FLOPs of this hit.
+ */
+template<SubStringInfo S, SourceLocationInfo<S> A, ProfileGroupName G>
+constexpr auto GetProfileBlock(const char* blockName, const ProfileWork& work)
 {
-	template <SourceLocationInfo S>
-	friend class ProfileBlock;
-
-public:
-	static void Begin();
-	static void End();
-
-	static void PrintBlocks();
-
-private:
-	static u32 GetNewIndex();
-
-private:
-	static ProfilerBlockInfo blocks[4096];
-	static u64 beginCpuTime;
-	static u64 endCpuTime;
+	return ProfileBlock<A, G>(blockName, work);
+}
 
-	static u32 indexCounter;
-	static u32 parentBlockIndex;
-};
\ No newline at end of file
+#endif
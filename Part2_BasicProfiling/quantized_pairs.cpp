@@ -0,0 +1,103 @@
+#include "quantized_pairs.h"
+
+#include "haversine.h"
+#include "output_file.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+// NOTE(Umut): Pairs are pulled and quantized this many at a time, each column chunk is written straight to
+// its offset in the file so no column sized buffer is ever needed.
+const u64 WRITE_CHUNK_SIZE = 64 * 1024;
+
+f64 WriteQuantizedPairs(const std::vector<HaversinePair>& pairs, const char* fileName)
+{
+	return WriteQuantizedPairs(pairs.size(), [&pairs](const u64 firstPairIndex, std::span<HaversinePair> pairsOut) {
+		std::copy_n(pairs.begin() + firstPairIndex, pairsOut.size(), pairsOut.begin());
+	}, fileName);
+}
+
+f64 WriteQuantizedPairs(const u64 pairCount, const PairSource& source, const char* fileName)
+{
+	OutputFile file = OpenOutputFile(fileName);
+	if (!IsValid(file)) {
+		return -1.0;
+	}
+
+	QuantizedPairsHeader header = {};
+	memcpy(header.magic, QUANTIZED_PAIRS_MAGIC, sizeof(header.magic));
+	header.columnCount = 4;
+	header.pairCount = pairCount;
+	bool written = WriteAt(file, 0, &header, sizeof(header));
+
+	std::vector<HaversinePair> pairs(WRITE_CHUNK_SIZE);
+	std::vector<s32> chunk(WRITE_CHUNK_SIZE);
+	f64 maxError = 0.0;
+
+	for (u64 start = 0; (start < pairCount) && written; start += WRITE_CHUNK_SIZE) {
+		const u64 count = (pairCount - start < WRITE_CHUNK_SIZE) ? (pairCount - start) : WRITE_CHUNK_SIZE;
+		source(start, { pairs.data(), count });
+
+		for (u32 column = 0; column < header.columnCount; ++column) {
+			const f64 scale = (column % 2) ? QUANTIZED_LAT_SCALE : QUANTIZED_LON_SCALE;
+			for (u64 i = 0; i < count; ++i) {
+				const Point& point = (column < 2) ? pairs[i].p0 : pairs[i].p1;
+				const f64 degrees = (column % 2) ? point.y : point.x;
+
+				chunk[i] = QuantizeCoordinate(degrees, scale);
+
+				const f64 error = fabs(DequantizeCoordinate(chunk[i], scale) - degrees);
+				maxError = (error > maxError) ? error : maxError;
+			}
+
+			const u64 offset = sizeof(header) + (column * pairCount + start) * sizeof(s32);
+			written = written && WriteAt(file, offset, chunk.data(), count * sizeof(s32));
+		}
+	}
+
+	CloseOutputFile(file);
+
+	return written ? maxError : -1.0;
+}
+
+QuantizedPairs MapQuantizedPairs(const char* fileName)
+{
+	QuantizedPairs result = {};
+
+	MappedFile file = MapFileReadOnly(fileName);
+	if (!IsValid(file)) {
+		return result;
+	}
+
+	QuantizedPairsHeader header;
+	if (file.size < sizeof(header)) {
+		UnmapFile(file);
+		return result;
+	}
+
+	memcpy(&header, file.data, sizeof(header));
+	const u64 columnSize = header.pairCount * sizeof(s32);
+	if (memcmp(header.magic, QUANTIZED_PAIRS_MAGIC, sizeof(header.magic)) || (header.columnCount != 4) ||
+		(file.size != sizeof(header) + header.columnCount * columnSize)) {
+		fprintf(stderr, "ERROR: %s is not a quantized pair file\n", fileName);
+		UnmapFile(file);
+		return result;
+	}
+
+	const s32* columns = reinterpret_cast<const s32*>(file.data + sizeof(header));
+	result.x0 = { columns + 0 * header.pairCount, header.pairCount };
+	result.y0 = { columns + 1 * header.pairCount, header.pairCount };
+	result.x1 = { columns + 2 * header.pairCount, header.pairCount };
+	result.y1 = { columns + 3 * header.pairCount, header.pairCount };
+	result.file = file;
+
+	return result;
+}
+
+void UnmapQuantizedPairs(QuantizedPairs& pairs)
+{
+	UnmapFile(pairs.file);
+	pairs = QuantizedPairs{};
+}
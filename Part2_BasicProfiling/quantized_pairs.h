@@ -0,0 +1,73 @@
+#pragma once
+
+#include <functional>
+#include <span>
+#include <vector>
+
+#include "basedef.h"
+#include "mapped_file.h"
+
+struct HaversinePair;
+
+/* NOTE(Umut): Compact pair format, 16 bytes per pair instead of 32. Every coordinate is an s32 fixed
+   point value covering [-180, 180) for longitudes and [-90, 90) for latitudes, which is a resolution of
+   ~8.4e-8 degrees (~1cm on the equator). The file is a QuantizedPairsHeader followed by the x0, y0, x1
+   and y1 columns, each pairCount values long, so the kernels can load them straight into registers. */
+const f64 QUANTIZED_LON_SCALE = 180.0 / 2147483648.0;
+const f64 QUANTIZED_LAT_SCALE = 90.0 / 2147483648.0;
+
+const char QUANTIZED_PAIRS_MAGIC[4] = { 'H', 'V', 'Q', '1' };
+
+struct QuantizedPairsHeader
+{
+	char magic[4];
+	u32 columnCount;
+	u64 pairCount;
+};
+
+struct QuantizedPairs
+{
+	std::span<const s32> x0;
+	std::span<const s32> y0;
+	std::span<const s32> x1;
+	std::span<const s32> y1;
+
+	MappedFile file;
+};
+
+inline s32 QuantizeCoordinate(const f64 degrees, const f64 scale)
+{
+	const f64 scaled = degrees / scale;
+	const f64 rounded = (scaled < 0.0) ? (scaled - 0.5) : (scaled + 0.5);
+	if (rounded >= 2147483647.0) {
+		return 2147483647;
+	}
+
+	if (rounded <= -2147483648.0) {
+		return -2147483647 - 1;
+	}
+
+	return static_cast<s32>(rounded);
+}
+
+inline f64 DequantizeCoordinate(const s32 value, const f64 scale)
+{
+	return static_cast<f64>(value) * scale;
+}
+
+// NOTE(Umut): Fills pairsOut with the pairs starting at firstPairIndex, lets the writer pull pairs in chunks.
+using PairSource = std::function<void(u64 firstPairIndex, std::span<HaversinePair> pairsOut)>;
+
+/**
+ * @brief Write pairs in the quantized format. Returns the largest coordinate rounding error in degrees,
+ *        or a negative value if the file could not be written.
+ */
+f64 WriteQuantizedPairs(const std::vector<HaversinePair>& pairs, const char* fileName);
+
+/**
+ * @brief Same, pulling pairCount pairs from source one chunk at a time, so memory use does not depend on the pair count.
+ */
+f64 WriteQuantizedPairs(const u64 pairCount, const PairSource& source, const char* fileName);
+
+QuantizedPairs MapQuantizedPairs(const char* fileName);
+void UnmapQuantizedPairs(QuantizedPairs& pairs);
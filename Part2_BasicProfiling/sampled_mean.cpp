@@ -0,0 +1,245 @@
+#include "sampled_mean.h"
+
+#include "haversine.h"
+#include "profiler.h"
+
+#include <assert.h>
+#include <math.h>
+#include <numeric>
+#include <random>
+#include <vector>
+
+/* NOTE(Umut): Visits every block of a stratum exactly once in a scrambled order without storing a
+   permutation: i -> (multiplier * i + offset) mod count is a bijection whenever gcd(multiplier, count) == 1. */
+struct BlockPermutation
+{
+	u64 count = 0;
+	u64 multiplier = 1;
+	u64 offset = 0;
+	u64 next = 0;
+};
+
+struct Stratum
+{
+	u64 firstPair = 0;
+	u64 pairCount = 0;
+	u64 blockCount = 0;
+	f64 weight = 0;
+
+	BlockPermutation permutation;
+
+	// NOTE(Umut): The stratum mean is estimated as sampledSum / sampledPairCount, a ratio estimator, so a
+	// short last block only counts for the pairs it has.
+	u64 sampledBlockCount = 0;
+	u64 sampledPairCount = 0;
+	f64 sampledSum = 0;
+
+	// Weighted Welford running statistics over the sampled block means, every block weighted by its pair count squared.
+	f64 squaredWeightSum = 0;
+	f64 squaredWeightedMean = 0;
+	f64 m2 = 0;
+
+	// W_h * S_h of the current round, what its Neyman allocation is proportional to.
+	f64 allocationWeight = 0;
+};
+
+static BlockPermutation CreateBlockPermutation(const u64 count, std::mt19937_64& generator)
+{
+	// NOTE(Umut): Multiplier and index both stay below 2^32 so their product cannot overflow.
+	assert(count < (1ull << 32));
+
+	BlockPermutation result;
+	result.count = count;
+	if (count <= 1) {
+		return result;
+	}
+
+	std::uniform_int_distribution<u64> dist(1, count - 1);
+	result.offset = dist(generator);
+	do {
+		result.multiplier = dist(generator);
+	} while (std::gcd(result.multiplier, count) != 1);
+
+	return result;
+}
+
+static u64 NextBlock(BlockPermutation& permutation)
+{
+	assert(permutation.next < permutation.count);
+	return (permutation.multiplier * permutation.next++ + permutation.offset) % permutation.count;
+}
+
+static void SampleBlock(Stratum& stratum, std::span<const HaversinePair> pairs, const u64 blockSize, SampledMeanResult& result)
+{
+	const u64 blockIdx = NextBlock(stratum.permutation);
+	const u64 start = blockIdx * blockSize;
+	const u64 count = (stratum.pairCount - start < blockSize) ? (stratum.pairCount - start) : blockSize;
+
+	const f64 blockSum = HaversineSum(pairs.subspan(stratum.firstPair + start, count));
+	const f64 blockMean = blockSum / static_cast<f64>(count);
+
+	++stratum.sampledBlockCount;
+	stratum.sampledPairCount += count;
+	stratum.sampledSum += blockSum;
+
+	const f64 weight = static_cast<f64>(count) * static_cast<f64>(count);
+	stratum.squaredWeightSum += weight;
+	const f64 delta = blockMean - stratum.squaredWeightedMean;
+	stratum.squaredWeightedMean += delta * weight / stratum.squaredWeightSum;
+	stratum.m2 += weight * delta * (blockMean - stratum.squaredWeightedMean);
+
+	result.sampledPairCount += count;
+	++result.sampledBlockCount;
+}
+
+static f64 GetStratumMean(const Stratum& stratum)
+{
+	return stratum.sampledPairCount ? (stratum.sampledSum / static_cast<f64>(stratum.sampledPairCount)) : 0.0;
+}
+
+/**
+ * @brief Sample variance of the block residuals sum - mean * count of the ratio estimator, divided by the
+ *        squared average pair count of a block, 0 with fewer than two blocks.
+ */
+static f64 GetBlockVariance(const Stratum& stratum)
+{
+	if (stratum.sampledBlockCount < 2) {
+		return 0.0;
+	}
+
+	// NOTE(Umut): Residual of a block is count * (blockMean - mean). Summed squared, that is the m2 around the
+	// squared weighted mean plus the shift from there to the ratio mean.
+	const f64 shift = stratum.squaredWeightedMean - GetStratumMean(stratum);
+	const f64 residualSquareSum = stratum.m2 + stratum.squaredWeightSum * shift * shift;
+
+	const f64 n = static_cast<f64>(stratum.sampledBlockCount);
+	const f64 averageBlockPairCount = static_cast<f64>(stratum.pairCount) / static_cast<f64>(stratum.blockCount);
+	return residualSquareSum / (n - 1.0) / (averageBlockPairCount * averageBlockPairCount);
+}
+
+static f64 GetStratumVariance(const Stratum& stratum)
+{
+	if (stratum.sampledBlockCount == stratum.blockCount) {
+		return 0.0;
+	}
+
+	const f64 n = static_cast<f64>(stratum.sampledBlockCount);
+	const f64 finitePopulationCorrection = 1.0 - n / static_cast<f64>(stratum.blockCount);
+	return GetBlockVariance(stratum) / n * finitePopulationCorrection;
+}
+
+SampledMeanResult ComputeSampledMean(std::span<const HaversinePair> pairs, const SampledMeanParameters& params)
+{
+	SampledMeanResult result;
+	if (pairs.empty()) {
+		return result;
+	}
+
+	PROFILE_BLOCK_FUNCTION();
+
+	std::mt19937_64 generator(params.seed);
+
+	const u64 blockSize = params.blockSize ? params.blockSize : 1;
+	const u64 strataCount = (params.mode == SamplingMode::Random) ? 1 : (params.strataCount ? params.strataCount : 1);
+
+	std::vector<Stratum> strata(strataCount);
+	const u64 stratumPairCount = pairs.size() / strataCount;
+	for (u64 i = 0; i < strataCount; ++i) {
+		Stratum& stratum = strata[i];
+		stratum.firstPair = i * stratumPairCount;
+		stratum.pairCount = (i == strataCount - 1) ? (pairs.size() - stratum.firstPair) : stratumPairCount;
+		stratum.blockCount = (stratum.pairCount + blockSize - 1) / blockSize;
+		stratum.weight = static_cast<f64>(stratum.pairCount) / static_cast<f64>(pairs.size());
+		stratum.permutation = CreateBlockPermutation(stratum.blockCount, generator);
+	}
+
+	for (Stratum& stratum : strata) {
+		// NOTE(Umut): At least two blocks per stratum, a single sample has no variance estimate.
+		const u64 minimumCount = (params.initialBlocksPerStratum < 2) ? 2 : params.initialBlocksPerStratum;
+		const u64 initialCount = (stratum.blockCount < minimumCount) ? stratum.blockCount : minimumCount;
+		for (u64 i = 0; i < initialCount; ++i) {
+			SampleBlock(stratum, pairs, blockSize, result);
+		}
+	}
+
+	/* NOTE(Umut): Blocks are added in rounds and the interval is only checked between rounds. A round is split
+	   over the strata by Neyman allocation, n_h proportional to W_h * S_h, and sized for the block count n that
+	   allocation needs to reach the target half width t with the current estimates. Including the finite
+	   population correction, A^2 / n - sum(W_h^2 * S_h^2 / N_h) = (t / z)^2 with A = sum(W_h * S_h). Every round
+	   grows the sample by at least an eighth and at most a half, so the checks happen on a geometric schedule
+	   and a noisy early estimate cannot overshoot by much. */
+	while (true) {
+		f64 mean = 0;
+		f64 variance = 0;
+		f64 maxDeviation = 0;
+		f64 openSampledBlockCount = 0;
+		// NOTE(Umut): A stratum whose sampled blocks all agree has no variance estimate yet, not a zero variance.
+		bool isVarianceKnown = true;
+		for (const Stratum& stratum : strata) {
+			const f64 stratumVariance = GetStratumVariance(stratum);
+			mean += stratum.weight * GetStratumMean(stratum);
+			variance += stratum.weight * stratum.weight * stratumVariance;
+			isVarianceKnown &= (stratum.sampledBlockCount == stratum.blockCount) || (stratumVariance > 0.0);
+
+			const f64 deviation = sqrt(GetBlockVariance(stratum));
+			maxDeviation = (deviation > maxDeviation) ? deviation : maxDeviation;
+			if (stratum.sampledBlockCount < stratum.blockCount) {
+				openSampledBlockCount += static_cast<f64>(stratum.sampledBlockCount);
+			}
+		}
+
+		result.mean = mean;
+		result.halfWidth = params.confidenceZ * sqrt(variance);
+		if (isVarianceKnown && (result.halfWidth <= params.targetRelativeError * fabs(mean))) {
+			result.converged = true;
+			break;
+		}
+
+		if (openSampledBlockCount == 0.0) {
+			// Every block was sampled, the mean is exact.
+			f64 sum = 0;
+			for (const Stratum& stratum : strata) {
+				sum += stratum.sampledSum;
+			}
+
+			result.mean = sum / static_cast<f64>(pairs.size());
+			result.halfWidth = 0;
+			result.converged = true;
+			break;
+		}
+
+		// NOTE(Umut): Strata without a variance estimate are allocated as if they had the largest one.
+		maxDeviation = (maxDeviation > 0.0) ? maxDeviation : 1.0;
+		f64 allocationSum = 0;
+		f64 populationTerm = 0;
+		for (Stratum& stratum : strata) {
+			if (stratum.sampledBlockCount < stratum.blockCount) {
+				const f64 deviation = sqrt(GetBlockVariance(stratum));
+				stratum.allocationWeight = stratum.weight * ((deviation > 0.0) ? deviation : maxDeviation);
+				allocationSum += stratum.allocationWeight;
+				populationTerm += stratum.allocationWeight * stratum.allocationWeight / static_cast<f64>(stratum.blockCount);
+			}
+		}
+
+		const f64 targetDeviation = params.targetRelativeError * fabs(mean) / params.confidenceZ;
+		const f64 neededBlockCount = allocationSum * allocationSum / (targetDeviation * targetDeviation + populationTerm);
+		const f64 minBlockCount = openSampledBlockCount * 1.125;
+		const f64 maxBlockCount = openSampledBlockCount * 1.5;
+		const f64 roundBlockCount = (neededBlockCount < minBlockCount) ? minBlockCount : ((neededBlockCount > maxBlockCount) ? maxBlockCount : neededBlockCount);
+
+		// NOTE(Umut): The targets add up to more than what the open strata have, so at least one of them grows.
+		for (Stratum& stratum : strata) {
+			if (stratum.sampledBlockCount == stratum.blockCount) {
+				continue;
+			}
+
+			const u64 targetCount = static_cast<u64>(ceil(roundBlockCount * stratum.allocationWeight / allocationSum));
+			const u64 endCount = (targetCount < stratum.blockCount) ? targetCount : stratum.blockCount;
+			while (stratum.sampledBlockCount < endCount) {
+				SampleBlock(stratum, pairs, blockSize, result);
+			}
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <span>
+
+#include "basedef.h"
+
+struct HaversinePair;
+
+enum class SamplingMode : u8
+{
+	// Blocks are drawn from the whole data set in a pseudo random order.
+	Random,
+	// Data is split into equal contiguous strata (one per generated cluster) and blocks are drawn per stratum,
+	// in proportion to each stratum's weight times its estimated standard deviation (Neyman allocation).
+	Stratified,
+};
+
+struct SampledMeanParameters
+{
+	SamplingMode mode = SamplingMode::Stratified;
+
+	// Stop once the confidence interval half width is below targetRelativeError * |mean|.
+	f64 targetRelativeError = 0.01;
+	// 1.96 for a 95% confidence interval.
+	f64 confidenceZ = 1.96;
+
+	// Contiguous pairs evaluated per sample. 8KB of pairs, long enough for the hardware prefetcher to stream a
+	// randomly placed block, where 64 pair blocks cost more per pair than a full scan.
+	u64 blockSize = 256;
+	u32 strataCount = 32;
+	// Blocks sampled from each stratum before the interval is trusted.
+	u32 initialBlocksPerStratum = 4;
+
+	u64 seed = 0x5eed;
+};
+
+struct SampledMeanResult
+{
+	f64 mean = 0;
+	f64 halfWidth = 0;
+	u64 sampledPairCount = 0;
+	u64 sampledBlockCount = 0;
+	bool converged = false;
+};
+
+/**
+ * @brief Estimate the mean haversine distance from blocks of pairs, sampled in growing rounds until the
+ *        confidence interval is tight enough. Falls back to the exact mean if every block ends up sampled.
+ */
+SampledMeanResult ComputeSampledMean(std::span<const HaversinePair> pairs, const SampledMeanParameters& params);
@@ -0,0 +1,297 @@
+#include "spatial_index.h"
+
+#include "haversine_dispatch.h"
+#include "math_approx.h"
+#include "profiler.h"
+
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include <thread>
+
+// NOTE(Umut): Deep enough for 2^64 leaves, the traversal stacks never hold more than depth + 1 entries.
+const u32 SPATIAL_INDEX_MAX_DEPTH = 64;
+
+struct BuildPoint
+{
+	f64 v[3];
+	u64 pairIndex;
+};
+
+struct NodeRange
+{
+	u64 node;
+	u64 start;
+	u64 end;
+	u32 level;
+	// Squared distance from the query to the node box, only used by the nearest search.
+	f64 boxDistanceSquared;
+};
+
+static u32 GetThreadCount(const SpatialIndexParameters& params)
+{
+	const u32 threadCount = params.threadCount ? params.threadCount : std::thread::hardware_concurrency();
+	return threadCount ? threadCount : 1;
+}
+
+template <typename RangeFunction>
+static void ParallelFor(const u64 count, const u32 threadCount, RangeFunction&& function)
+{
+	const u64 chunkSize = (count + threadCount - 1) / threadCount;
+	std::vector<std::thread> threads;
+	for (u32 i = 1; (i < threadCount) && (i * chunkSize < count); ++i) {
+		const u64 start = i * chunkSize;
+		const u64 end = (count - start < chunkSize) ? count : (start + chunkSize);
+		threads.emplace_back(function, start, end);
+	}
+
+	function(0, (count < chunkSize) ? count : chunkSize);
+
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
+
+static void ComputeBox(const BuildPoint* points, const u64 count, SpatialIndexBox& box)
+{
+	for (u32 axis = 0; axis < 3; ++axis) {
+		box.min[axis] = INFINITY;
+		box.max[axis] = -INFINITY;
+	}
+
+	for (u64 i = 0; i < count; ++i) {
+		for (u32 axis = 0; axis < 3; ++axis) {
+			box.min[axis] = (points[i].v[axis] < box.min[axis]) ? points[i].v[axis] : box.min[axis];
+			box.max[axis] = (points[i].v[axis] > box.max[axis]) ? points[i].v[axis] : box.max[axis];
+		}
+	}
+}
+
+static void BuildNode(BuildPoint* points, SpatialIndex& index, const NodeRange range, const u32 parallelLevels)
+{
+	ComputeBox(points + range.start, range.end - range.start, index.boxes[range.node]);
+	if (range.level == index.depth) {
+		return;
+	}
+
+	// NOTE(Umut): Split on the widest axis so clusters elongated along any direction still produce compact leaves.
+	const SpatialIndexBox& box = index.boxes[range.node];
+	u32 axis = 0;
+	for (u32 i = 1; i < 3; ++i) {
+		axis = ((box.max[i] - box.min[i]) > (box.max[axis] - box.min[axis])) ? i : axis;
+	}
+
+	const u64 mid = range.start + (range.end - range.start) / 2;
+	std::nth_element(points + range.start, points + mid, points + range.end,
+					 [axis](const BuildPoint& a, const BuildPoint& b) { return a.v[axis] < b.v[axis]; });
+
+	const NodeRange left = { 2 * range.node + 1, range.start, mid, range.level + 1, 0.0 };
+	const NodeRange right = { 2 * range.node + 2, mid, range.end, range.level + 1, 0.0 };
+	if (range.level < parallelLevels) {
+		std::thread leftThread(BuildNode, points, std::ref(index), left, parallelLevels);
+		BuildNode(points, index, right, parallelLevels);
+		leftThread.join();
+	}
+	else {
+		BuildNode(points, index, left, parallelLevels);
+		BuildNode(points, index, right, parallelLevels);
+	}
+}
+
+SpatialIndex BuildSpatialIndex(std::span<const HaversinePair> pairs, const SpatialIndexParameters& params)
+{
+	PROFILE_BLOCK_FUNCTION(pairs.size_bytes());
+
+	SpatialIndex index;
+	index.earthRadius = params.earthRadius;
+
+	const u64 count = pairs.size();
+	const u32 threadCount = GetThreadCount(params);
+	u32 leafSize = (params.leafSize < SPATIAL_INDEX_MAX_LEAF_SIZE) ? params.leafSize : SPATIAL_INDEX_MAX_LEAF_SIZE;
+	leafSize = leafSize ? leafSize : 1;
+
+	// NOTE(Umut): Halving splits keep every leaf at most ceil(count / 2^depth) points.
+	while ((index.depth < SPATIAL_INDEX_MAX_DEPTH - 1) && (((count + (1ull << index.depth) - 1) >> index.depth) > leafSize)) {
+		++index.depth;
+	}
+	index.boxes.resize((2ull << index.depth) - 1);
+
+	std::vector<BuildPoint> points(count);
+	ParallelFor(count, threadCount, [&](const u64 start, const u64 end) {
+		for (u64 i = start; i < end; ++i) {
+			const Point& point = (params.endpoint == PairEndpoint::Start) ? pairs[i].p0 : pairs[i].p1;
+			ComputeUnitVector(point, points[i].v[0], points[i].v[1], points[i].v[2]);
+			points[i].pairIndex = i;
+		}
+	});
+
+	u32 parallelLevels = 0;
+	while ((1u << parallelLevels) < threadCount) {
+		++parallelLevels;
+	}
+
+	BuildNode(points.data(), index, { 0, 0, count, 0, 0.0 }, parallelLevels);
+
+	index.points.x.resize(count);
+	index.points.y.resize(count);
+	index.points.z.resize(count);
+	index.pairIndices.resize(count);
+	ParallelFor(count, threadCount, [&](const u64 start, const u64 end) {
+		for (u64 i = start; i < end; ++i) {
+			index.points.x[i] = points[i].v[0];
+			index.points.y[i] = points[i].v[1];
+			index.points.z[i] = points[i].v[2];
+			index.pairIndices[i] = points[i].pairIndex;
+		}
+	});
+
+	return index;
+}
+
+static f64 GetBoxDistanceSquared(const SpatialIndexBox& box, const f64* query)
+{
+	f64 result = 0.0;
+	for (u32 axis = 0; axis < 3; ++axis) {
+		const f64 below = box.min[axis] - query[axis];
+		const f64 above = query[axis] - box.max[axis];
+		const f64 delta = (below > above) ? below : above;
+		result += (delta > 0.0) ? delta * delta : 0.0;
+	}
+
+	// NOTE(Umut): Empty leaves keep the inverted infinite box from ComputeBox and are never visited.
+	return result;
+}
+
+static void ComputeLeafChordSquared(const SpatialIndex& index, const f64* query, const u64 start, const u64 count, f64* out)
+{
+	const HaversineImplInfo& impl = GetActiveHaversineImplInfo();
+	const HaversineImplInfo& scalar = GetHaversineImplInfo(HaversineImpl::Scalar);
+
+	const f64* x = index.points.x.data() + start;
+	const f64* y = index.points.y.data() + start;
+	const f64* z = index.points.z.data() + start;
+
+	const u64 vectorCount = count - (count % impl.laneCount);
+	impl.chordSquared(query[0], query[1], query[2], x, y, z, out, vectorCount);
+	scalar.chordSquared(query[0], query[1], query[2], x + vectorCount, y + vectorCount, z + vectorCount, out + vectorCount, count - vectorCount);
+}
+
+static f64 ChordSquaredToDistance(const f64 chordSquared, const f64 earthRadius)
+{
+	f64 distance = chordSquared;
+	GetHaversineImplInfo(HaversineImpl::Scalar).chordSquaredToDistance(&distance, 1, earthRadius);
+	return distance;
+}
+
+void QueryRadius(const SpatialIndex& index, const Point center, const f64 radius, std::vector<SpatialQueryResult>& resultsOut)
+{
+	resultsOut.clear();
+	if (index.pairIndices.empty() || (radius < 0.0)) {
+		return;
+	}
+
+	f64 query[3];
+	ComputeUnitVector(center, query[0], query[1], query[2]);
+
+	const f64 halfAngle = radius / (2.0 * index.earthRadius);
+	const f64 chord = 2.0 * sin((halfAngle < HALF_PI64) ? halfAngle : HALF_PI64);
+	const f64 maxChordSquared = chord * chord;
+
+	NodeRange stack[SPATIAL_INDEX_MAX_DEPTH + 1];
+	u32 stackSize = 0;
+	stack[stackSize++] = { 0, 0, index.pairIndices.size(), 0, 0.0 };
+
+	f64 chords[SPATIAL_INDEX_MAX_LEAF_SIZE];
+	while (stackSize) {
+		const NodeRange range = stack[--stackSize];
+		if (GetBoxDistanceSquared(index.boxes[range.node], query) > maxChordSquared) {
+			continue;
+		}
+
+		if (range.level < index.depth) {
+			const u64 mid = range.start + (range.end - range.start) / 2;
+			stack[stackSize++] = { 2 * range.node + 2, mid, range.end, range.level + 1, 0.0 };
+			stack[stackSize++] = { 2 * range.node + 1, range.start, mid, range.level + 1, 0.0 };
+			continue;
+		}
+
+		const u64 count = range.end - range.start;
+		assert(count <= SPATIAL_INDEX_MAX_LEAF_SIZE);
+		ComputeLeafChordSquared(index, query, range.start, count, chords);
+		for (u64 i = 0; i < count; ++i) {
+			if (chords[i] <= maxChordSquared) {
+				resultsOut.push_back({ index.pairIndices[range.start + i], ChordSquaredToDistance(chords[i], index.earthRadius) });
+			}
+		}
+	}
+}
+
+struct NearestCandidate
+{
+	f64 chordSquared;
+	u64 position;
+
+	bool operator<(const NearestCandidate& other) const { return chordSquared < other.chordSquared; }
+};
+
+void QueryNearest(const SpatialIndex& index, const Point center, const u32 k, std::vector<SpatialQueryResult>& resultsOut)
+{
+	resultsOut.clear();
+	if (index.pairIndices.empty() || !k) {
+		return;
+	}
+
+	f64 query[3];
+	ComputeUnitVector(center, query[0], query[1], query[2]);
+
+	// NOTE(Umut): Max heap on the squared chord, the root is the candidate the next point has to beat.
+	std::vector<NearestCandidate> heap;
+	heap.reserve(k);
+
+	NodeRange stack[SPATIAL_INDEX_MAX_DEPTH + 1];
+	u32 stackSize = 0;
+	stack[stackSize++] = { 0, 0, index.pairIndices.size(), 0, GetBoxDistanceSquared(index.boxes[0], query) };
+
+	f64 chords[SPATIAL_INDEX_MAX_LEAF_SIZE];
+	while (stackSize) {
+		const NodeRange range = stack[--stackSize];
+		if ((heap.size() == k) && (range.boxDistanceSquared >= heap.front().chordSquared)) {
+			continue;
+		}
+
+		if (range.level < index.depth) {
+			// Push the far child first so the near one is searched first and tightens the bound early.
+			const u64 mid = range.start + (range.end - range.start) / 2;
+			NodeRange left = { 2 * range.node + 1, range.start, mid, range.level + 1, 0.0 };
+			NodeRange right = { 2 * range.node + 2, mid, range.end, range.level + 1, 0.0 };
+			left.boxDistanceSquared = GetBoxDistanceSquared(index.boxes[left.node], query);
+			right.boxDistanceSquared = GetBoxDistanceSquared(index.boxes[right.node], query);
+
+			const bool isLeftNear = left.boxDistanceSquared <= right.boxDistanceSquared;
+			stack[stackSize++] = isLeftNear ? right : left;
+			stack[stackSize++] = isLeftNear ? left : right;
+			continue;
+		}
+
+		const u64 count = range.end - range.start;
+		assert(count <= SPATIAL_INDEX_MAX_LEAF_SIZE);
+		ComputeLeafChordSquared(index, query, range.start, count, chords);
+		for (u64 i = 0; i < count; ++i) {
+			if (heap.size() < k) {
+				heap.push_back({ chords[i], range.start + i });
+				std::push_heap(heap.begin(), heap.end());
+			}
+			else if (chords[i] < heap.front().chordSquared) {
+				std::pop_heap(heap.begin(), heap.end());
+				heap.back() = { chords[i], range.start + i };
+				std::push_heap(heap.begin(), heap.end());
+			}
+		}
+	}
+
+	std::sort_heap(heap.begin(), heap.end());
+	resultsOut.reserve(heap.size());
+	for (const NearestCandidate& candidate : heap) {
+		resultsOut.push_back({ index.pairIndices[candidate.position], ChordSquaredToDistance(candidate.chordSquared, index.earthRadius) });
+	}
+}
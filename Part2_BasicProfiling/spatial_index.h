@@ -0,0 +1,69 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "basedef.h"
+#include "haversine.h"
+#include "distance_matrix.h"
+
+/* NOTE(Umut): Implicit k-d tree over one endpoint of every pair. Points are stored as unit vectors, so
+   boxes never wrap around the date line or degenerate at the poles, and a great circle radius turns into
+   a plain 3D ball of radius chord = 2 * sin(radius / (2 * earthRadius)). The tree is complete: node i has
+   children 2i + 1 and 2i + 2, every split halves its range, so node ranges are recomputed on the way down
+   and only the bounding boxes are stored. Leaves are contiguous runs of the reordered points that the
+   batch haversine kernels scan directly. */
+const u32 SPATIAL_INDEX_MAX_LEAF_SIZE = 128;
+
+enum class PairEndpoint : u8
+{
+	Start,
+	End,
+};
+
+struct SpatialIndexParameters
+{
+	PairEndpoint endpoint = PairEndpoint::Start;
+
+	// Upper bound on the points per leaf, clamped to SPATIAL_INDEX_MAX_LEAF_SIZE.
+	u32 leafSize = 32;
+	// 0 picks std::thread::hardware_concurrency().
+	u32 threadCount = 0;
+
+	f64 earthRadius = EARTH_RADIUS;
+};
+
+struct SpatialIndexBox
+{
+	f64 min[3];
+	f64 max[3];
+};
+
+struct SpatialIndex
+{
+	// Points in tree order, pairIndices maps them back to the input pairs.
+	UnitVectors points;
+	std::vector<u64> pairIndices;
+
+	std::vector<SpatialIndexBox> boxes;
+	u32 depth = 0;
+	f64 earthRadius = EARTH_RADIUS;
+};
+
+struct SpatialQueryResult
+{
+	u64 pairIndex = 0;
+	f64 distance = 0;
+};
+
+SpatialIndex BuildSpatialIndex(std::span<const HaversinePair> pairs, const SpatialIndexParameters& params = {});
+
+/**
+ * @brief Every indexed point within radius (same unit as the index earth radius) of center, in no particular order.
+ */
+void QueryRadius(const SpatialIndex& index, const Point center, const f64 radius, std::vector<SpatialQueryResult>& resultsOut);
+
+/**
+ * @brief The k indexed points closest to center, sorted from the closest.
+ */
+void QueryNearest(const SpatialIndex& index, const Point center, const u32 k, std::vector<SpatialQueryResult>& resultsOut);
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#if _WIN32
+#include <windows.h>
+#endif
+
+#include "basedef.h"
+#include "cpu_features.h"
+
+/* NOTE(Umut): Measuring the TSC against the OS timer takes 100ms, most of a short run. The frequency is
+   taken from CPUID when the CPU reports it (leaf 0x15 crystal ratio, the 0x16 base clock, or the hypervisor
+   timing leaf inside a VM), then from the kernel's tsc_khz, and only measured as a last resort. A measured
+   value is cached on disk keyed by the CPU signature and brand string, so later runs skip the wait. */
+
+inline u64 ReadTscFrequencyFromCpuid()
+{
+	u32 regs[4] = {};
+	ReadCpuid(0, 0, regs);
+	const u32 maxLeaf = regs[0];
+
+	if (maxLeaf >= 0x15) {
+		ReadCpuid(0x15, 0, regs);
+		const u32 denominator = regs[0];
+		const u32 numerator = regs[1];
+		const u32 crystalHz = regs[2];
+		if (denominator && numerator && crystalHz) {
+			return static_cast<u64>(crystalHz) * numerator / denominator;
+		}
+
+		// NOTE(Umut): No crystal clock reported, the base frequency is the nominal TSC rate on these parts.
+		if (denominator && numerator && (maxLeaf >= 0x16)) {
+			ReadCpuid(0x16, 0, regs);
+			if (regs[0] & 0xffff) {
+				return static_cast<u64>(regs[0] & 0xffff) * 1000000;
+			}
+		}
+	}
+
+	ReadCpuid(1, 0, regs);
+	const b32 isHypervisor = !!(regs[2] & (1u << 31));
+	if (isHypervisor) {
+		ReadCpuid(0x40000000, 0, regs);
+		if (regs[0] >= 0x40000010) {
+			ReadCpuid(0x40000010, 0, regs);
+			if (regs[0]) {
+				return static_cast<u64>(regs[0]) * 1000;
+			}
+		}
+	}
+
+	return 0;
+}
+
+inline u64 ReadTscFrequencyFromKernel()
+{
+#if _WIN32
+	return 0;
+#else
+	FILE* file = fopen("/sys/devices/system/cpu/cpu0/tsc_freq_khz", "rb");
+	if (!file) {
+		return 0;
+	}
+
+	unsigned long long khz = 0;
+	const s32 readCount = fscanf(file, "%llu", &khz);
+	fclose(file);
+	return (readCount == 1) ? khz * 1000 : 0;
+#endif
+}
+
+/**
+ * @brief Path of a per-user cache file for values measured on this machine, empty if there is no cache directory.
+ */
+inline std::string GetMachineCachePath(const char* fileName)
+{
+#if _WIN32
+	char directory[MAX_PATH];
+	const DWORD length = GetEnvironmentVariableA("LOCALAPPDATA", directory, MAX_PATH);
+	return (length && (length < MAX_PATH)) ? std::string(directory) + "\\" + fileName : std::string();
+#else
+	if (const char* cacheHome = getenv("XDG_CACHE_HOME")) {
+		return std::string(cacheHome) + "/" + fileName;
+	}
+
+	if (const char* home = getenv("HOME")) {
+		return std::string(home) + "/.cache/" + fileName;
+	}
+
+	return std::string();
+#endif
+}
+
+inline std::string GetTscFrequencyCachePath()
+{
+	return GetMachineCachePath("tsc_frequency.txt");
+}
+
+/**
+ * @brief CPUID signature and brand string, a cached frequency is only trusted on the CPU that measured it.
+ */
+inline std::string GetCpuIdentity()
+{
+	u32 regs[4] = {};
+	ReadCpuid(1, 0, regs);
+
+	char identity[64] = {};
+	snprintf(identity, sizeof(identity), "%08x ", regs[0]);
+
+	ReadCpuid(0x80000000, 0, regs);
+	if (regs[0] >= 0x80000004) {
+		char brand[49] = {};
+		for (u32 i = 0; i < 3; ++i) {
+			ReadCpuid(0x80000002 + i, 0, regs);
+			memcpy(brand + i * 16, regs, 16);
+		}
+
+		return std::string(identity) + brand;
+	}
+
+	return std::string(identity);
+}
+
+inline u64 LoadCachedTscFrequency(const std::string& path, const std::string& identity)
+{
+	FILE* file = nullptr;
+	if (path.empty() || fopen_s(&file, path.c_str(), "rb") || !file) {
+		return 0;
+	}
+
+	char line[128] = {};
+	unsigned long long frequency = 0;
+	const bool valid = fgets(line, sizeof(line), file) && (sscanf(line, "%llu", &frequency) == 1)
+		&& fgets(line, sizeof(line), file) && (identity + "\n" == line);
+	fclose(file);
+
+	return valid ? frequency : 0;
+}
+
+inline void StoreCachedTscFrequency(const std::string& path, const std::string& identity, const u64 frequency)
+{
+	FILE* file = nullptr;
+	if (path.empty() || fopen_s(&file, path.c_str(), "wb") || !file) {
+		return;
+	}
+
+	fprintf(file, "%llu\n%s\n", frequency, identity.c_str());
+	fclose(file);
+}
+
+/**
+ * @brief TSC ticks per second from the first source that knows it, calling measure() and caching its result
+ *        on disk only when none does.
+ */
+template <typename MeasureFunction>
+u64 DiscoverTscFrequency(MeasureFunction&& measure)
+{
+	if (const u64 frequency = ReadTscFrequencyFromCpuid()) {
+		return frequency;
+	}
+
+	if (const u64 frequency = ReadTscFrequencyFromKernel()) {
+		return frequency;
+	}
+
+	const std::string path = GetTscFrequencyCachePath();
+	const std::string identity = GetCpuIdentity();
+	if (const u64 frequency = LoadCachedTscFrequency(path, identity)) {
+		return frequency;
+	}
+
+	const u64 frequency = measure();
+	if (frequency) {
+		StoreCachedTscFrequency(path, identity, frequency);
+	}
+
+	return frequency;
+}
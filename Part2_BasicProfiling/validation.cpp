@@ -0,0 +1,234 @@
+#include "validation.h"
+
+#include "mapped_file.h"
+#include "profiler.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <bit>
+#include <emmintrin.h>
+
+/* NOTE(Umut): Constants of GetErrorBuckets. Adding ROUNDING to the biased exponent lines the bucket edges up
+   with multiples of the step, so a single shift gives the bucket up to a constant. */
+static_assert(std::has_single_bit(static_cast<u32>(ERROR_HISTOGRAM_EXPONENT_STEP)), "GetErrorBuckets divides by shifting");
+const s32 ERROR_HISTOGRAM_STEP_SHIFT = std::countr_zero(static_cast<u32>(ERROR_HISTOGRAM_EXPONENT_STEP));
+const s64 ERROR_HISTOGRAM_BIASED_MIN = 1023 + ERROR_HISTOGRAM_MIN_EXPONENT;
+const s64 ERROR_HISTOGRAM_ROUNDING = (ERROR_HISTOGRAM_EXPONENT_STEP - ERROR_HISTOGRAM_BIASED_MIN % ERROR_HISTOGRAM_EXPONENT_STEP) % ERROR_HISTOGRAM_EXPONENT_STEP;
+const s64 ERROR_HISTOGRAM_BUCKET_OFFSET = (ERROR_HISTOGRAM_BIASED_MIN + ERROR_HISTOGRAM_ROUNDING) / ERROR_HISTOGRAM_EXPONENT_STEP - 2;
+
+// Histogram copies the main loop spreads its increments over, one per lane of the two vectors it takes at a time.
+const u32 HISTOGRAM_COPY_COUNT = 4;
+
+static u32 GetErrorBucket(const f64 absError)
+{
+	u64 bits;
+	memcpy(&bits, &absError, sizeof(bits));
+	if (!bits) {
+		return 0;
+	}
+
+	const s32 exponent = static_cast<s32>(bits >> 52) - 1023;
+	if (exponent < ERROR_HISTOGRAM_MIN_EXPONENT) {
+		return 1;
+	}
+
+	const s32 bucket = (exponent - ERROR_HISTOGRAM_MIN_EXPONENT) / ERROR_HISTOGRAM_EXPONENT_STEP + 2;
+	return (bucket < static_cast<s32>(ERROR_HISTOGRAM_BUCKET_COUNT)) ? bucket : (ERROR_HISTOGRAM_BUCKET_COUNT - 1);
+}
+
+/**
+ * @brief GetErrorBucket for both lanes of a vector of absolute errors, in the low word of each 64 bit lane, except
+ *        that exact zeros land in bucket 1 and NaNs in the last bucket. The caller counts both and moves them.
+ */
+static __m128i GetErrorBuckets(const __m128d absError)
+{
+	// NOTE(Umut): The shifted exponent fits in 16 bits, the only width SSE2 has a min and max for. The constants
+	// only sit in the low word of every lane, so the other words stay 0. An exponent of 2047 carries into the
+	// sign bit, which the shift keeps as a large value that clamps to the last bucket like infinity should.
+	const __m128i rounded = _mm_add_epi64(_mm_castpd_si128(absError), _mm_set1_epi64x(ERROR_HISTOGRAM_ROUNDING << 52));
+	const __m128i bucket = _mm_sub_epi16(_mm_srli_epi64(rounded, 52 + ERROR_HISTOGRAM_STEP_SHIFT), _mm_set1_epi64x(ERROR_HISTOGRAM_BUCKET_OFFSET));
+	return _mm_min_epi16(_mm_max_epi16(bucket, _mm_set1_epi64x(1)), _mm_set1_epi64x(ERROR_HISTOGRAM_BUCKET_COUNT - 1));
+}
+
+static f64 GetBucketUpperBound(const u32 bucket)
+{
+	const s32 exponent = ERROR_HISTOGRAM_MIN_EXPONENT + (static_cast<s32>(bucket) - 1) * ERROR_HISTOGRAM_EXPONENT_STEP;
+	return ldexp(1.0, exponent);
+}
+
+// NOTE(Umut): A NaN error compares false against everything, outliers are ranked with NaN above any finite error.
+static f64 GetOutlierRank(const f64 error)
+{
+	return isnan(error) ? INFINITY : error;
+}
+
+/**
+ * @brief Insert into the sorted outlier list. Returns the rank a new candidate has to beat.
+ */
+static f64 InsertOutlier(ValidationStats& stats, const ValidationOutlier& outlier)
+{
+	const f64 rank = GetOutlierRank(outlier.error);
+	u32 idx = (stats.outlierCount < WORST_OUTLIER_COUNT) ? stats.outlierCount++ : (WORST_OUTLIER_COUNT - 1);
+	for (; (idx > 0) && (GetOutlierRank(stats.outliers[idx - 1].error) < rank); --idx) {
+		stats.outliers[idx] = stats.outliers[idx - 1];
+	}
+	stats.outliers[idx] = outlier;
+
+	return (stats.outlierCount < WORST_OUTLIER_COUNT) ? -1.0 : GetOutlierRank(stats.outliers[WORST_OUTLIER_COUNT - 1].error);
+}
+
+bool ValidatePairDistances(const f64* distances, const u64 pairCount, const MappedFile& answersFile, ValidationStats& statsOut)
+{
+	statsOut = ValidationStats{};
+
+	if (!IsValid(answersFile)) {
+		fprintf(stderr, "ERROR: Answers file is not mapped\n");
+		return false;
+	}
+
+	const u64 answerPairCount = (answersFile.size / sizeof(f64)) - 1;
+	if ((answersFile.size % sizeof(f64)) || (pairCount != answerPairCount)) {
+		fprintf(stderr, "ERROR: Pair count does not match! (%llu computed, %llu in answers)\n", pairCount, answerPairCount);
+		return false;
+	}
+
+	PROFILE_GROUP_FUNCTION("validate", ProfileWork{ 2 * pairCount * sizeof(f64), 0, 0 });
+
+	const f64* answers = reinterpret_cast<const f64*>(answersFile.data);
+	statsOut.pairCount = pairCount;
+	statsOut.referenceMean = answers[pairCount];
+
+	// NOTE(Umut): Consecutive pairs mostly land in the same bucket. One histogram copy per lane keeps the
+	// increments from serializing on the same counter.
+	u64 histogram[HISTOGRAM_COPY_COUNT][ERROR_HISTOGRAM_BUCKET_COUNT] = {};
+	__m128i zeroCounts = _mm_setzero_si128();
+	__m128i nanCounts = _mm_setzero_si128();
+
+	const __m128d absMask = _mm_castsi128_pd(_mm_set1_epi64x(0x7fffffffffffffffll));
+	__m128d maxError = _mm_setzero_pd();
+	__m128d sumError = _mm_setzero_pd();
+	f64 outlierThreshold = -1.0;
+	__m128d threshold = _mm_set1_pd(outlierThreshold);
+
+	/* NOTE(Umut): NaN errors are counted on their own and kept out of the max, the mean and the histogram, so
+	   those stay about the pairs that compare. They always make it to the outliers, ahead of finite errors.
+	   _mm_max_pd returns its second operand when either one is NaN, which keeps maxError finite. Buckets are
+	   computed in SIMD and the errors only go through memory for the rare pairs that can be an outlier, so the
+	   loop keeps up with the loads. A compare mask is all ones, -1, subtracting it counts. */
+	u64 idx = 0;
+	for (; idx + 4 <= pairCount; idx += 4) {
+		const __m128d error0 = _mm_and_pd(_mm_sub_pd(_mm_loadu_pd(distances + idx), _mm_loadu_pd(answers + idx)), absMask);
+		const __m128d error1 = _mm_and_pd(_mm_sub_pd(_mm_loadu_pd(distances + idx + 2), _mm_loadu_pd(answers + idx + 2)), absMask);
+		const __m128d nanMask0 = _mm_cmpunord_pd(error0, error0);
+		const __m128d nanMask1 = _mm_cmpunord_pd(error1, error1);
+
+		maxError = _mm_max_pd(error0, _mm_max_pd(error1, maxError));
+		sumError = _mm_add_pd(sumError, _mm_add_pd(_mm_andnot_pd(nanMask0, error0), _mm_andnot_pd(nanMask1, error1)));
+
+		const __m128i buckets0 = GetErrorBuckets(error0);
+		const __m128i buckets1 = GetErrorBuckets(error1);
+		++histogram[0][_mm_cvtsi128_si64(buckets0)];
+		++histogram[1][_mm_cvtsi128_si64(_mm_unpackhi_epi64(buckets0, buckets0))];
+		++histogram[2][_mm_cvtsi128_si64(buckets1)];
+		++histogram[3][_mm_cvtsi128_si64(_mm_unpackhi_epi64(buckets1, buckets1))];
+
+		const __m128i zeroMask0 = _mm_castpd_si128(_mm_cmpeq_pd(error0, _mm_setzero_pd()));
+		const __m128i zeroMask1 = _mm_castpd_si128(_mm_cmpeq_pd(error1, _mm_setzero_pd()));
+		zeroCounts = _mm_sub_epi64(_mm_sub_epi64(zeroCounts, zeroMask0), zeroMask1);
+		nanCounts = _mm_sub_epi64(_mm_sub_epi64(nanCounts, _mm_castpd_si128(nanMask0)), _mm_castpd_si128(nanMask1));
+
+		const __m128d candidates0 = _mm_or_pd(_mm_cmpgt_pd(error0, threshold), nanMask0);
+		const __m128d candidates1 = _mm_or_pd(_mm_cmpgt_pd(error1, threshold), nanMask1);
+		if (_mm_movemask_pd(_mm_or_pd(candidates0, candidates1))) {
+			alignas(16) f64 errors[4];
+			_mm_store_pd(errors, error0);
+			_mm_store_pd(errors + 2, error1);
+			for (u64 lane = 0; lane < 4; ++lane) {
+				if (GetOutlierRank(errors[lane]) > outlierThreshold) {
+					const u64 pairIdx = idx + lane;
+					outlierThreshold = InsertOutlier(statsOut, { pairIdx, distances[pairIdx], answers[pairIdx], errors[lane] });
+				}
+			}
+			threshold = _mm_set1_pd(outlierThreshold);
+		}
+	}
+
+	for (u32 bucket = 0; bucket < ERROR_HISTOGRAM_BUCKET_COUNT; ++bucket) {
+		for (u32 copy = 0; copy < HISTOGRAM_COPY_COUNT; ++copy) {
+			statsOut.histogram[bucket] += histogram[copy][bucket];
+		}
+	}
+
+	const u64 zeroCount = _mm_cvtsi128_si64(zeroCounts) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(zeroCounts, zeroCounts));
+	u64 nanCount = _mm_cvtsi128_si64(nanCounts) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(nanCounts, nanCounts));
+	statsOut.histogram[1] -= zeroCount;
+	statsOut.histogram[0] += zeroCount;
+	statsOut.histogram[ERROR_HISTOGRAM_BUCKET_COUNT - 1] -= nanCount;
+
+	alignas(16) f64 maxErrors[2];
+	alignas(16) f64 sumErrors[2];
+	_mm_store_pd(maxErrors, maxError);
+	_mm_store_pd(sumErrors, sumError);
+	f64 maxErrorTotal = (maxErrors[0] > maxErrors[1]) ? maxErrors[0] : maxErrors[1];
+	f64 sumErrorTotal = sumErrors[0] + sumErrors[1];
+
+	for (; idx < pairCount; ++idx) {
+		const f64 diff = distances[idx] - answers[idx];
+		const f64 error = (diff < 0) ? -diff : diff;
+		if (isnan(error)) {
+			++nanCount;
+		}
+		else {
+			maxErrorTotal = (error > maxErrorTotal) ? error : maxErrorTotal;
+			sumErrorTotal += error;
+			++statsOut.histogram[GetErrorBucket(error)];
+		}
+
+		if (GetOutlierRank(error) > outlierThreshold) {
+			outlierThreshold = InsertOutlier(statsOut, { idx, distances[idx], answers[idx], error });
+		}
+	}
+
+	const u64 finiteCount = pairCount - nanCount;
+	statsOut.nanCount = nanCount;
+	statsOut.maxError = maxErrorTotal;
+	statsOut.meanError = finiteCount ? (sumErrorTotal / static_cast<f64>(finiteCount)) : 0.0;
+
+	return true;
+}
+
+void PrintValidationStats(const ValidationStats& stats)
+{
+	printf("Per-pair validation (%llu pairs):\n", stats.pairCount);
+	printf("  Max error: %.16f\n", stats.maxError);
+	printf("  Mean error: %.16f\n", stats.meanError);
+	if (stats.nanCount) {
+		printf("  NaN errors: %llu (left out of the max, the mean and the histogram)\n", stats.nanCount);
+	}
+
+	printf("  Error histogram:\n");
+	for (u32 bucket = 0; bucket < ERROR_HISTOGRAM_BUCKET_COUNT; ++bucket) {
+		if (!stats.histogram[bucket]) {
+			continue;
+		}
+
+		const f64 percentage = 100.0 * static_cast<f64>(stats.histogram[bucket]) / static_cast<f64>(stats.pairCount);
+		if (bucket == 0) {
+			printf("    %-12s %12llu (%.2f%%)\n", "exact", stats.histogram[bucket], percentage);
+		}
+		else if (bucket == ERROR_HISTOGRAM_BUCKET_COUNT - 1) {
+			printf("    >= %-9.3g %12llu (%.2f%%)\n", GetBucketUpperBound(bucket - 1), stats.histogram[bucket], percentage);
+		}
+		else {
+			printf("    < %-10.3g %12llu (%.2f%%)\n", GetBucketUpperBound(bucket), stats.histogram[bucket], percentage);
+		}
+	}
+
+	printf("  Worst outliers:\n");
+	for (u32 i = 0; i < stats.outlierCount; ++i) {
+		const ValidationOutlier& outlier = stats.outliers[i];
+		printf("    [%llu] computed: %.16f, reference: %.16f, error: %.16f\n",
+			   outlier.pairIndex, outlier.computed, outlier.reference, outlier.error);
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "basedef.h"
+#include "mapped_file.h"
+
+// NOTE(Umut): Error histogram buckets are spaced by binary exponent of the absolute error.
+// Bucket 0 counts exact matches, bucket 1 everything below 2^ERROR_HISTOGRAM_MIN_EXPONENT
+// and the last bucket everything from 2^(MIN + (COUNT - 3) * STEP) upwards.
+const u32 ERROR_HISTOGRAM_BUCKET_COUNT = 16;
+const s32 ERROR_HISTOGRAM_MIN_EXPONENT = -48;
+const s32 ERROR_HISTOGRAM_EXPONENT_STEP = 4;
+
+const u32 WORST_OUTLIER_COUNT = 8;
+
+struct ValidationOutlier
+{
+	u64 pairIndex = 0;
+	f64 computed = 0;
+	f64 reference = 0;
+	f64 error = 0;
+};
+
+struct ValidationStats
+{
+	u64 pairCount = 0;
+	f64 referenceMean = 0;
+	// NOTE(Umut): Max, mean and histogram only cover the pairs with a finite error, the others are counted here.
+	u64 nanCount = 0;
+	f64 maxError = 0;
+	f64 meanError = 0;
+	u64 histogram[ERROR_HISTOGRAM_BUCKET_COUNT] = {};
+
+	// NOTE(Umut): Sorted from the worst to the least bad.
+	ValidationOutlier outliers[WORST_OUTLIER_COUNT] = {};
+	u32 outlierCount = 0;
+};
+
+/**
+ * @brief Compare every computed pair distance against the matching entry of the answers file.
+ *
+ * @distances Computed distance of each pair, in the same order as the generated data.
+ * @pairCount Number of computed distances.
+ * @answersFile Mapped binary answers file written by the generator (per-pair f64s followed by the mean).
+ * @statsOut Error statistics of the comparison.
+ */
+bool ValidatePairDistances(const f64* distances, const u64 pairCount, const MappedFile& answersFile, ValidationStats& statsOut);
+
+void PrintValidationStats(const ValidationStats& stats);
@@ -10,6 +10,8 @@
 #include "read_write_tests.h"
 #include "os_fault_counter.h"
 #include "virtual_address_analysis.h"
+#include "math_tests.h"
+#include "profiler_tests.h"
 
 
 TestInfo readTests[] = {
@@ -58,6 +60,11 @@ int main(int ArgCount, char** Args)
 	const bool isForward = true;
 	TestPageFaultCounter(isForward);
 
+	//RunMathTests(GetEstimatedCPUFrequency());
+
+	//RunProfilerTests(GetEstimatedCPUFrequency());
+	//RunTimestampModeTests(GetEstimatedCPUFrequency());
+
 	//DoVirtualAddressAnalysis();
 
 	return 0;
@@ -0,0 +1,412 @@
+#include "math_tests.h"
+
+#include "platform_metrics.h"
+#include "../Part2_BasicProfiling/math_approx.h"
+#include "../Part2_BasicProfiling/cpu_features.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <assert.h>
+#include <random>
+#include <string>
+#include <immintrin.h>
+
+// NOTE(Umut): Same as haversine_batch.cpp, GCC and clang only emit AVX inside functions compiled for it.
+#if _MSC_VER
+#define BEGIN_TARGET_AVX2
+#define END_TARGET
+#else
+#define BEGIN_TARGET_AVX2 _Pragma("GCC push_options") _Pragma("GCC target(\"avx2\")")
+#define END_TARGET _Pragma("GCC pop_options")
+#endif
+
+using ScalarFunction = f64 (*)(f64);
+using SseFunction = __m128d (*)(__m128d);
+using AvxFunction = __m256d (*)(__m256d);
+
+// NOTE(Umut): 16kb of inputs, stays in L1 so the loads never show up in the numbers.
+const u64 MATH_INPUT_COUNT = 2048;
+const u64 MATH_INPUT_SEED = 0x5eed;
+
+struct MathKernel
+{
+	const char* name;
+	TestFunction throughput;
+	TestFunction latency;
+	u32 width;
+};
+
+struct MathKernelGroup
+{
+	const char* name;
+	std::vector<MathKernel> kernels;
+	std::vector<MathInputRange> ranges;
+};
+
+struct MathKernelResult
+{
+	f64 throughputCyclesPerOp;
+	f64 latencyCyclesPerOp;
+};
+
+static void BeginTime(RepetitionValue& result)
+{
+	result.elapsedCpuTime -= ReadCPUTimer();
+}
+
+static void EndTime(RepetitionValue& result)
+{
+	result.elapsedCpuTime += ReadCPUTimer();
+}
+
+static f64 Identity(const f64 x) { return x; }
+static f64 SinLibm(const f64 x) { return sin(x); }
+static f64 CosLibm(const f64 x) { return cos(x); }
+static f64 AsinLibm(const f64 x) { return asin(x); }
+static f64 SqrtLibm(const f64 x) { return sqrt(x); }
+
+static __m128d IdentitySse(const __m128d x) { return x; }
+static __m128d SqrtSse2(const __m128d x) { return _mm_sqrt_pd(x); }
+
+BEGIN_TARGET_AVX2
+static __m256d IdentityAvx(const __m256d x) { return x; }
+static __m256d SqrtAvx(const __m256d x) { return _mm256_sqrt_pd(x); }
+END_TARGET
+
+#if _MSC_VER
+// NOTE(Umut): SVML intrinsics, only shipped with MSVC and ICC.
+static __m128d SinSvmlSse(const __m128d x) { return _mm_sin_pd(x); }
+static __m128d CosSvmlSse(const __m128d x) { return _mm_cos_pd(x); }
+static __m128d AsinSvmlSse(const __m128d x) { return _mm_asin_pd(x); }
+static __m256d SinSvmlAvx(const __m256d x) { return _mm256_sin_pd(x); }
+static __m256d CosSvmlAvx(const __m256d x) { return _mm256_cos_pd(x); }
+static __m256d AsinSvmlAvx(const __m256d x) { return _mm256_asin_pd(x); }
+#endif
+
+/* NOTE(Umut): Throughput tests count every element as an op and keep four independent accumulators,
+   so only the function itself limits how many calls are in flight. Latency tests count every dependent
+   call as an op, whatever its width. */
+template <ScalarFunction F>
+static TestResult TestScalarThroughput(ITestParameters* params)
+{
+	MathTestParameters* mathParams = static_cast<MathTestParameters*>(params);
+	TestResult res{};
+	RepetitionValue& value = res.value;
+
+	const f64* inputs = mathParams->inputs.data();
+	const u64 count = mathParams->inputs.size();
+	value.byteCount = count * sizeof(f64);
+	value.opCount = count;
+
+	f64 sum0 = 0.0;
+	f64 sum1 = 0.0;
+	f64 sum2 = 0.0;
+	f64 sum3 = 0.0;
+
+	BeginTime(value);
+	for (u64 i = 0; i < count; i += 4) {
+		sum0 += F(inputs[i + 0]);
+		sum1 += F(inputs[i + 1]);
+		sum2 += F(inputs[i + 2]);
+		sum3 += F(inputs[i + 3]);
+	}
+	EndTime(value);
+
+	mathParams->sink += (sum0 + sum1) + (sum2 + sum3);
+	return res;
+}
+
+template <ScalarFunction F>
+static TestResult TestScalarLatency(ITestParameters* params)
+{
+	MathTestParameters* mathParams = static_cast<MathTestParameters*>(params);
+	TestResult res{};
+	RepetitionValue& value = res.value;
+
+	const f64* inputs = mathParams->inputs.data();
+	const u64 count = mathParams->inputs.size();
+	const f64 chainScale = mathParams->chainScale;
+	value.byteCount = count * sizeof(f64);
+	value.opCount = count;
+
+	f64 result = 0.0;
+
+	BeginTime(value);
+	for (u64 i = 0; i < count; ++i) {
+		result = F(inputs[i] + result * chainScale);
+	}
+	EndTime(value);
+
+	mathParams->sink += result;
+	return res;
+}
+
+template <SseFunction F>
+static TestResult TestSseThroughput(ITestParameters* params)
+{
+	MathTestParameters* mathParams = static_cast<MathTestParameters*>(params);
+	TestResult res{};
+	RepetitionValue& value = res.value;
+
+	const f64* inputs = mathParams->inputs.data();
+	const u64 count = mathParams->inputs.size();
+	value.byteCount = count * sizeof(f64);
+	value.opCount = count;
+
+	__m128d sum0 = _mm_setzero_pd();
+	__m128d sum1 = _mm_setzero_pd();
+
+	BeginTime(value);
+	for (u64 i = 0; i < count; i += 4) {
+		sum0 = _mm_add_pd(sum0, F(_mm_loadu_pd(inputs + i + 0)));
+		sum1 = _mm_add_pd(sum1, F(_mm_loadu_pd(inputs + i + 2)));
+	}
+	EndTime(value);
+
+	alignas(16) f64 sums[2];
+	_mm_store_pd(sums, _mm_add_pd(sum0, sum1));
+	mathParams->sink += sums[0] + sums[1];
+	return res;
+}
+
+template <SseFunction F>
+static TestResult TestSseLatency(ITestParameters* params)
+{
+	MathTestParameters* mathParams = static_cast<MathTestParameters*>(params);
+	TestResult res{};
+	RepetitionValue& value = res.value;
+
+	const f64* inputs = mathParams->inputs.data();
+	const u64 count = mathParams->inputs.size();
+	const __m128d chainScale = _mm_set1_pd(mathParams->chainScale);
+	value.byteCount = count * sizeof(f64);
+	value.opCount = count / 2;
+
+	__m128d result = _mm_setzero_pd();
+
+	BeginTime(value);
+	for (u64 i = 0; i < count; i += 2) {
+		result = F(_mm_add_pd(_mm_loadu_pd(inputs + i), _mm_mul_pd(result, chainScale)));
+	}
+	EndTime(value);
+
+	alignas(16) f64 results[2];
+	_mm_store_pd(results, result);
+	mathParams->sink += results[0] + results[1];
+	return res;
+}
+
+BEGIN_TARGET_AVX2
+template <AvxFunction F>
+static TestResult TestAvxThroughput(ITestParameters* params)
+{
+	MathTestParameters* mathParams = static_cast<MathTestParameters*>(params);
+	TestResult res{};
+	RepetitionValue& value = res.value;
+
+	const f64* inputs = mathParams->inputs.data();
+	const u64 count = mathParams->inputs.size();
+	value.byteCount = count * sizeof(f64);
+	value.opCount = count;
+
+	__m256d sum0 = _mm256_setzero_pd();
+	__m256d sum1 = _mm256_setzero_pd();
+
+	BeginTime(value);
+	for (u64 i = 0; i < count; i += 8) {
+		sum0 = _mm256_add_pd(sum0, F(_mm256_loadu_pd(inputs + i + 0)));
+		sum1 = _mm256_add_pd(sum1, F(_mm256_loadu_pd(inputs + i + 4)));
+	}
+	EndTime(value);
+
+	alignas(32) f64 sums[4];
+	_mm256_store_pd(sums, _mm256_add_pd(sum0, sum1));
+	mathParams->sink += (sums[0] + sums[1]) + (sums[2] + sums[3]);
+	return res;
+}
+
+template <AvxFunction F>
+static TestResult TestAvxLatency(ITestParameters* params)
+{
+	MathTestParameters* mathParams = static_cast<MathTestParameters*>(params);
+	TestResult res{};
+	RepetitionValue& value = res.value;
+
+	const f64* inputs = mathParams->inputs.data();
+	const u64 count = mathParams->inputs.size();
+	const __m256d chainScale = _mm256_set1_pd(mathParams->chainScale);
+	value.byteCount = count * sizeof(f64);
+	value.opCount = count / 4;
+
+	__m256d result = _mm256_setzero_pd();
+
+	BeginTime(value);
+	for (u64 i = 0; i < count; i += 4) {
+		result = F(_mm256_add_pd(_mm256_loadu_pd(inputs + i), _mm256_mul_pd(result, chainScale)));
+	}
+	EndTime(value);
+
+	alignas(32) f64 results[4];
+	_mm256_store_pd(results, result);
+	mathParams->sink += (results[0] + results[1]) + (results[2] + results[3]);
+	return res;
+}
+END_TARGET
+
+#define SCALAR_KERNEL(name, func) MathKernel{ name, TestScalarThroughput<func>, TestScalarLatency<func>, 1 }
+#define SSE_KERNEL(name, func) MathKernel{ name, TestSseThroughput<func>, TestSseLatency<func>, 2 }
+#define AVX_KERNEL(name, func) MathKernel{ name, TestAvxThroughput<func>, TestAvxLatency<func>, 4 }
+
+static std::vector<MathKernelGroup> GetMathKernelGroups()
+{
+	const std::vector<MathInputRange> sinCosRanges = {
+		{ "[-pi/4, pi/4]", -0.25 * PI64, 0.25 * PI64 },
+		{ "[-pi, pi]", -PI64, PI64 },
+		{ "[-1000, 1000]", -1000.0, 1000.0 },
+	};
+
+	const std::vector<MathInputRange> asinRanges = {
+		{ "[-0.5, 0.5]", -0.5, 0.5 },
+		{ "[-1, 1]", -1.0, 1.0 },
+	};
+
+	const std::vector<MathInputRange> sqrtRanges = {
+		{ "[0, 1]", 0.0, 1.0 },
+		{ "[0, 1e12]", 0.0, 1e12 },
+	};
+
+	return {
+		MathKernelGroup{ "sin", {
+			SCALAR_KERNEL("libm", SinLibm),
+			SCALAR_KERNEL("SinApprox", SinApprox),
+#if _MSC_VER
+			SSE_KERNEL("_mm_sin_pd", SinSvmlSse),
+			AVX_KERNEL("_mm256_sin_pd", SinSvmlAvx),
+#endif
+		}, sinCosRanges },
+		MathKernelGroup{ "cos", {
+			SCALAR_KERNEL("libm", CosLibm),
+			SCALAR_KERNEL("CosApprox", CosApprox),
+#if _MSC_VER
+			SSE_KERNEL("_mm_cos_pd", CosSvmlSse),
+			AVX_KERNEL("_mm256_cos_pd", CosSvmlAvx),
+#endif
+		}, sinCosRanges },
+		MathKernelGroup{ "asin", {
+			SCALAR_KERNEL("libm", AsinLibm),
+			SCALAR_KERNEL("AsinApprox", AsinApprox),
+#if _MSC_VER
+			SSE_KERNEL("_mm_asin_pd", AsinSvmlSse),
+			AVX_KERNEL("_mm256_asin_pd", AsinSvmlAvx),
+#endif
+		}, asinRanges },
+		MathKernelGroup{ "sqrt", {
+			SCALAR_KERNEL("libm", SqrtLibm),
+			SCALAR_KERNEL("_mm_sqrt_sd", SqrtSse),
+			SCALAR_KERNEL("SqrtApprox", SqrtApprox),
+			SSE_KERNEL("_mm_sqrt_pd", SqrtSse2),
+			AVX_KERNEL("_mm256_sqrt_pd", SqrtAvx),
+		}, sqrtRanges },
+	};
+}
+
+static f64 MeasureCyclesPerOp(const u64 cpuFreq, const TestInfo& testInfo, const MathInputRange& range, const u32 secondsToTry)
+{
+	RepetitionTester tester(cpuFreq, testInfo);
+	tester.NewTestWave(MATH_INPUT_COUNT * sizeof(f64), range.label, secondsToTry);
+	tester.DoTest();
+
+	const RepetitionValue& best = tester.stats.min;
+	if ((tester.mode == TestMode::Error) || !best.opCount) {
+		return 0.0;
+	}
+
+	return static_cast<f64>(best.elapsedCpuTime) / static_cast<f64>(best.opCount);
+}
+
+MathTestParameters::MathTestParameters(const u64 inputCount)
+	: inputs(inputCount)
+	, chainScale(0.0)
+	, sink(0.0)
+{
+	assert((inputCount % 8) == 0);
+}
+
+void MathTestParameters::FillInputs(const MathInputRange& range)
+{
+	std::mt19937_64 generator(MATH_INPUT_SEED);
+	std::uniform_real_distribution<f64> dist(range.min, range.max);
+	for (f64& input : inputs) {
+		input = dist(generator);
+	}
+}
+
+static f64 GetChainCycles(const u32 width, const f64 scalarChainCycles, const f64 sseChainCycles, const f64 avxChainCycles)
+{
+	switch (width) {
+		case 1:
+			return scalarChainCycles;
+		case 2:
+			return sseChainCycles;
+		case 4:
+			return avxChainCycles;
+		default:
+			return 0.0;
+	}
+}
+
+void RunMathTests(const u64 cpuFreq, const u32 secondsToTry)
+{
+	MathTestParameters params(MATH_INPUT_COUNT);
+	// The 256 bit kernels are compiled for AVX2 like the rest of the AVX paths, only run them where it is there.
+	const b32 hasAvx = GetCpuFeatures().avx2;
+
+	// NOTE(Umut): The latency chain adds a mul and an add to every call, measure it once to subtract it.
+	const MathInputRange chainRange = { "chain overhead", 0.0, 1.0 };
+	params.FillInputs(chainRange);
+	const f64 scalarChainCycles = MeasureCyclesPerOp(cpuFreq, TestInfo{ "scalar latency", TestScalarLatency<Identity>, &params }, chainRange, secondsToTry);
+	const f64 sseChainCycles = MeasureCyclesPerOp(cpuFreq, TestInfo{ "sse latency", TestSseLatency<IdentitySse>, &params }, chainRange, secondsToTry);
+	const f64 avxChainCycles = hasAvx ? MeasureCyclesPerOp(cpuFreq, TestInfo{ "avx latency", TestAvxLatency<IdentityAvx>, &params }, chainRange, secondsToTry) : 0.0;
+
+	const std::vector<MathKernelGroup> groups = GetMathKernelGroups();
+	for (const MathKernelGroup& group : groups) {
+		std::vector<std::vector<MathKernelResult>> results(group.ranges.size(), std::vector<MathKernelResult>(group.kernels.size()));
+
+		for (size_t rangeIdx = 0; rangeIdx < group.ranges.size(); ++rangeIdx) {
+			const MathInputRange& range = group.ranges[rangeIdx];
+			params.FillInputs(range);
+
+			for (size_t kernelIdx = 0; kernelIdx < group.kernels.size(); ++kernelIdx) {
+				const MathKernel& kernel = group.kernels[kernelIdx];
+				if ((kernel.width == 4) && !hasAvx) {
+					continue;
+				}
+
+				const std::string name = std::string(group.name) + " " + kernel.name;
+				MathKernelResult& result = results[rangeIdx][kernelIdx];
+				result.throughputCyclesPerOp = MeasureCyclesPerOp(cpuFreq, TestInfo{ name + " throughput", kernel.throughput, &params }, range, secondsToTry);
+				result.latencyCyclesPerOp = MeasureCyclesPerOp(cpuFreq, TestInfo{ name + " latency", kernel.latency, &params }, range, secondsToTry);
+			}
+		}
+
+		printf("\n=== %s (TSC cycles, throughput per element, latency per dependent call) ===\n", group.name);
+		printf("%-16s %-16s %10s %10s %10s %10s\n", "kernel", "range", "thr c/op", "thr op/c", "lat c/op", "lat-chain");
+
+		for (size_t rangeIdx = 0; rangeIdx < group.ranges.size(); ++rangeIdx) {
+			for (size_t kernelIdx = 0; kernelIdx < group.kernels.size(); ++kernelIdx) {
+				const MathKernel& kernel = group.kernels[kernelIdx];
+				const MathKernelResult& result = results[rangeIdx][kernelIdx];
+				if (result.throughputCyclesPerOp <= 0.0) {
+					continue;
+				}
+
+				const f64 chainCycles = GetChainCycles(kernel.width, scalarChainCycles, sseChainCycles, avxChainCycles);
+				printf("%-16s %-16s %10.2f %10.3f %10.2f %10.2f\n", kernel.name, group.ranges[rangeIdx].label,
+					   result.throughputCyclesPerOp, 1.0 / result.throughputCyclesPerOp,
+					   result.latencyCyclesPerOp, result.latencyCyclesPerOp - chainCycles);
+			}
+		}
+	}
+
+	printf("\n(sink %f)\n", params.sink);
+}
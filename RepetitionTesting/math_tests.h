@@ -0,0 +1,34 @@
+#pragma once
+
+#include "repetition_tester.h"
+
+#include <vector>
+
+struct MathInputRange
+{
+	const char* label;
+	f64 min;
+	f64 max;
+};
+
+struct MathTestParameters : ITestParameters
+{
+	MathTestParameters(const u64 inputCount);
+
+	void FillInputs(const MathInputRange& range);
+
+	std::vector<f64> inputs;
+
+	// NOTE(Umut): Always zero. Latency tests feed the previous result back as "input + result * chainScale";
+	// reading the scale from memory keeps the compiler from breaking the dependency.
+	f64 chainScale;
+
+	// NOTE(Umut): Results are accumulated here so the measured calls cannot be optimized out.
+	f64 sink;
+};
+
+/**
+ * @brief Measure throughput (independent inputs) and latency (dependent chain) of the libm,
+ *        approximated and SIMD candidates for sin, cos, asin and sqrt, per input range.
+ */
+void RunMathTests(const u64 cpuFreq, const u32 secondsToTry = 2);
@@ -1,8 +1,9 @@
 #include "platform_metrics.h"
+#include "../Part2_BasicProfiling/tsc_frequency.h"
 
 #include <psapi.h>
 
-u64 GetEstimatedCPUFrequency()
+static u64 MeasureCPUFrequency()
 {
 	const u64 MILISECONDS_TO_WAIT = 100;
 	const u64 OSFreq = GetOSTimerFreq();
@@ -27,6 +28,13 @@ u64 GetEstimatedCPUFrequency()
 	return cpuFreq;
 }
 
+u64 GetEstimatedCPUFrequency()
+{
+	// NOTE(Umut): Resolved once per process, every report and the profiler ask for it.
+	static const u64 cpuFreq = DiscoverTscFrequency(MeasureCPUFrequency);
+	return cpuFreq;
+}
+
 void InitializeOsMetrics()
 {
 	if (globalMetrics.initialized) {
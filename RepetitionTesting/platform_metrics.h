@@ -51,21 +51,22 @@ inline u64 ReadOSTimer(void)
 #else
 
 #include <x86intrin.h>
-#include <sys/time.h>
+#include <time.h>
 
+#include "../Part2_BasicProfiling/basedef.h"
+
+// NOTE(Umut): clock_gettime instead of gettimeofday for nanosecond resolution, RAW so NTP slewing doesn't bend the rate.
 static u64 GetOSTimerFreq(void)
 {
-	return 1000000;
+	return 1000000000;
 }
 
 static u64 ReadOSTimer(void)
 {
-	// NOTE(casey): The "struct" keyword is not necessary here when compiling in C++,
-	// but just in case anyone is using this file from C, I include it.
-	struct timeval Value;
-	gettimeofday(&Value, 0);
+	struct timespec Value;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &Value);
 
-	u64 Result = GetOSTimerFreq() * (u64)Value.tv_sec + (u64)Value.tv_usec;
+	u64 Result = GetOSTimerFreq() * (u64)Value.tv_sec + (u64)Value.tv_nsec;
 	return Result;
 }
 
@@ -0,0 +1,235 @@
+#include "profiler_tests.h"
+
+#include "../Part2_BasicProfiling/profiler.h"
+
+#include <stdio.h>
+#include <math.h>
+
+// NOTE(Umut): 32kb of values, stays in L1 so the loads never show up in the numbers.
+const u64 PROFILER_TEST_VALUE_COUNT = 4096;
+
+const u64 TIMESTAMP_TEST_BLOCK_COUNT = 4096;
+// Rough core cycles of work inside the timed blocks, the empty one gives the reading the profiler subtracts.
+const u32 TIMESTAMP_WORK_CYCLES[] = { 0, 10, 100, 1000 };
+const u32 TIMESTAMP_WORK_SIZE_COUNT = ARRAY_SIZE(TIMESTAMP_WORK_CYCLES);
+
+enum class ProfilerTestBlock : u8
+{
+	None,
+	GroupOn,
+	GroupOff,
+};
+
+static void BeginTime(RepetitionValue& result)
+{
+	result.elapsedCpuTime -= ReadCPUTimer();
+}
+
+static void EndTime(RepetitionValue& result)
+{
+	result.elapsedCpuTime += ReadCPUTimer();
+}
+
+/* NOTE(Umut): Every iteration is one multiply-add on a chain through the previous one, a few cycles of work the
+   block's own instructions can overlap with, the way they would in a real loop. Every block counts as an op. */
+template <ProfilerTestBlock B>
+static TestResult TestProfileBlocks(ITestParameters* params)
+{
+	ProfilerTestParameters* profilerParams = static_cast<ProfilerTestParameters*>(params);
+	TestResult res{};
+	RepetitionValue& value = res.value;
+
+	const u64* values = profilerParams->values.data();
+	const u64 count = profilerParams->values.size();
+	value.byteCount = count * sizeof(u64);
+	value.opCount = count;
+
+	u64 result = 0;
+
+	BeginTime(value);
+	for (u64 i = 0; i < count; ++i) {
+		if constexpr (B == ProfilerTestBlock::GroupOn) {
+			PROFILE_GROUP_BLOCK("ProfilerTestOn", "ProfilerTestBlockOn");
+			result = result * 31 + values[i];
+		}
+		else if constexpr (B == ProfilerTestBlock::GroupOff) {
+			PROFILE_GROUP_BLOCK("ProfilerTestOff", "ProfilerTestBlockOff");
+			result = result * 31 + values[i];
+		}
+		else {
+			result = result * 31 + values[i];
+		}
+	}
+	EndTime(value);
+
+	profilerParams->sink += result;
+	return res;
+}
+
+// Reference for the timestamp modes, the same loop without any read.
+struct NoTimer
+{
+	static constexpr const char* name = "none";
+
+	static u64 ReadBegin() { return 0; }
+	static u64 ReadEnd() { return 0; }
+};
+
+/**
+ * @brief Chain of dependent xor and add pairs, two cycles a pair on current cores.
+ */
+template <u32 CycleCount>
+static u64 RunDependentWork(u64 value, const u64 key)
+{
+	for (u32 i = 0; i < CycleCount / 2; ++i) {
+		value = (value ^ key) + key;
+	}
+
+	return value;
+}
+
+/* NOTE(Umut): The work carries from one block to the next, so without fences the timestamp reads can only
+   overlap with it, never run ahead of it. Every block counts as an op. */
+template <typename Timer, u32 CycleCount>
+static TestResult TestTimestampMode(ITestParameters* params)
+{
+	TimestampTestParameters* timestampParams = static_cast<TimestampTestParameters*>(params);
+	TestResult res{};
+	RepetitionValue& value = res.value;
+	value.opCount = TIMESTAMP_TEST_BLOCK_COUNT;
+
+	const u64 key = timestampParams->key;
+	u64 work = timestampParams->work;
+	u64 reading = 0;
+
+	BeginTime(value);
+	for (u64 i = 0; i < TIMESTAMP_TEST_BLOCK_COUNT; ++i) {
+		const u64 begin = Timer::ReadBegin();
+		work = RunDependentWork<CycleCount>(work, key);
+		reading += Timer::ReadEnd() - begin;
+	}
+	EndTime(value);
+
+	const f64 averageReading = static_cast<f64>(reading) / TIMESTAMP_TEST_BLOCK_COUNT;
+	timestampParams->bestReading = (averageReading < timestampParams->bestReading) ? averageReading : timestampParams->bestReading;
+	timestampParams->work = work;
+	return res;
+}
+
+static f64 MeasureCyclesPerOp(const u64 cpuFreq, const TestInfo& testInfo, const u64 byteCount, const char* description, const u32 secondsToTry)
+{
+	RepetitionTester tester(cpuFreq, testInfo);
+	tester.NewTestWave(byteCount, description, secondsToTry);
+	tester.DoTest();
+
+	const RepetitionValue& best = tester.stats.min;
+	if ((tester.mode == TestMode::Error) || !best.opCount) {
+		return 0.0;
+	}
+
+	return static_cast<f64>(best.elapsedCpuTime) / static_cast<f64>(best.opCount);
+}
+
+struct TimestampModeResult
+{
+	const char* name;
+	// Loop ticks per block and average reading of the best run, for every work size.
+	f64 cyclesPerBlock[TIMESTAMP_WORK_SIZE_COUNT];
+	f64 readings[TIMESTAMP_WORK_SIZE_COUNT];
+};
+
+template <typename Timer>
+static TimestampModeResult MeasureTimestampMode(const u64 cpuFreq, TimestampTestParameters& params, const u32 secondsToTry)
+{
+	const TestFunction tests[TIMESTAMP_WORK_SIZE_COUNT] = {
+		TestTimestampMode<Timer, 0>,
+		TestTimestampMode<Timer, 10>,
+		TestTimestampMode<Timer, 100>,
+		TestTimestampMode<Timer, 1000>,
+	};
+
+	TimestampModeResult result = {};
+	result.name = Timer::name;
+	for (u32 size = 0; size < TIMESTAMP_WORK_SIZE_COUNT; ++size) {
+		const std::string name = std::string(Timer::name) + " around " + std::to_string(TIMESTAMP_WORK_CYCLES[size]) + " cycles";
+		params.bestReading = INFINITY;
+		result.cyclesPerBlock[size] = MeasureCyclesPerOp(cpuFreq, TestInfo{ name.c_str(), tests[size], &params }, 0, "timestamps", secondsToTry);
+		result.readings[size] = params.bestReading;
+	}
+
+	return result;
+}
+
+ProfilerTestParameters::ProfilerTestParameters(const u64 valueCount)
+	: values(valueCount)
+	, sink(0)
+{
+	for (u64 i = 0; i < valueCount; ++i) {
+		values[i] = i * 0x9e3779b97f4a7c15ull;
+	}
+}
+
+TimestampTestParameters::TimestampTestParameters()
+	: key(0x9e3779b97f4a7c15ull)
+	, work(0)
+	, bestReading(INFINITY)
+{
+}
+
+void RunProfilerTests(const u64 cpuFreq, const u32 secondsToTry)
+{
+	ProfilerTestParameters params(PROFILER_TEST_VALUE_COUNT);
+
+	// Group names are template arguments, so the blocks spell them out, every other group stays off from here on.
+	Profiler::EnableGroups("ProfilerTestOn");
+
+	const f64 noBlockCycles = MeasureCyclesPerOp(cpuFreq, TestInfo{ "no block", TestProfileBlocks<ProfilerTestBlock::None>, &params }, PROFILER_TEST_VALUE_COUNT * sizeof(u64), "profile blocks", secondsToTry);
+	const f64 groupOnCycles = MeasureCyclesPerOp(cpuFreq, TestInfo{ "group on", TestProfileBlocks<ProfilerTestBlock::GroupOn>, &params }, PROFILER_TEST_VALUE_COUNT * sizeof(u64), "profile blocks", secondsToTry);
+	const f64 groupOffCycles = MeasureCyclesPerOp(cpuFreq, TestInfo{ "group off", TestProfileBlocks<ProfilerTestBlock::GroupOff>, &params }, PROFILER_TEST_VALUE_COUNT * sizeof(u64), "profile blocks", secondsToTry);
+
+	printf("\n=== Profile block cost (TSC cycles per block, around a multiply-add chain) ===\n");
+	printf("%-24s %10s %10s\n", "block", "c/op", "added");
+	printf("%-24s %10.2f %10s\n", "none (compiled out)", noBlockCycles, "");
+	printf("%-24s %10.2f %10.2f\n", "group on", groupOnCycles, groupOnCycles - noBlockCycles);
+	printf("%-24s %10.2f %10.2f\n", "group off", groupOffCycles, groupOffCycles - noBlockCycles);
+#if !PROFILER
+	printf("(built without PROFILER, every block is compiled out)\n");
+#elif !PROFILER_RUNTIME_TOGGLE
+	printf("(built without PROFILER_RUNTIME_TOGGLE, groups can't be switched off and both blocks record)\n");
+#endif
+
+	printf("\n(sink %llu)\n", params.sink);
+}
+
+void RunTimestampModeTests(const u64 cpuFreq, const u32 secondsToTry)
+{
+	TimestampTestParameters params;
+
+	// NOTE(Umut): The OS timer counts in its own units and is left out, every mode here reads the TSC.
+	const TimestampModeResult reference = MeasureTimestampMode<NoTimer>(cpuFreq, params, secondsToTry);
+	const TimestampModeResult results[] = {
+		MeasureTimestampMode<RdtscTimer>(cpuFreq, params, secondsToTry),
+		MeasureTimestampMode<RdtscpTimer>(cpuFreq, params, secondsToTry),
+		MeasureTimestampMode<LfenceRdtscTimer>(cpuFreq, params, secondsToTry),
+		MeasureTimestampMode<RdtscpLfenceTimer>(cpuFreq, params, secondsToTry),
+		MeasureTimestampMode<CpuidTimer>(cpuFreq, params, secondsToTry),
+	};
+
+	// Work of a size is what its loop takes over the empty loop, both without any timestamp.
+	printf("\n=== Timestamp modes (TSC ticks per block; overhead is what the reads add to the loop, corrected is the reading minus the empty block's) ===\n");
+	printf("%-16s %8s %10s %10s %10s %10s %10s\n", "mode", "cycles", "work", "overhead", "reading", "corrected", "error");
+	for (const TimestampModeResult& result : results) {
+		for (u32 size = 0; size < TIMESTAMP_WORK_SIZE_COUNT; ++size) {
+			const f64 work = reference.cyclesPerBlock[size] - reference.cyclesPerBlock[0];
+			const f64 overhead = result.cyclesPerBlock[size] - reference.cyclesPerBlock[size];
+			const f64 corrected = result.readings[size] - result.readings[0];
+			printf("%-16s %8u %10.1f %10.1f %10.1f %10.1f", result.name, TIMESTAMP_WORK_CYCLES[size], work, overhead, result.readings[size], corrected);
+			if (size && (work > 0.0)) {
+				printf(" %+9.1f%%", 100.0 * (corrected - work) / work);
+			}
+			printf("\n");
+		}
+	}
+
+	printf("\n(work %llu)\n", params.work);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "repetition_tester.h"
+
+#include <vector>
+
+struct ProfilerTestParameters : ITestParameters
+{
+	ProfilerTestParameters(const u64 valueCount);
+
+	std::vector<u64> values;
+
+	// NOTE(Umut): Results are accumulated here so the measured loops cannot be optimized out.
+	u64 sink;
+};
+
+struct TimestampTestParameters : ITestParameters
+{
+	TimestampTestParameters();
+
+	// NOTE(Umut): Operand of the dependent work, read from memory so the compiler can't fold the chain.
+	u64 key;
+	u64 work;
+
+	// Lowest average reading over the runs of the current test, a run hit by an interrupt only raises its own.
+	f64 bestReading;
+};
+
+/**
+ * @brief Measure what a profile block adds to a loop of dependent work: with its group enabled, with its group
+ *        switched off at runtime, and against the same loop without any block, the cost of a compiled out one.
+ */
+void RunProfilerTests(const u64 cpuFreq, const u32 secondsToTry = 2);
+
+/**
+ * @brief For every timestamp mode the profiler can be built with, time blocks around roughly 10, 100 and 1000
+ *        cycles of dependent work: what the two reads add to the loop, what they report, and how far the
+ *        report is off from the work once the mode's empty block reading is subtracted, as the profiler does.
+ */
+void RunTimestampModeTests(const u64 cpuFreq, const u32 secondsToTry = 1);
@@ -49,6 +49,11 @@ static void PrintRepetitionValue(const char* label, const RepetitionValue& repVa
 		printf(" %fgb/s", gigabytesPerSec);
 	}
 
+	if (repVal.opCount > 0) {
+		const f64 cyclesPerOp = static_cast<f64>(repVal.elapsedCpuTime) / static_cast<f64>(repVal.opCount);
+		printf(" %.3fc/op %.3fop/c", cyclesPerOp, 1.0 / cyclesPerOp);
+	}
+
 	if (repVal.memPageFaults > 0) {
 		printf(" PF: %llu (%0.4fk/fault)", repVal.memPageFaults, static_cast<f64>(repVal.byteCount) / (repVal.memPageFaults * 1024.0));
 	}
@@ -132,6 +137,11 @@ void RepetitionTester::HandleError(const char* message)
 }
 
 void RepetitionTester::NewTestWave(const u64 byteCount, const AllocationType allocationType, const u32 secondsToTry)
+{
+	NewTestWave(byteCount, GetAllocationDescription(allocationType).c_str(), secondsToTry);
+}
+
+void RepetitionTester::NewTestWave(const u64 byteCount, const char* description, const u32 secondsToTry)
 {
 	if (mode == TestMode::Uninitialized) {
 		mode = TestMode::Testing;
@@ -144,7 +154,7 @@ void RepetitionTester::NewTestWave(const u64 byteCount, const AllocationType all
 
 	tryForTime = secondsToTry * cpuTimerFreq;
 
-	printf("--- %s (%s) ---\n", test.name.c_str(), GetAllocationDescription(allocationType).c_str());
+	printf("--- %s (%s) ---\n", test.name.c_str(), description);
 }
 
 RepetitionValue RepetitionValue::GetAverage(const size_t count) const
@@ -152,7 +162,8 @@ RepetitionValue RepetitionValue::GetAverage(const size_t count) const
 	const f64 divisor = static_cast<f64>(count);
 	return RepetitionValue{ static_cast<u64>(elapsedCpuTime / divisor),
 							static_cast<u64>(memPageFaults / divisor),
-							static_cast<u64>(byteCount / divisor)
+							static_cast<u64>(byteCount / divisor),
+							static_cast<u64>(opCount / divisor)
 						  };
 }
 
@@ -161,5 +172,6 @@ RepetitionValue& RepetitionValue::operator+=(const RepetitionValue& rhs)
 	elapsedCpuTime += rhs.elapsedCpuTime;
 	memPageFaults += rhs.memPageFaults;
 	byteCount += rhs.byteCount;
+	opCount += rhs.opCount;
 	return *this;
 }
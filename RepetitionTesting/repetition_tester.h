@@ -50,6 +50,7 @@ struct RepetitionValue
 	u64 elapsedCpuTime = 0;
 	u64 memPageFaults = 0;
 	u64 byteCount = 0;
+	u64 opCount = 0;
 
 	RepetitionValue GetAverage(const size_t count) const;
 	RepetitionValue& operator+= (const RepetitionValue& rhs);
@@ -89,6 +90,7 @@ struct RepetitionTester
 	void PrintResults();
 	void HandleError(const char* message);
 	void NewTestWave(const u64 byteCount, const AllocationType allocationType, const u32 secondsToTry = 10);
+	void NewTestWave(const u64 byteCount, const char* description, const u32 secondsToTry = 10);
 
 	u64 targetProcessedByteCount;
 	u64 cpuTimerFreq;